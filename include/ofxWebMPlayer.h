@@ -20,17 +20,225 @@ public:
 		unsigned long long	ms_decode_cur;
 		unsigned long long	ms_get_frame_worst;
 		unsigned long long	ms_decode_worst;
+		unsigned long long	us_audio_out_cur;
+		unsigned long long	us_audio_out_worst;
+		unsigned long long	us_audio_out_budget;	//the duration of one device buffer
+		unsigned long long	us_time_to_first_frame;	//load() until the first frame is on the texture
 	};
+
+	//The stages getStageTiming() times, in nanoseconds.
+	enum Stage
+	{
+		STAGE_READ,				//the file into memory, and what a live file appended
+		STAGE_DEMUX,			//the clusters into the frame index
+		STAGE_DECODE,			//vpx_codec_decode()
+		STAGE_CONVERT,			//vpx_codec_get_frame(), the decoded image out of libvpx
+		STAGE_UPLOAD,			//the planes to the textures
+		STAGE_FBO,				//the shader pass of the planes to the fbo
+		STAGE_AUDIO_CALLBACK,	//audioOut(), on the audio thread
+		STAGE_COUNT,
+	};
+
+	struct StageTiming
+	{
+		unsigned long long	count;
+		unsigned long long	total_ns;
+		unsigned long long	p50_ns;
+		unsigned long long	p95_ns;
+		unsigned long long	p99_ns;
+		unsigned long long	max_ns;
+	};
+#endif
+
+	struct AudioOutputSettings
+	{
+		int sample_rate;	//files at other rates are resampled, 0 opens the device at the file rate
+		int num_channels;	//the file layout is mixed down/up to this layout
+		int buffer_size;
+		int num_buffers;
+	};
+
+	//All the players share one output device, it is opened by the first play()
+	//with audio. The settings apply when the device is (re)opened.
+	static void setAudioOutputSettings(AudioOutputSettings const& settings);
+	static AudioOutputSettings const& getAudioOutputSettings();
+
+	//closes the shared output device, call it before the app exits.
+	static void closeAudioOutput();
+
+	//Default is true. A closed player leaves its decoder, textures, fbo, shader and
+	//movie buffer to the next load() of any player with the same codec and size.
+	static void enableResourcePool(bool yes);
+	//the bytes of idle movie buffers the pool keeps, default is 256 MB.
+	static void setResourcePoolMemoryLimit(size_t bytes);
+	//frees what the pool keeps, call it before the GL context goes away.
+	static void clearResourcePool();
+
+	//Default is 0, no budget. Over the budget the pool is trimmed first, then the
+	//players which are not playing and then the paused ones, the least recently
+	//played first, give back their movie, audio, index and decoder. They keep the
+	//last frame on screen and load again when they are played or seeked.
+	static void setMemoryBudget(size_t bytes);
+	//every player and the idle resources of the pool, the decoders and the GL estimated.
+	static size_t getTotalMemoryBytes();
+
+	//Default is false. Records update(), the decodes, the frames presented, the
+	//seeks, the audio callbacks and the load phases of every player, on every
+	//thread, into a ring per thread of the last events_per_thread events. The
+	//size applies to the threads which record for the first time.
+	static void enableTrace(bool yes, size_t events_per_thread = 65536);
+	//writes what the rings hold as Chrome trace JSON, for chrome://tracing or ui.perfetto.dev.
+	static bool dumpTrace(std::string path);
+	//the next dumpTrace() starts from now.
+	static void clearTrace();
+
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+	//logs the samples/s of the pcm interleave kernels, scalar against the ones picked for this cpu.
+	static void logAudioKernelThroughput();
 #endif
 
+	//How the pre-decoded audio is kept in memory.
+	enum AudioStorage
+	{
+		AUDIO_STORAGE_F32,		//32-bit float, lossless
+		AUDIO_STORAGE_S16,		//16-bit integer, half of the memory
+		AUDIO_STORAGE_ADPCM,	//4-bit IMA ADPCM blocks decoded on the fly, about 1/8 of the memory
+	};
+
+	enum Demuxer
+	{
+		DEMUXER_MKVPARSER,		//mkvparser, Segment::Load() or the lazy load
+		DEMUXER_WEBM_PARSER,	//webm::WebmParser, parses as the playback needs the frames, the file is still read whole.
+								//enableLive() uses it to start on a file still arriving, with bounded memory.
+	};
+
+	//What a player holds against the memory budget.
+	struct MemoryUsage
+	{
+		size_t	movie_bytes;
+		size_t	audio_bytes;
+		size_t	index_bytes;
+		size_t	decoder_bytes;	//estimated
+		size_t	gpu_bytes;		//estimated
+		size_t	total_bytes;
+		bool	is_degraded;	//gave its memory back to the budget, loads again when played
+	};
+
+	//Counters since the player was made or resetStats(), and gauges of now.
+	//getGlobalStats() sums the counters of every player there has been.
+	struct Stats
+	{
+		unsigned long long	bytes_read;				//the movie files, and what live files appended
+		unsigned long long	frames_decoded;
+		unsigned long long	frames_presented;		//drawn to the fbo
+		unsigned long long	frames_dropped;			//decoded to catch up, never presented
+		unsigned long long	texture_bytes_uploaded;
+		unsigned long long	audio_callbacks;
+		unsigned long long	audio_frames_out;		//at the rate of the file
+		unsigned long long	seeks;
+		unsigned long long	loads;
+		unsigned int		catch_up_depth;			//the frames the last update() decoded, 0 in the global stats
+		unsigned int		catch_up_depth_max;
+		unsigned long long	pcm_frames_total;		//the pre-decoded audio, 0 in the global stats
+		unsigned long long	pcm_frames_left;		//not played yet
+		unsigned int		players;				//alive, 1 in the stats of a player
+		size_t				memory_bytes;			//as getMemoryUsage() and getTotalMemoryBytes()
+	};
+
+	//What probe() finds in the headers. 0, -1 or empty when the file does not say.
+	struct MovieInfo
+	{
+		float		duration_s;
+		std::string	video_codec;		//"V_VP8", "V_VP9", empty without video
+		int			width;
+		int			height;
+		float		frame_rate;
+		bool		has_alpha;
+		int			video_bit_depth;	//BitsPerChannel of the Colour, 10 or 12 for the HDR masters
+		std::string	audio_codec;		//"A_VORBIS", "A_OPUS", empty without audio
+		int			audio_sample_rate;
+		int			audio_channels;
+		int			audio_bit_depth;
+		int			frame_count;		//-1 unless the movie has an index
+		int			key_frame_count;	//from the index, or the cues with read_cues, -1 otherwise
+	};
+
+	//A frame of decodeOffline(), the planes are valid during the callback only.
+	//The colour only, the alpha of a transparent movie is not decoded.
+	struct OfflineFrame
+	{
+		unsigned int			index;
+		long long				time_ns;
+		unsigned int			width;				//0 if the decoder gave no image for the frame
+		unsigned int			height;
+		unsigned int			bit_depth;			//2 bytes per sample above 8
+		unsigned int			chroma_shift_x;		//1 and 1 for 4:2:0
+		unsigned int			chroma_shift_y;
+		unsigned char const*	planes[3];			//Y, U, V, the visible samples
+		unsigned int			strides[3];			//bytes
+	};
+
 	ofxWebMPlayer();
 	~ofxWebMPlayer();
 
 	//default is false, because it has problem (it's no sync)
 	void enableAudio(bool yes);
 
+	//default is true, load() uses "<movie>.webmidx" if it exists and still matches the movie.
+	void enableIndex(bool yes);
+
+	//default is false. load() parses only the headers and the first cluster, the
+	//rest is indexed as the playback or a seek reaches it. The frame count is an
+	//estimate from the duration until the end is reached. No effect with an index.
+	//What it saves is the parse: the file is still read whole first, and with
+	//enableAudio(true) the audio is decoded up front, which walks every cluster.
+	void enableLazyLoad(bool yes);
+
+	//applies to the next load(). The index, if there is one, is used either way.
+	void setDemuxer(Demuxer demuxer);
+
+	//the threads load() parses the clusters on when there is no index and no lazy
+	//load. Default is 1, the blocks are walked with mkvparser. 0 is every core.
+	void setIndexThreads(unsigned int count);
+
+	//default is false. For a file which is still being written: update() keeps
+	//reading what is appended and plays latency_s behind the last frame written.
+	//Uses the webm parser, no index and no audio. Applies to the next load().
+	//load() waits up to 10 s for the first frames of a capture which just
+	//started. What was played is dropped from memory, a seek stops at the key
+	//frame the playback was on when it was dropped.
+	void enableLive(bool yes, float latency_s = 2.f);
+
+	//writes "<movie>.webmidx" next to the movie, tool/webm_index does the same from the command line.
+	static bool buildIndex(std::string name);
+
+	//Reads only the headers, and the cues with read_cues, no decoder and no GL.
+	//Uses "<movie>.webmidx" for the frame counts if it matches the movie.
+	static bool probe(std::string name, MovieInfo* p_out, bool read_cues = false);
+
+	//-1 is left, 0 is center, 1 is right
+	void setPan(float pan);
+
+	//applies to the next load()
+	void setAudioStorage(AudioStorage storage);
+	//the bytes held by the pre-decoded audio
+	size_t getAudioMemoryBytes() const;
+	//the bytes held by the frame index, it grows with the lazy load and the live mode
+	size_t getIndexMemoryBytes() const;
+	MemoryUsage getMemoryUsage() const;
+
+	//a poll is a few atomic loads, cheap enough to do every frame.
+	void getStats(Stats* p_out) const;
+	void resetStats();
+	static void getGlobalStats(Stats* p_out);
+	static void resetGlobalStats();
+	//appends "<prefix><name> <value>" lines, one per field.
+	static void formatStats(Stats const& stats, std::string* p_out, std::string const& prefix = "");
+
 	//ofBaseVideoPlayer -------------------------------------
 	bool load(std::string name)						override;
+	//load() on a thread up to the first decoded frame, update() finishes it on the
+	//GL thread. isLoaded() is false until then, a play() before waits for it.
 	void loadAsync(std::string name)				override;
 	void play()										override;
 	void stop()										override;
@@ -102,30 +310,89 @@ public:
 	bool getKeyFrames(std::vector<unsigned int>*);
 	void forceUpdate();
 
+	//For a frame accurate check without a window or real time: the clock
+	//update() reads, default (empty) is ofGetElapsedTimeMillis(). With audio the
+	//audio device is the clock, leave it off for a deterministic run.
+	void setClock(std::function<unsigned long long()> get_millis);
+	//default is false, applies to the next load(): the frames are decoded but
+	//nothing goes to GL, getTexturePtr() is empty.
+	void enableHeadless(bool yes);
+	//default is false, a checksum of the planes of every frame presented.
+	void enableFrameChecksums(bool yes);
+	//default is 0, 0 (off), applies to the next load(): the planes are box
+	//filtered down by the smallest integer factor which fits in max_width x
+	//max_height (0 is any), before the upload. getWidth() is still the movie,
+	//getTexturePtr() is the preview. For the walls of thumbnails.
+	void setPreviewSize(unsigned int max_width, unsigned int max_height);
+	//default is 0, 0, 0, 0 (the whole frame), applies to the next load(): only
+	//this rectangle is uploaded and drawn into getTexturePtr(), for the nodes of
+	//a video wall. x and y go down to the chroma samples (even with 4:2:0), the
+	//texture is of the rectangle, before setPreviewSize() scales it.
+	void setRegion(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+	unsigned int getFrameChecksum() const;
+	//the checksum of every frame decoded in order from the first by a plain
+	//decoder, not the seek of the player: the reference a seek, a loop or a step
+	//has to land on. tool/webm_playback_check runs them against it.
+	static bool computeFrameChecksums(std::string name, std::vector<unsigned int>* p_out);
+	//Decodes every frame as fast as it can, for batch analysis: no playback and
+	//no GL. The GOPs go to thread_count decoders (0 is the number of cores) and
+	//on_frame gets the frames in order, on the calling thread; it returns false
+	//to stop. False if the load failed or it was stopped. The movie is loaded by
+	//a headless player without audio, which goes through the memory budget like
+	//any other and may degrade the players: call it on the thread which updates
+	//them, as computeFrameChecksums().
+	static bool decodeOffline(std::string name, std::function<bool(OfflineFrame const&)> on_frame, unsigned int thread_count = 0);
+
 #if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+	//millisecond cur/worst, getStageTiming() has the percentiles in nanoseconds.
 	QaInfo const& getQaInfo() const;
 
+	//Default is false. Off, a stage costs one branch and no clock read. The
+	//percentiles are from log-linear buckets, within about 3% of the real time.
+	void enableStageTiming(bool yes);
+	void resetStageTiming();
+	//what is recorded so far, false if the timing was never enabled.
+	bool getStageTiming(Stage stage, StageTiming* p_out) const;
+	static char const* getStageName(Stage stage);
+	//one line per stage which has any sample.
+	void logStageTiming() const;
+
 #endif
 	//u32 getMsPerFrame();
 
 private:
 	struct VpxMovInfo;
-	enum { MaxMovInfoInsSize = 512 };
+	enum { MaxMovInfoInsSize = 4096 };
 
 	VpxMovInfo*		m_vpx_mov_info;
 	ofPixels		m_pixels;
 	GLuint			m_gl_tex2d_planes[4];
 	ofVboMesh		m_mesh_quard;
-	ofShader		m_shader;
-	ofFbo			m_fbo;
-	ofSoundStream	m_sound_stream;
+	std::shared_ptr<ofShader>	m_sp_shader;	//from the resource pool, nullptr when nothing is loaded
+	std::shared_ptr<ofFbo>		m_sp_fbo;
 
 	std::atomic<bool>	m_is_paused;
+	std::atomic<float>	m_volume;
+	std::atomic<float>	m_pan;
 	bool				m_is_playing;
 	bool				m_is_frame_new;
 	bool				m_is_loop;
+	bool				m_is_audio_chained;	//the audio is pulled by a playlist, not by the mixer
 	bool				m_enable_audio;
+	bool				m_enable_index;
+	bool				m_enable_lazy_load;
+	Demuxer				m_demuxer;
+	bool				m_enable_live;
+	float				m_live_latency_s;
+	unsigned int		m_index_threads;
+	AudioStorage		m_audio_storage;
 	float				m_position;
+	bool				m_enable_headless;
+	bool				m_enable_frame_checksums;
+	unsigned int		m_preview_width;
+	unsigned int		m_preview_height;
+	unsigned int		m_region[4];
+	std::function<unsigned long long()>	m_get_millis;
 	char				m_mov_info_instance[MaxMovInfoInsSize];
 
 #if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
@@ -133,11 +400,39 @@ private:
 
 #endif
 
+	friend class ofxWebMPlaylist;
+
+	unsigned int mf_read_audio_frames(float* output, unsigned int frames);
+	bool mf_get_audio_format(unsigned int* p_sample_rate, unsigned int* p_channels) const;
+	void mf_rewind_audio();
+	bool mf_is_loading() const;
+	unsigned long long mf_get_overrun_millis() const;
+	void mf_set_play_millis(unsigned long long millis);
+	void mf_render_audio_frames(float* output, unsigned int frames);
+	void mf_setup_audio_chain(unsigned int dst_rate, unsigned int dst_channels);
 	void mf_convert_vpx_img_to_texture(void*);
 	void mf_get_frame();
 	void mf_unload();
 	void mf_update(unsigned long long delta_millis);
 	float mf_set_key_frame(unsigned int frame_idx);
+	bool mf_index_frames(unsigned int frame_idx);
+	void mf_follow_live();
+	int mf_wait_live_start(void* p_reader, int result);
+	bool mf_scan_clusters(void* p_segment, unsigned int* p_video_track, unsigned int* p_audio_track);
+	bool mf_load_movie(std::string name);
+	bool mf_load_gl();
+	void mf_finish_load();
+	void mf_on_loaded();
+	unsigned long long mf_get_millis() const;
+	unsigned char const* mf_get_movie_bytes(unsigned long long pos) const;
+	void mf_decode_to(unsigned int frame_idx);
+	void mf_post_alpha(unsigned int frame_idx);
+	void mf_join_load();
+	void mf_reserve_memory(std::string const& name);
+	void mf_charge_memory();
+	size_t mf_get_index_bytes() const;
+	void mf_degrade();
+	bool mf_restore();
 };
 
 #if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
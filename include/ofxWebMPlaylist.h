@@ -0,0 +1,98 @@
+#ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_OFXWEBMPLAYLIST_H_
+#define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_OFXWEBMPLAYLIST_H_
+
+#include <ofMain.h>
+#include <atomic>
+#include "ofxWebMPlayer.h"
+
+//Plays movies back to back. While one movie plays, the next one is loaded with
+//loadAsync() (the file, the index, the decoder and its first frame), so the
+//switch at the end is on the frame the clock says, with no load in between.
+//
+//The audio of the movies goes out through the playlist, not the players: when
+//the current movie runs out of samples the next one goes on in the same device
+//buffer. That is sample exact when the two have the same rate and channels,
+//otherwise the next buffer starts with the new format.
+class ofxWebMPlaylist : public ofBaseSoundOutput
+{
+public:
+	ofxWebMPlaylist();
+	~ofxWebMPlaylist();
+
+	//default is false, applies to the movies loaded after it.
+	void enableAudio(bool yes);
+
+	void add(std::string name);
+	void clear();
+	size_t getCount() const;
+	//the movie on screen, -1 if none.
+	int getCurrentIndex() const;
+
+	//loads the first movie if it is not playing yet, the next one is loaded in the background.
+	bool play();
+	//closes the movies, the next play() starts from the first one.
+	void stop();
+	void setPaused(bool yes);
+	bool isPaused() const;
+	bool isPlaying() const;
+
+	//default is false, the first movie follows the last one.
+	void setLoop(bool yes);
+	void setVolume(float volume);
+
+	void update();
+	bool isFrameNew() const;
+	ofTexture* getTexturePtr();
+	void draw(float x, float y);
+	void draw(float x, float y, float w, float h);
+	float getWidth() const;
+	float getHeight() const;
+
+	//the player of the movie on screen.
+	ofxWebMPlayer& getCurrentPlayer();
+
+	//ofBaseSoundOutput -------------------------------------
+	void audioOut(float* output, int bufferSize, int nChannels) override;
+
+private:
+	struct AudioChain;
+	enum { MaxAudioChainInsSize = 1024 };
+
+	AudioChain*		m_audio_chain;
+	ofxWebMPlayer	m_players[2];
+	unsigned int	m_cur_slot;
+
+	std::vector<std::string>	m_names;
+	int							m_cur_item;
+	int							m_next_item;	//-1 at the end of the list
+	bool						m_is_next_ready;
+	bool						m_is_playing;
+	bool						m_is_loop;
+	bool						m_enable_audio;
+	bool						m_is_audio_added;
+
+	std::atomic<bool>			m_is_paused;
+	std::atomic<float>			m_volume;
+	std::atomic<ofxWebMPlayer*>	m_p_audio_cur;		//the player the samples come from
+	std::atomic<ofxWebMPlayer*>	m_p_audio_next;		//goes on when the current one runs out
+	std::atomic<unsigned int>	m_callback_seq;
+	char						m_audio_chain_instance[MaxAudioChainInsSize];
+
+	ofxWebMPlayer& mf_cur();
+	ofxWebMPlayer& mf_next();
+	void mf_preload(int item);
+	void mf_switch();
+	void mf_start_audio();
+	void mf_stop_audio();
+	void mf_wait_audio();
+	void mf_build_audio_chain(unsigned int dst_channels);
+	void mf_prepare_audio_stage(unsigned int sample_rate, unsigned int channels);
+	void mf_use_audio_stage(unsigned int sample_rate, unsigned int channels);
+	void mf_setup_audio_stage(unsigned int index, unsigned int src_rate, unsigned int src_channels);
+	void mf_pull_audio(unsigned int index, float* output, unsigned int frames);
+
+	ofxWebMPlaylist(ofxWebMPlaylist const&);
+	ofxWebMPlaylist& operator=(ofxWebMPlaylist const&);
+};
+
+#endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_OFXWEBMPLAYLIST_H_
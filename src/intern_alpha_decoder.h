@@ -0,0 +1,251 @@
+#ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_ALPHA_DECODER_H_
+#define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_ALPHA_DECODER_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "vpx_decoder.h"
+#include "intern_base.h"
+#include "intern_cluster_scan.h"
+
+//The alpha of a transparent WebM is a second VP8/VP9 stream, one frame in the
+//BlockAdditional (BlockAddID 1) of every BlockGroup of the video track. It is
+//decoded here on a thread of its own: the player posts the alpha packet of a
+//frame right before it decodes the colour of it, and waits for the alpha only
+//when it uploads the planes, so the two decodes overlap. A frame without one
+//is posted too, empty, so its alpha is not the one of the frame before.
+namespace alpha
+{
+	enum
+	{
+		IdBlockAdditions = 0x75A1,
+		IdBlockMore = 0xA6,
+		IdBlockAddId = 0xEE,
+		IdBlockAdditional = 0xA5,
+		AlphaAddId = 1,
+	};
+
+	//The BlockAdditional of a frame, which comes after its Block in the same group.
+	//block_end is the end of the frame, end is the end of the movie bytes.
+	inline bool findAdditional(u8 const* p, u64 block_end, u64 end, u64* p_pos, u32* p_len)
+	{
+		u64 pos = block_end;
+		while (pos < end)
+		{
+			u32 id;
+			u64 size;
+			if (!cluster_scan::readId(p, end, &pos, &id) || !cluster_scan::readSize(p, end, &pos, &size) || size > end - pos)
+			{
+				return false;
+			}
+
+			switch (id)
+			{
+			case IdBlockAdditions:
+			{
+				//BlockMore's, the one with BlockAddID 1 (the default) is the alpha.
+				u64 more = pos;
+				u64 const more_end = pos + size;
+				while (more < more_end)
+				{
+					u32 more_id;
+					u64 more_size;
+					if (!cluster_scan::readId(p, more_end, &more, &more_id) || !cluster_scan::readSize(p, more_end, &more, &more_size) || more_size > more_end - more)
+					{
+						return false;
+					}
+
+					if (more_id == IdBlockMore)
+					{
+						u64 add_id = AlphaAddId;
+						u64 data_pos = 0;
+						u64 data_size = 0;
+						u64 child = more;
+						while (child < more + more_size)
+						{
+							u32 child_id;
+							u64 child_size;
+							if (!cluster_scan::readId(p, more + more_size, &child, &child_id) || !cluster_scan::readSize(p, more + more_size, &child, &child_size) ||
+								child_size > more + more_size - child)
+							{
+								return false;
+							}
+
+							if (child_id == IdBlockAddId)
+							{
+								add_id = cluster_scan::readUint(p, child, child_size);
+							}
+							else if (child_id == IdBlockAdditional)
+							{
+								data_pos = child;
+								data_size = child_size;
+							}
+
+							child += child_size;
+						}
+
+						if (add_id == AlphaAddId && data_size)
+						{
+							*p_pos = data_pos;
+							*p_len = static_cast<u32>(data_size);
+							return true;
+						}
+					}
+
+					more += more_size;
+				}
+
+				return false;
+			}
+
+			//the other children of a BlockGroup.
+			case 0x9B:		//BlockDuration
+			case 0xFA:		//ReferencePriority
+			case 0xFB:		//ReferenceBlock
+			case 0xFD:		//ReferenceVirtual
+			case 0xA4:		//CodecState
+			case 0x75A2:	//DiscardPadding
+			case 0x8E:		//Slices
+			case 0xA2:		//BlockVirtual
+				pos += size;
+				break;
+
+			default:
+				//out of the group, a SimpleBlock never has one.
+				return false;
+			}
+		}
+
+		return false;
+	}
+
+	class Decoder
+	{
+	public:
+		Decoder()
+		: m_is_busy(false)
+		, m_is_quit(false)
+		, m_p_image(NULL)
+		, m_is_ready(false)
+		{}
+
+		~Decoder()
+		{
+			{
+				std::lock_guard<std::mutex> locker(m_mtx);
+				m_is_quit = true;
+			}
+
+			m_cv.notify_all();
+			if (m_thread.joinable())
+			{
+				m_thread.join();
+			}
+
+			if (m_is_ready)
+			{
+				vpx_codec_destroy(&m_ctx);
+			}
+		}
+
+		bool setup(vpx_codec_iface_t* p_iface, u32 width, u32 height)
+		{
+			vpx_codec_dec_cfg_t cfg;
+			cfg.threads = 2;
+			cfg.w = width;
+			cfg.h = height;
+			if (vpx_codec_dec_init(&m_ctx, p_iface, &cfg, 0))
+			{
+				return false;
+			}
+
+			m_is_ready = true;
+			m_thread = std::thread([this]() { mf_run(); });
+			return true;
+		}
+
+		//the bytes are read in place, the movie buffer must not move or go before
+		//wait() returns. NULL, 0 is a frame without alpha, it is opaque.
+		void post(u8 const* p_data, u32 len)
+		{
+			Packet packet = { p_data, len };
+			{
+				std::lock_guard<std::mutex> locker(m_mtx);
+				m_queue.push_back(packet);
+			}
+
+			m_cv.notify_all();
+		}
+
+		//the alpha of the last frame posted, NULL if it had none or its decode failed.
+		//Valid until the next post().
+		vpx_image_t* wait()
+		{
+			std::unique_lock<std::mutex> locker(m_mtx);
+			m_cv.wait(locker, [this]() { return m_queue.empty() && !m_is_busy; });
+			return m_p_image;
+		}
+
+	private:
+		typedef struct Packet
+		{
+			u8 const*	p_data;
+			u32			len;
+		} Packet;
+
+		std::thread				m_thread;
+		std::mutex				m_mtx;
+		std::condition_variable	m_cv;
+		std::vector<Packet>		m_queue;
+		std::vector<Packet>		m_work;
+		bool					m_is_busy;
+		bool					m_is_quit;
+		vpx_codec_ctx_t			m_ctx;
+		vpx_image_t*			m_p_image;
+		bool					m_is_ready;
+
+		void mf_run()
+		{
+			for (;;)
+			{
+				{
+					std::unique_lock<std::mutex> locker(m_mtx);
+					m_cv.wait(locker, [this]() { return m_is_quit || !m_queue.empty(); });
+					if (m_is_quit)
+					{
+						return;
+					}
+
+					m_work.swap(m_queue);
+					m_is_busy = true;
+				}
+
+				vpx_image_t* p_image = NULL;
+				for (Packet const& packet : m_work)
+				{
+					p_image = NULL;
+					if (packet.len && !vpx_codec_decode(&m_ctx, packet.p_data, packet.len, NULL, 0))
+					{
+						vpx_codec_iter_t iter = NULL;
+						p_image = vpx_codec_get_frame(&m_ctx, &iter);
+					}
+				}
+
+				m_work.clear();
+				{
+					std::lock_guard<std::mutex> locker(m_mtx);
+					m_p_image = p_image;
+					m_is_busy = false;
+				}
+
+				m_cv.notify_all();
+			}
+		}
+
+		Decoder(Decoder const&);
+		Decoder& operator=(Decoder const&);
+	};
+}
+
+#endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_ALPHA_DECODER_H_
@@ -0,0 +1,309 @@
+#ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_AUDIO_DSP_H_
+#define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_AUDIO_DSP_H_
+
+#include <string.h>
+#include "intern_base.h"
+
+namespace audio
+{
+	enum { MaxChannels = 8 };
+
+	//The channel matrix maps the interleaved source layout (vorbis order) onto
+	//the device layout. coef[dst][src] is the weight of src channel in dst channel.
+	struct MixMatrix
+	{
+		u32		src_channels;
+		u32		dst_channels;
+		bool	is_identity;
+		f32		coef[MaxChannels][MaxChannels];
+	};
+
+	// https://xiph.org/vorbis/doc/Vorbis_I_spec.html#x1-810004.3.9
+	// vorbis channel order:
+	// 3 => L, C, R
+	// 4 => FL, FR, RL, RR
+	// 5 => FL, C, FR, RL, RR
+	// 6 => FL, C, FR, RL, RR, LFE
+	// 7 => FL, C, FR, SL, SR, RC, LFE
+	// 8 => FL, C, FR, SL, SR, RL, RR, LFE
+	inline void buildStereoDownmix(MixMatrix* p_mat)
+	{
+		f32 const k = 0.70710678f; //-3dB
+
+		f32 (*c)[MaxChannels] = p_mat->coef;
+		switch (p_mat->src_channels)
+		{
+		case 1:
+			c[0][0] = k;
+			c[1][0] = k;
+			break;
+
+		case 2:
+			c[0][0] = 1.f;
+			c[1][1] = 1.f;
+			break;
+
+		case 3:
+			c[0][0] = 1.f; c[0][1] = k;
+			c[1][2] = 1.f; c[1][1] = k;
+			break;
+
+		case 4:
+			c[0][0] = 1.f; c[0][2] = k;
+			c[1][1] = 1.f; c[1][3] = k;
+			break;
+
+		case 5:
+		case 6:
+			c[0][0] = 1.f; c[0][1] = k; c[0][3] = k;
+			c[1][2] = 1.f; c[1][1] = k; c[1][4] = k;
+			break;
+
+		case 7:
+			c[0][0] = 1.f; c[0][1] = k; c[0][3] = k; c[0][5] = 0.5f;
+			c[1][2] = 1.f; c[1][1] = k; c[1][4] = k; c[1][5] = 0.5f;
+			break;
+
+		default:
+			c[0][0] = 1.f; c[0][1] = k; c[0][3] = k; c[0][5] = k;
+			c[1][2] = 1.f; c[1][1] = k; c[1][4] = k; c[1][6] = k;
+			break;
+		}
+
+		//keep the sum of each row at unity, so a full-scale downmix does not hit the clipper.
+		for (u32 d = 0; d < 2; ++d)
+		{
+			f32 sum = 0.f;
+			for (u32 s = 0; s < MaxChannels; ++s)
+			{
+				sum += c[d][s];
+			}
+
+			if (sum > 1.f)
+			{
+				for (u32 s = 0; s < MaxChannels; ++s)
+				{
+					c[d][s] /= sum;
+				}
+			}
+		}
+	}
+
+	inline void buildMixMatrix(MixMatrix* p_mat, u32 src_channels, u32 dst_channels)
+	{
+		memset(p_mat, 0x00, sizeof(MixMatrix));
+		p_mat->src_channels = src_channels < static_cast<u32>(MaxChannels) ? src_channels : static_cast<u32>(MaxChannels);
+		p_mat->dst_channels = dst_channels < static_cast<u32>(MaxChannels) ? dst_channels : static_cast<u32>(MaxChannels);
+		p_mat->is_identity = (src_channels == dst_channels);
+
+		if (p_mat->is_identity)
+		{
+			for (u32 i = 0; i < p_mat->dst_channels; ++i)
+			{
+				p_mat->coef[i][i] = 1.f;
+			}
+		}
+		else if (p_mat->dst_channels == 2)
+		{
+			buildStereoDownmix(p_mat);
+		}
+		else if (p_mat->dst_channels == 1)
+		{
+			f32 w = 1.f / p_mat->src_channels;
+			for (u32 s = 0; s < p_mat->src_channels; ++s)
+			{
+				p_mat->coef[0][s] = w;
+			}
+		}
+		else
+		{
+			//unknown device layout, route channel by channel.
+			u32 n = p_mat->src_channels < p_mat->dst_channels ? p_mat->src_channels : p_mat->dst_channels;
+			for (u32 i = 0; i < n; ++i)
+			{
+				p_mat->coef[i][i] = 1.f;
+			}
+		}
+	}
+
+	//src has src_stride floats per frame, dst has dst_channels floats per frame.
+	inline void mixChannels(MixMatrix const& mat, f32 const* src, u32 src_stride, f32* dst, u32 frames)
+	{
+		u32 const sc = mat.src_channels;
+		u32 const dc = mat.dst_channels;
+
+		for (u32 f = 0; f < frames; ++f)
+		{
+			f32 const* in = src + f * src_stride;
+			f32* out = dst + f * dc;
+
+			for (u32 d = 0; d < dc; ++d)
+			{
+				f32 const* row = mat.coef[d];
+				f32 acc = 0.f;
+				for (u32 s = 0; s < sc; ++s)
+				{
+					acc += row[s] * in[s];
+				}
+				out[d] = acc;
+			}
+		}
+	}
+
+	//Applies a per-channel gain which ramps linearly from the last gain to the target
+	//gain across the buffer, then clamps to [-1, 1].
+	class GainStage
+	{
+	public:
+		GainStage()
+		: m_channels(0)
+		{
+			memset(m_gain, 0x00, sizeof(m_gain));
+		}
+
+		void reset(u32 channels, f32 const* p_gain)
+		{
+			m_channels = channels < static_cast<u32>(MaxChannels) ? channels : static_cast<u32>(MaxChannels);
+			memcpy(m_gain, p_gain, sizeof(f32) * m_channels);
+		}
+
+		void process(f32* buffer, u32 frames, f32 const* p_target)
+		{
+			if (!frames || !m_channels)
+			{
+				return;
+			}
+
+			u32 const c = m_channels;
+			f32 step[MaxChannels];
+			for (u32 i = 0; i < c; ++i)
+			{
+				step[i] = (p_target[i] - m_gain[i]) / frames;
+			}
+
+#if defined(USE_OFXWEBMPLAYER_SSE2)
+			//with 1, 2 or 4 channels the lane pattern repeats every 4 floats
+			if ((4 % c) == 0)
+			{
+				u32 const frames_per_vec = 4 / c;
+				f32 lane_gain[4], lane_step[4];
+				for (u32 l = 0; l < 4; ++l)
+				{
+					u32 ch = l % c;
+					u32 f = l / c;
+					lane_gain[l] = m_gain[ch] + step[ch] * (f + 1);
+					lane_step[l] = step[ch] * frames_per_vec;
+				}
+
+				__m128 v_gain = _mm_loadu_ps(lane_gain);
+				__m128 v_step = _mm_loadu_ps(lane_step);
+				__m128 const v_max = _mm_set1_ps(1.f);
+				__m128 const v_min = _mm_set1_ps(-1.f);
+
+				u32 const count = frames * c;
+				u32 i = 0;
+				for (; i + 4 <= count; i += 4)
+				{
+					__m128 v = _mm_mul_ps(_mm_loadu_ps(buffer + i), v_gain);
+					v = _mm_min_ps(_mm_max_ps(v, v_min), v_max);
+					_mm_storeu_ps(buffer + i, v);
+					v_gain = _mm_add_ps(v_gain, v_step);
+				}
+
+				if (i < count)
+				{
+					mf_process_scalar(buffer + i, (count - i) / c, step, i / c);
+				}
+
+				mf_finish(p_target);
+				return;
+			}
+
+#endif
+			mf_process_scalar(buffer, frames, step, 0);
+			mf_finish(p_target);
+		}
+
+	private:
+		u32 m_channels;
+		f32 m_gain[MaxChannels];
+
+		void mf_process_scalar(f32* buffer, u32 frames, f32 const* step, u32 frame_offset)
+		{
+			u32 const c = m_channels;
+			for (u32 f = 0; f < frames; ++f)
+			{
+				for (u32 ch = 0; ch < c; ++ch)
+				{
+					f32 g = m_gain[ch] + step[ch] * (frame_offset + f + 1);
+					f32 v = buffer[f * c + ch] * g;
+					v = v > 1.f ? 1.f : v;
+					v = v < -1.f ? -1.f : v;
+					buffer[f * c + ch] = v;
+				}
+			}
+		}
+
+		void mf_finish(f32 const* p_target)
+		{
+			memcpy(m_gain, p_target, sizeof(f32) * m_channels);
+		}
+	};
+
+	//dst += src
+	inline void accumulate(f32* dst, f32 const* src, u32 count)
+	{
+		u32 i = 0;
+#if defined(USE_OFXWEBMPLAYER_SSE2)
+		for (; i + 8 <= count; i += 8)
+		{
+			_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+			_mm_storeu_ps(dst + i + 4, _mm_add_ps(_mm_loadu_ps(dst + i + 4), _mm_loadu_ps(src + i + 4)));
+		}
+
+#endif
+		for (; i < count; ++i)
+		{
+			dst[i] += src[i];
+		}
+	}
+
+	inline void clamp(f32* buffer, u32 count)
+	{
+		u32 i = 0;
+#if defined(USE_OFXWEBMPLAYER_SSE2)
+		__m128 const v_max = _mm_set1_ps(1.f);
+		__m128 const v_min = _mm_set1_ps(-1.f);
+		for (; i + 4 <= count; i += 4)
+		{
+			_mm_storeu_ps(buffer + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(buffer + i), v_min), v_max));
+		}
+
+#endif
+		for (; i < count; ++i)
+		{
+			f32 v = buffer[i];
+			v = v > 1.f ? 1.f : v;
+			buffer[i] = v < -1.f ? -1.f : v;
+		}
+	}
+
+	//pan is -1 (left) to 1 (right). It works as a balance control: the side the
+	//pan moves to stays at unity, the other side fades out, so it never boosts.
+	//Only stereo device layouts are panned.
+	inline void computeChannelGains(f32* p_gain, u32 channels, f32 volume, f32 pan)
+	{
+		for (u32 i = 0; i < channels; ++i)
+		{
+			p_gain[i] = volume;
+		}
+
+		if (channels == 2)
+		{
+			p_gain[0] = volume * (pan > 0.f ? 1.f - pan : 1.f);
+			p_gain[1] = volume * (pan < 0.f ? 1.f + pan : 1.f);
+		}
+	}
+}
+
+#endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_AUDIO_DSP_H_
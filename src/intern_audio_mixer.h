@@ -0,0 +1,198 @@
+#ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_AUDIO_MIXER_H_
+#define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_AUDIO_MIXER_H_
+
+#include <ofMain.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "intern_audio_dsp.h"
+
+namespace audio
+{
+	//One output stream for the whole process. Every playing player is a source,
+	//the device callback renders each source into a scratch buffer and sums them.
+	//
+	//The callback never takes a lock: the sources live in a fixed table of atomic
+	//pointers. Removing a source clears its slot and then waits until the callback
+	//that may still hold it has returned, so a player can be destroyed right after.
+	class Mixer : public ofBaseSoundOutput
+	{
+	public:
+		enum { MaxSources = 64 };
+
+		static Mixer& instance()
+		{
+			static Mixer s_mixer;
+			return s_mixer;
+		}
+
+		~Mixer()
+		{
+			close();
+		}
+
+		//Opens the device if it is not open yet. When it is already open the
+		//arguments are ignored, every source has to follow the device format.
+		bool open(u32 sample_rate, u32 channels, u32 buffer_size, u32 num_buffers)
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			if (m_is_open)
+			{
+				return true;
+			}
+
+			m_sample_rate = sample_rate;
+			m_channels = channels;
+			m_scratch.assign(static_cast<size_t>(buffer_size) * channels, 0.f);
+
+			m_stream.setOutput(this);
+			m_is_open = m_stream.setup(channels, 0, sample_rate, buffer_size, num_buffers);
+			if (!m_is_open)
+			{
+				m_stream.setOutput(NULL);
+			}
+
+			return m_is_open;
+		}
+
+		void close()
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			if (!m_is_open)
+			{
+				return;
+			}
+
+			m_stream.stop();
+			m_stream.close();
+			m_stream.setOutput(NULL);
+			m_is_open = false;
+		}
+
+		bool addSource(ofBaseSoundOutput* p_source)
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			for (u32 i = 0; i < MaxSources; ++i)
+			{
+				if (m_sources[i].load() == p_source)
+				{
+					return true;
+				}
+			}
+
+			for (u32 i = 0; i < MaxSources; ++i)
+			{
+				ofBaseSoundOutput* p_empty = NULL;
+				if (m_sources[i].compare_exchange_strong(p_empty, p_source))
+				{
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		void removeSource(ofBaseSoundOutput* p_source)
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			bool is_found = false;
+			for (u32 i = 0; i < MaxSources; ++i)
+			{
+				ofBaseSoundOutput* p_expected = p_source;
+				is_found = m_sources[i].compare_exchange_strong(p_expected, NULL) || is_found;
+			}
+
+			if (!is_found)
+			{
+				return;
+			}
+
+			//odd means a callback is running, wait for the next even value.
+			u32 seq = m_callback_seq.load();
+			if (seq & 1)
+			{
+				while (m_callback_seq.load() == seq)
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+
+		bool isOpen() const
+		{
+			return m_is_open;
+		}
+
+		u32 getSampleRate() const
+		{
+			return m_sample_rate;
+		}
+
+		u32 getChannels() const
+		{
+			return m_channels;
+		}
+
+		void audioOut(float* output, int bufferSize, int nChannels) override
+		{
+			++m_callback_seq;
+
+			u32 const count = static_cast<u32>(bufferSize * nChannels);
+			memset(output, 0x00, sizeof(f32) * count);
+
+			//the scratch is allocated by open(), a device which gives a bigger
+			//buffer than asked for is mixed in pieces of it.
+			f32* scratch = m_scratch.data();
+			u32 const chunk_frames = nChannels > 0 ? static_cast<u32>(m_scratch.size() / nChannels) : 0;
+			for (u32 done = 0; chunk_frames && done < static_cast<u32>(bufferSize);)
+			{
+				u32 const frames = std::min(static_cast<u32>(bufferSize) - done, chunk_frames);
+				for (u32 i = 0; i < MaxSources; ++i)
+				{
+					ofBaseSoundOutput* p_source = m_sources[i].load(std::memory_order_acquire);
+					if (!p_source)
+					{
+						continue;
+					}
+
+					p_source->audioOut(scratch, frames, nChannels);
+					accumulate(output + done * nChannels, scratch, frames * nChannels);
+				}
+
+				done += frames;
+			}
+
+			clamp(output, count);
+
+			++m_callback_seq;
+		}
+
+	private:
+		ofSoundStream						m_stream;
+		std::mutex							m_mtx;
+		std::atomic<ofBaseSoundOutput*>		m_sources[MaxSources];
+		std::atomic<u32>					m_callback_seq;
+		std::vector<f32>					m_scratch;
+		bool								m_is_open;
+		u32									m_sample_rate;
+		u32									m_channels;
+
+		Mixer()
+		: m_callback_seq(0)
+		, m_is_open(false)
+		, m_sample_rate(0)
+		, m_channels(0)
+		{
+			for (u32 i = 0; i < MaxSources; ++i)
+			{
+				m_sources[i] = NULL;
+			}
+		}
+
+		Mixer(Mixer const&);
+		Mixer& operator=(Mixer const&);
+	};
+}
+
+#endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_AUDIO_MIXER_H_
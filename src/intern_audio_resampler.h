@@ -0,0 +1,253 @@
+#ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_AUDIO_RESAMPLER_H_
+#define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_AUDIO_RESAMPLER_H_
+
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "intern_base.h"
+
+namespace audio
+{
+	//Polyphase windowed-sinc resampler for a rational ratio L/M.
+	//
+	//The output position advances M/L input samples per output sample. The integer
+	//part selects the first input sample under the filter, the remainder (in 1/L
+	//steps) selects one of the L filter phases, so every output sample is a single
+	//Taps-long dot product. The history is kept planar, so the dot product runs on
+	//contiguous floats.
+	class Resampler
+	{
+	public:
+		enum
+		{
+			Taps = 32,
+			MaxPhases = 4096,
+			HistoryChunk = 1024,
+		};
+
+		Resampler()
+		: m_L(1)
+		, m_M(1)
+		, m_channels(0)
+		, m_phase(0)
+		, m_pos(0)
+		, m_hist_len(0)
+		, m_hist_cap(0)
+		{}
+
+		bool setup(u32 src_rate, u32 dst_rate, u32 channels)
+		{
+			m_channels = channels;
+			m_L = m_M = 1;
+			m_coef.clear();
+
+			if (!src_rate || !dst_rate || !channels)
+			{
+				return false;
+			}
+
+			u32 g = mf_gcd(src_rate, dst_rate);
+			u32 L = dst_rate / g;
+			u32 M = src_rate / g;
+
+			if (L > MaxPhases)
+			{
+				return false;
+			}
+
+			m_L = L;
+			m_M = M;
+
+			if (isPassthrough())
+			{
+				return true;
+			}
+
+			//cut a little below the lower Nyquist of the two rates.
+			f64 const scale = (L < M ? static_cast<f64>(L) / M : 1.0) * 0.95;
+			f64 const half = Taps / 2;
+			f64 const pi = 3.14159265358979323846;
+
+			m_coef.resize(static_cast<size_t>(L) * Taps);
+			for (u32 p = 0; p < L; ++p)
+			{
+				f32* row = &m_coef[p * Taps];
+				f64 frac = static_cast<f64>(p) / L;
+				f64 sum = 0.0;
+
+				for (u32 t = 0; t < Taps; ++t)
+				{
+					f64 dist = (static_cast<f64>(t) - (half - 1.0)) - frac;
+					f64 x = dist * scale;
+					f64 sinc = (x == 0.0) ? 1.0 : sin(pi * x) / (pi * x);
+
+					//blackman window across [-half, half]
+					f64 w = (dist + half) / (2.0 * half);
+					f64 win = 0.42 - 0.5 * cos(2.0 * pi * w) + 0.08 * cos(4.0 * pi * w);
+
+					f64 h = scale * sinc * win;
+					row[t] = static_cast<f32>(h);
+					sum += h;
+				}
+
+				//unity gain at DC for every phase
+				for (u32 t = 0; t < Taps; ++t)
+				{
+					row[t] = static_cast<f32>(row[t] / sum);
+				}
+			}
+
+			m_hist_cap = Taps + HistoryChunk;
+			m_hist.assign(static_cast<size_t>(m_hist_cap) * m_channels, 0.f);
+			reset();
+			return true;
+		}
+
+		void reset()
+		{
+			m_phase = 0;
+			m_pos = 0;
+
+			//the first output is centered on the first input, so half of the filter
+			//looks at silence before the stream starts.
+			m_hist_len = Taps / 2 - 1;
+			std::fill(m_hist.begin(), m_hist.end(), 0.f);
+		}
+
+		bool isPassthrough() const
+		{
+			return m_L == m_M;
+		}
+
+		//the number of input frames needed to produce `frames` output frames.
+		u32 getInputFrames(u32 frames) const
+		{
+			return static_cast<u32>((static_cast<u64>(frames) * m_M + m_L - 1) / m_L) + Taps;
+		}
+
+		//the most frames one pull asks for, the size of the pull buffer of process().
+		u32 getMaxPullFrames() const
+		{
+			return m_hist_cap;
+		}
+
+		//pull(f32* interleaved, u32 frames) must fill all the frames it is asked for,
+		//padding with silence at the end of the stream.
+		template<typename Fn>
+		void process(f32* output, u32 frames, Fn pull, std::vector<f32>& pull_buffer)
+		{
+			u32 const c = m_channels;
+
+			for (u32 n = 0; n < frames; ++n)
+			{
+				if (m_pos + Taps > m_hist_len)
+				{
+					mf_refill(frames - n, pull, pull_buffer);
+				}
+
+				f32 const* coef = &m_coef[m_phase * Taps];
+				for (u32 ch = 0; ch < c; ++ch)
+				{
+					output[n * c + ch] = mf_dot(coef, &m_hist[ch * m_hist_cap + m_pos]);
+				}
+
+				m_phase += m_M;
+				m_pos += m_phase / m_L;
+				m_phase %= m_L;
+			}
+		}
+
+	private:
+		u32					m_L;
+		u32					m_M;
+		u32					m_channels;
+		u32					m_phase;
+		u32					m_pos;
+		u32					m_hist_len;
+		u32					m_hist_cap;
+		std::vector<f32>	m_coef;
+		std::vector<f32>	m_hist;
+
+		static u32 mf_gcd(u32 a, u32 b)
+		{
+			while (b)
+			{
+				u32 t = a % b;
+				a = b;
+				b = t;
+			}
+			return a;
+		}
+
+		static f32 mf_dot(f32 const* coef, f32 const* hist)
+		{
+#if defined(USE_OFXWEBMPLAYER_SSE2)
+			__m128 acc0 = _mm_setzero_ps();
+			__m128 acc1 = _mm_setzero_ps();
+			for (u32 t = 0; t < Taps; t += 8)
+			{
+				acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(coef + t), _mm_loadu_ps(hist + t)));
+				acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(coef + t + 4), _mm_loadu_ps(hist + t + 4)));
+			}
+
+			acc0 = _mm_add_ps(acc0, acc1);
+			acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+			acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+			return _mm_cvtss_f32(acc0);
+
+#else
+			f32 acc = 0.f;
+			for (u32 t = 0; t < Taps; ++t)
+			{
+				acc += coef[t] * hist[t];
+			}
+			return acc;
+
+#endif
+		}
+
+		template<typename Fn>
+		void mf_refill(u32 frames_left, Fn& pull, std::vector<f32>& pull_buffer)
+		{
+			u32 const c = m_channels;
+
+			//drop what the filter has passed
+			if (m_pos)
+			{
+				u32 keep = m_hist_len - m_pos;
+				for (u32 ch = 0; ch < c; ++ch)
+				{
+					f32* h = &m_hist[ch * m_hist_cap];
+					memmove(h, h + m_pos, sizeof(f32) * keep);
+				}
+				m_hist_len = keep;
+				m_pos = 0;
+			}
+
+			//pull only what this callback needs, so the audio clock stays close to
+			//what is actually played.
+			u32 want = static_cast<u32>((static_cast<u64>(m_phase) + static_cast<u64>(frames_left) * m_M) / m_L) + Taps - m_hist_len;
+			u32 room = m_hist_cap - m_hist_len;
+			want = want < room ? want : room;
+
+			//the caller sized it with getMaxPullFrames(), it is not grown here.
+			u32 const fit = static_cast<u32>(pull_buffer.size() / c);
+			want = want < fit ? want : fit;
+
+			f32* src = pull_buffer.data();
+			pull(src, want);
+
+			for (u32 f = 0; f < want; ++f)
+			{
+				for (u32 ch = 0; ch < c; ++ch)
+				{
+					m_hist[ch * m_hist_cap + m_hist_len + f] = src[f * c + ch];
+				}
+			}
+
+			m_hist_len += want;
+		}
+	};
+}
+
+#endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_AUDIO_RESAMPLER_H_
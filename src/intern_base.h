@@ -1,15 +1,23 @@
 #ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_BASE_H_
 #define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_BASE_H_
 
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define USE_OFXWEBMPLAYER_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace 
 {
 	typedef char				s8;
 	typedef unsigned char		u8;
+	typedef short				s16;
+	typedef unsigned short		u16;
 	typedef int					s32;
 	typedef unsigned int		u32;
 	typedef long long			s64;
 	typedef unsigned long long	u64;
 	typedef float				f32;
+	typedef double				f64;
 }
 
 #endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_BASE_H_
\ No newline at end of file
@@ -0,0 +1,489 @@
+#ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_CLUSTER_SCAN_H_
+#define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_CLUSTER_SCAN_H_
+
+#include <atomic>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include "intern_base.h"
+#include "intern_frame_index.h"
+#include "intern_webm_index.h"
+
+//Builds the frame index and the audio packet map straight from the bytes of the
+//movie, cluster by cluster on several threads, instead of the block walk of
+//mkvparser which has to go through the clusters one after another.
+//
+//A first pass reads only the headers of the top level elements to find where
+//every cluster is, the clusters are then parsed in parallel and the results are
+//merged in file order. A file this does not handle (an unknown cluster size, as
+//live captures write) returns false, and load() falls back to Segment::Load().
+//
+//It runs on the movie block, after WebMReader::Setup(). Only the parse scales
+//with the cores.
+namespace cluster_scan
+{
+	enum
+	{
+		IdCluster = 0x1F43B675,
+		IdTimecode = 0xE7,
+		IdSimpleBlock = 0xA3,
+		IdBlockGroup = 0xA0,
+		IdBlock = 0xA1,
+		IdReferenceBlock = 0xFB,
+	};
+
+	typedef struct Range
+	{
+		u64 begin;	//the payload
+		u64 end;
+	} Range;
+
+	typedef struct Packet
+	{
+		u64 pos;
+		u32 len;
+		bool is_key;
+		s64 time_ns;
+	} Packet;
+
+	typedef struct Result
+	{
+		std::vector<Packet> video;
+		std::vector<Packet> audio;
+	} Result;
+
+	//EBML element id, the length bits are kept.
+	inline bool readId(u8 const* p, u64 end, u64* p_pos, u32* p_id)
+	{
+		u64 pos = *p_pos;
+		if (pos >= end || !p[pos])
+		{
+			return false;
+		}
+
+		u32 len = 1;
+		while (len <= 4 && !(p[pos] & (0x80 >> (len - 1))))
+		{
+			++len;
+		}
+
+		if (len > 4 || pos + len > end)
+		{
+			return false;
+		}
+
+		u32 id = 0;
+		for (u32 i = 0; i < len; ++i)
+		{
+			id = (id << 8) | p[pos + i];
+		}
+
+		*p_id = id;
+		*p_pos = pos + len;
+		return true;
+	}
+
+	//EBML variable size integer. p_len gets its length, *p_is_unknown is set for the all ones value.
+	inline bool readVint(u8 const* p, u64 end, u64* p_pos, u64* p_value, u32* p_len, bool* p_is_unknown)
+	{
+		u64 pos = *p_pos;
+		if (pos >= end || !p[pos])
+		{
+			return false;
+		}
+
+		u32 len = 1;
+		while (!(p[pos] & (0x80 >> (len - 1))))
+		{
+			++len;
+		}
+
+		if (pos + len > end)
+		{
+			return false;
+		}
+
+		u64 value = p[pos] & (0xff >> len);
+		bool is_all_ones = value == (0xffu >> len);
+		for (u32 i = 1; i < len; ++i)
+		{
+			value = (value << 8) | p[pos + i];
+			is_all_ones = is_all_ones && p[pos + i] == 0xff;
+		}
+
+		*p_value = value;
+		*p_len = len;
+		*p_is_unknown = is_all_ones;
+		*p_pos = pos + len;
+		return true;
+	}
+
+	inline bool readSize(u8 const* p, u64 end, u64* p_pos, u64* p_size)
+	{
+		u32 len;
+		bool is_unknown;
+		return readVint(p, end, p_pos, p_size, &len, &is_unknown) && !is_unknown;
+	}
+
+	inline u64 readUint(u8 const* p, u64 pos, u64 size)
+	{
+		u64 v = 0;
+		for (u64 i = 0; i < size && i < 8; ++i)
+		{
+			v = (v << 8) | p[pos + i];
+		}
+
+		return v;
+	}
+
+	//the clusters of the segment payload [begin, end).
+	inline bool findClusters(u8 const* p, u64 begin, u64 end, std::vector<Range>* p_out)
+	{
+		u64 pos = begin;
+		while (pos < end)
+		{
+			u32 id;
+			u64 size;
+			u32 len;
+			bool is_unknown;
+			if (!readId(p, end, &pos, &id) || !readVint(p, end, &pos, &size, &len, &is_unknown))
+			{
+				//the tail of a cut file is not an error, the clusters so far are good.
+				return !p_out->empty();
+			}
+
+			if (is_unknown)
+			{
+				return false;
+			}
+
+			//past the end, a cut file keeps what its last cluster has.
+			bool const is_cut = size > end - pos;
+			if (id == IdCluster)
+			{
+				Range range;
+				range.begin = pos;
+				range.end = is_cut ? end : pos + size;
+				p_out->push_back(range);
+			}
+
+			if (is_cut)
+			{
+				return !p_out->empty();
+			}
+
+			pos += size;
+		}
+
+		return true;
+	}
+
+	//the frames of one (Simple)Block. The key flag of a block in a group comes from the group.
+	inline bool parseBlock(u8 const* p, u64 begin, u64 end, bool is_simple, bool is_group_key, u64 cluster_timecode, u64 timecode_scale,
+		u32 video_track, u32 audio_track, Result* p_result)
+	{
+		u64 pos = begin;
+		u64 track;
+		u32 len;
+		bool is_unknown;
+		if (!readVint(p, end, &pos, &track, &len, &is_unknown) || pos + 3 > end)
+		{
+			return false;
+		}
+
+		std::vector<Packet>* p_out = NULL;
+		if (track == video_track)
+		{
+			p_out = &p_result->video;
+		}
+		else if (track == audio_track)
+		{
+			p_out = &p_result->audio;
+		}
+		else
+		{
+			return true;
+		}
+
+		s16 timecode = static_cast<s16>((p[pos] << 8) | p[pos + 1]);
+		u8 flags = p[pos + 2];
+		pos += 3;
+
+		Packet packet;
+		packet.is_key = is_simple ? (flags & 0x80) != 0 : is_group_key;
+		packet.time_ns = (static_cast<s64>(cluster_timecode) + timecode) * static_cast<s64>(timecode_scale);
+
+		u32 const lacing = (flags >> 1) & 0x03;
+		if (!lacing)
+		{
+			packet.pos = pos;
+			packet.len = static_cast<u32>(end - pos);
+			p_out->push_back(packet);
+			return true;
+		}
+
+		if (pos >= end)
+		{
+			return false;
+		}
+
+		u32 const count = p[pos++] + 1;
+		std::vector<u64> sizes(count, 0);
+		u64 total = 0;
+
+		switch (lacing)
+		{
+		case 1:		//Xiph
+			for (u32 i = 0; i + 1 < count; ++i)
+			{
+				u8 b;
+				do
+				{
+					if (pos >= end)
+					{
+						return false;
+					}
+
+					b = p[pos++];
+					sizes[i] += b;
+				} while (b == 0xff);
+
+				total += sizes[i];
+				if (total > end - pos)
+				{
+					return false;
+				}
+			}
+			break;
+
+		case 2:		//fixed
+			for (u32 i = 0; i + 1 < count; ++i)
+			{
+				sizes[i] = (end - pos) / count;
+				total += sizes[i];
+			}
+			break;
+
+		case 3:		//EBML, the sizes after the first are signed differences
+		{
+			u64 v;
+			if (!readVint(p, end, &pos, &v, &len, &is_unknown))
+			{
+				return false;
+			}
+
+			if (v > end - pos)
+			{
+				return false;
+			}
+
+			sizes[0] = v;
+			total = v;
+			for (u32 i = 1; i + 1 < count; ++i)
+			{
+				if (!readVint(p, end, &pos, &v, &len, &is_unknown) || total > end - pos)
+				{
+					return false;
+				}
+
+				//a size below 0 or past what is left is a broken block.
+				s64 diff = static_cast<s64>(v) - ((1ll << (7 * len - 1)) - 1);
+				s64 size = static_cast<s64>(sizes[i - 1]) + diff;
+				if (size < 0 || static_cast<u64>(size) > end - pos - total)
+				{
+					return false;
+				}
+
+				sizes[i] = static_cast<u64>(size);
+				total += sizes[i];
+			}
+		}
+		break;
+		}
+
+		if (total > end - pos)
+		{
+			return false;
+		}
+
+		sizes[count - 1] = end - pos - total;
+		for (u32 i = 0; i < count; ++i)
+		{
+			packet.pos = pos;
+			packet.len = static_cast<u32>(sizes[i]);
+			p_out->push_back(packet);
+
+			//the other frames of a key block decode from the first one.
+			packet.is_key = false;
+			pos += sizes[i];
+		}
+
+		return true;
+	}
+
+	inline bool parseCluster(u8 const* p, Range const& range, u64 timecode_scale, u32 video_track, u32 audio_track, Result* p_result)
+	{
+		u64 cluster_timecode = 0;
+		u64 pos = range.begin;
+		while (pos < range.end)
+		{
+			u32 id;
+			u64 size;
+			if (!readId(p, range.end, &pos, &id) || !readSize(p, range.end, &pos, &size) || size > range.end - pos)
+			{
+				return false;
+			}
+
+			if (id == IdTimecode)
+			{
+				cluster_timecode = readUint(p, pos, size);
+			}
+			else if (id == IdSimpleBlock)
+			{
+				if (!parseBlock(p, pos, pos + size, true, false, cluster_timecode, timecode_scale, video_track, audio_track, p_result))
+				{
+					return false;
+				}
+			}
+			else if (id == IdBlockGroup)
+			{
+				//a block which refers to nothing is a key frame.
+				u64 block_begin = 0;
+				u64 block_end = 0;
+				bool has_reference = false;
+				u64 child = pos;
+				while (child < pos + size)
+				{
+					u32 child_id;
+					u64 child_size;
+					if (!readId(p, pos + size, &child, &child_id) || !readSize(p, pos + size, &child, &child_size) || child_size > pos + size - child)
+					{
+						return false;
+					}
+
+					if (child_id == IdBlock)
+					{
+						block_begin = child;
+						block_end = child + child_size;
+					}
+					else if (child_id == IdReferenceBlock)
+					{
+						has_reference = true;
+					}
+
+					child += child_size;
+				}
+
+				if (block_end && !parseBlock(p, block_begin, block_end, false, !has_reference, cluster_timecode, timecode_scale, video_track, audio_track, p_result))
+				{
+					return false;
+				}
+			}
+
+			pos += size;
+		}
+
+		return true;
+	}
+
+	//thread_count 0 uses every core.
+	inline bool build(u8 const* p, u64 segment_begin, u64 segment_end, u64 timecode_scale, u32 video_track, u32 audio_track, u32 thread_count,
+		FrameIndex* p_frames, std::vector<sidecar::AudioPacket>* p_audio)
+	{
+		std::vector<Range> clusters;
+		if (!findClusters(p, segment_begin, segment_end, &clusters) || clusters.empty())
+		{
+			return false;
+		}
+
+		std::vector<Result> results(clusters.size());
+		std::atomic<size_t> next(0);
+		std::atomic<bool> is_ok(true);
+
+		auto work = [&]()
+		{
+			for (size_t i = next++; i < clusters.size() && is_ok; i = next++)
+			{
+				if (!parseCluster(p, clusters[i], timecode_scale, video_track, audio_track, &results[i]))
+				{
+					is_ok = false;
+				}
+			}
+		};
+
+		if (!thread_count)
+		{
+			thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+
+		thread_count = static_cast<u32>(std::min<size_t>(thread_count, clusters.size()));
+
+		//the calling thread is one of the workers, and does it all if no thread can be made.
+		std::vector<std::thread> threads;
+		for (u32 i = 1; i < thread_count; ++i)
+		{
+			try
+			{
+				threads.push_back(std::thread(work));
+			}
+			catch (std::system_error const&)
+			{
+				break;
+			}
+		}
+
+		work();
+		for (std::thread& t : threads)
+		{
+			t.join();
+		}
+
+		if (!is_ok)
+		{
+			return false;
+		}
+
+		size_t video_count = 0;
+		size_t audio_count = 0;
+		for (Result const& result : results)
+		{
+			video_count += result.video.size();
+			audio_count += result.audio.size();
+		}
+
+		p_frames->clear();
+		p_frames->reserve(video_count);
+		if (p_audio)
+		{
+			p_audio->clear();
+			p_audio->reserve(audio_count);
+		}
+
+		for (Result const& result : results)
+		{
+			for (Packet const& packet : result.video)
+			{
+				p_frames->push(packet.pos, packet.len, packet.time_ns, packet.is_key);
+			}
+
+			if (!p_audio)
+			{
+				continue;
+			}
+
+			for (Packet const& packet : result.audio)
+			{
+				sidecar::AudioPacket audio_packet;
+				audio_packet.pos = packet.pos;
+				audio_packet.len = packet.len;
+				audio_packet.reserved = 0;
+				audio_packet.time_ns = packet.time_ns;
+				p_audio->push_back(audio_packet);
+			}
+		}
+
+		return true;
+	}
+}
+
+#endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_CLUSTER_SCAN_H_
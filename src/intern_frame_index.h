@@ -0,0 +1,366 @@
+#ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_FRAME_INDEX_H_
+#define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_FRAME_INDEX_H_
+
+#include <algorithm>
+#include <vector>
+#include "intern_base.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+//The position, size, time and key flag of every video frame, in decode order.
+//
+//The frames are kept in blocks of BlockFrames. A block has the smallest position
+//and time of its frames, every frame stores only the distance to them (the time
+//in units of the gcd of the distances, which is the timecode scale in practice),
+//packed with as many bits as the biggest distance of the block needs. The key
+//flags of a block are one u32. About 7 bytes a frame against 20 for the raw
+//struct with the time.
+//
+//The last block is kept raw until it is full, so push() is cheap and the frames
+//can be read while the index grows.
+class FrameIndex
+{
+public:
+	enum { BlockFrames = 32 };
+
+	typedef struct Frame
+	{
+		u64 pos;
+		u32 len;
+		u32 idx_key;	//the key frame the decoding has to start from
+		s64 time_ns;
+	} Frame;
+
+	FrameIndex()
+	{
+		clear();
+	}
+
+	void clear()
+	{
+		m_blocks.clear();
+		m_words.clear();
+		m_open_count = 0;
+		m_open_key_bits = 0;
+		m_key_count = 0;
+	}
+
+	//an estimate is enough, from the duration or the cues.
+	void reserve(size_t frames)
+	{
+		m_blocks.reserve(frames / BlockFrames + 1);
+		m_words.reserve(frames * GuessBitsPerFrame / 64 + 1);
+	}
+
+	void push(u64 pos, u32 len, s64 time_ns, bool is_key)
+	{
+		RawFrame& raw = m_open[m_open_count];
+		raw.pos = pos;
+		raw.len = len;
+		raw.time_ns = time_ns;
+
+		if (is_key)
+		{
+			m_open_key_bits |= 1u << m_open_count;
+			++m_key_count;
+		}
+
+		if (++m_open_count == BlockFrames)
+		{
+			mf_pack();
+		}
+	}
+
+	size_t size() const
+	{
+		return m_blocks.size() * BlockFrames + m_open_count;
+	}
+
+	bool empty() const
+	{
+		return size() == 0;
+	}
+
+	Frame get(u32 idx) const
+	{
+		Frame frame;
+		u32 const b = idx / BlockFrames;
+		u32 const i = idx % BlockFrames;
+
+		if (b < m_blocks.size())
+		{
+			Block const& block = m_blocks[b];
+			u32 const width = block.pos_bits + block.len_bits + block.time_bits;
+			u64 bit = block.bit_offset + static_cast<u64>(width) * i;
+
+			frame.pos = block.base_pos + mf_read_bits(bit, block.pos_bits);
+			bit += block.pos_bits;
+			frame.len = static_cast<u32>(mf_read_bits(bit, block.len_bits));
+			bit += block.len_bits;
+			frame.time_ns = block.base_time_ns + static_cast<s64>(mf_read_bits(bit, block.time_bits) * block.time_unit);
+			frame.idx_key = mf_key(block.key_bits, block.key_before, b, i);
+		}
+		else
+		{
+			RawFrame const& raw = m_open[i];
+			frame.pos = raw.pos;
+			frame.len = raw.len;
+			frame.time_ns = raw.time_ns;
+			frame.idx_key = mf_key(m_open_key_bits, mf_open_key_before(), b, i);
+		}
+
+		return frame;
+	}
+
+	//O(1), the key frame at or before idx. 0 when there is none.
+	u32 getKey(u32 idx) const
+	{
+		u32 const b = idx / BlockFrames;
+		u32 const i = idx % BlockFrames;
+		if (b < m_blocks.size())
+		{
+			return mf_key(m_blocks[b].key_bits, m_blocks[b].key_before, b, i);
+		}
+
+		return mf_key(m_open_key_bits, mf_open_key_before(), b, i);
+	}
+
+	s64 getTime(u32 idx) const
+	{
+		return get(idx).time_ns;
+	}
+
+	//O(log n), the last frame whose time is not after time_ns (0 if all are).
+	//The times are expected to grow, which they do in decode order for VP8/VP9.
+	u32 findFrame(s64 time_ns) const
+	{
+		size_t const count = size();
+		if (!count)
+		{
+			return 0;
+		}
+
+		size_t lo = 0;
+		size_t hi = count;
+		while (hi - lo > 1)
+		{
+			size_t mid = lo + (hi - lo) / 2;
+			if (getTime(static_cast<u32>(mid)) <= time_ns)
+			{
+				lo = mid;
+			}
+			else
+			{
+				hi = mid;
+			}
+		}
+
+		return static_cast<u32>(lo);
+	}
+
+	size_t getKeyCount() const
+	{
+		return m_key_count;
+	}
+
+	void getKeys(std::vector<u32>* p_out) const
+	{
+		p_out->clear();
+		p_out->reserve(m_key_count);
+		for (size_t b = 0; b <= m_blocks.size(); ++b)
+		{
+			u32 bits = b < m_blocks.size() ? m_blocks[b].key_bits : m_open_key_bits;
+			for (u32 i = 0; bits; ++i, bits >>= 1)
+			{
+				if (bits & 1)
+				{
+					p_out->push_back(static_cast<u32>(b * BlockFrames + i));
+				}
+			}
+		}
+	}
+
+	size_t getMemoryBytes() const
+	{
+		return sizeof(*this) + m_blocks.capacity() * sizeof(Block) + m_words.capacity() * sizeof(u64);
+	}
+
+private:
+	enum { GuessBitsPerFrame = 56 };
+
+	typedef struct RawFrame
+	{
+		u64 pos;
+		s64 time_ns;
+		u32 len;
+	} RawFrame;
+
+	typedef struct Block
+	{
+		u64 base_pos;
+		s64 base_time_ns;
+		u64 bit_offset;		//into m_words
+		u64 time_unit;
+		u32 key_before;		//the key frame in effect at the first frame of the block
+		u32 key_bits;		//bit i is set if frame i of the block is a key frame
+		u8	pos_bits;
+		u8	len_bits;
+		u8	time_bits;
+	} Block;
+
+	std::vector<Block>	m_blocks;
+	std::vector<u64>	m_words;
+	RawFrame			m_open[BlockFrames];
+	u32					m_open_count;
+	u32					m_open_key_bits;
+	size_t				m_key_count;
+
+	u32 mf_open_key_before() const
+	{
+		if (m_blocks.empty())
+		{
+			return 0;
+		}
+
+		Block const& last = m_blocks.back();
+		return mf_key(last.key_bits, last.key_before, static_cast<u32>(m_blocks.size() - 1), BlockFrames - 1);
+	}
+
+	static u32 mf_key(u32 key_bits, u32 key_before, u32 block, u32 i)
+	{
+		//2u << 31 wraps to 0, the mask is then all ones.
+		u32 const bits = key_bits & ((2u << i) - 1);
+		if (!bits)
+		{
+			return key_before;
+		}
+
+		return block * BlockFrames + mf_highest_bit(bits);
+	}
+
+	static u32 mf_highest_bit(u32 v)
+	{
+#if defined(_MSC_VER)
+		unsigned long idx;
+		_BitScanReverse(&idx, v);
+		return idx;
+#else
+		return 31 - __builtin_clz(v);
+#endif
+	}
+
+	static u8 mf_bits_for(u64 v)
+	{
+		u8 n = 0;
+		while (v)
+		{
+			++n;
+			v >>= 1;
+		}
+
+		return n;
+	}
+
+	static u64 mf_gcd(u64 a, u64 b)
+	{
+		while (b)
+		{
+			u64 t = a % b;
+			a = b;
+			b = t;
+		}
+
+		return a;
+	}
+
+	u64 mf_read_bits(u64 bit, u32 width) const
+	{
+		if (!width)
+		{
+			return 0;
+		}
+
+		size_t const w = static_cast<size_t>(bit / 64);
+		u32 const shift = static_cast<u32>(bit % 64);
+		u64 v = m_words[w] >> shift;
+		if (shift + width > 64)
+		{
+			v |= m_words[w + 1] << (64 - shift);
+		}
+
+		return width == 64 ? v : v & ((1ull << width) - 1);
+	}
+
+	void mf_write_bits(u64 bit, u32 width, u64 v)
+	{
+		if (!width)
+		{
+			return;
+		}
+
+		size_t const w = static_cast<size_t>(bit / 64);
+		u32 const shift = static_cast<u32>(bit % 64);
+		m_words[w] |= v << shift;
+		if (shift + width > 64)
+		{
+			m_words[w + 1] |= v >> (64 - shift);
+		}
+	}
+
+	void mf_pack()
+	{
+		Block block;
+		block.key_before = mf_open_key_before();
+		block.key_bits = m_open_key_bits;
+		block.base_pos = m_open[0].pos;
+		block.base_time_ns = m_open[0].time_ns;
+
+		for (u32 i = 1; i < BlockFrames; ++i)
+		{
+			block.base_pos = std::min(block.base_pos, m_open[i].pos);
+			block.base_time_ns = std::min(block.base_time_ns, m_open[i].time_ns);
+		}
+
+		u64 max_pos = 0;
+		u64 max_time = 0;
+		u32 max_len = 0;
+		u64 unit = 0;
+		for (u32 i = 0; i < BlockFrames; ++i)
+		{
+			u64 d_time = static_cast<u64>(m_open[i].time_ns - block.base_time_ns);
+			max_pos = std::max(max_pos, m_open[i].pos - block.base_pos);
+			max_time = std::max(max_time, d_time);
+			max_len = std::max(max_len, m_open[i].len);
+			unit = mf_gcd(unit, d_time);
+		}
+
+		block.time_unit = unit ? unit : 1;
+		block.pos_bits = mf_bits_for(max_pos);
+		block.len_bits = mf_bits_for(max_len);
+		block.time_bits = mf_bits_for(max_time / block.time_unit);
+
+		u32 const width = block.pos_bits + block.len_bits + block.time_bits;
+		block.bit_offset = m_words.size() * 64;
+		m_words.resize(m_words.size() + (static_cast<size_t>(width) * BlockFrames + 63) / 64, 0);
+
+		u64 bit = block.bit_offset;
+		for (u32 i = 0; i < BlockFrames; ++i)
+		{
+			RawFrame const& raw = m_open[i];
+			mf_write_bits(bit, block.pos_bits, raw.pos - block.base_pos);
+			bit += block.pos_bits;
+			mf_write_bits(bit, block.len_bits, raw.len);
+			bit += block.len_bits;
+			mf_write_bits(bit, block.time_bits, static_cast<u64>(raw.time_ns - block.base_time_ns) / block.time_unit);
+			bit += block.time_bits;
+		}
+
+		m_blocks.push_back(block);
+		m_open_count = 0;
+		m_open_key_bits = 0;
+	}
+};
+
+#endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_FRAME_INDEX_H_
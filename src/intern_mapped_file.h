@@ -0,0 +1,186 @@
+#ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_MAPPED_FILE_H_
+#define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_MAPPED_FILE_H_
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "intern_base.h"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+//size and last write time (seconds since epoch) of a file on disk.
+inline bool gf_get_file_stat(char const* path, u64* p_size, u64* p_mtime)
+{
+#if defined(_WIN32)
+	struct _stat64 st;
+	if (_stat64(path, &st) != 0)
+	{
+		return false;
+	}
+#else
+	struct stat st;
+	if (stat(path, &st) != 0)
+	{
+		return false;
+	}
+#endif
+
+	if (p_size)
+	{
+		*p_size = static_cast<u64>(st.st_size);
+	}
+
+	if (p_mtime)
+	{
+		*p_mtime = static_cast<u64>(st.st_mtime);
+	}
+
+	return true;
+}
+
+//Read-only view of a whole file. The pages are loaded by the OS when they are
+//touched, so opening a big file costs nothing until it is read.
+class MappedFile
+{
+public:
+	MappedFile()
+	: m_buffer(NULL)
+	, m_size(0)
+#if defined(_WIN32)
+	, m_file(INVALID_HANDLE_VALUE)
+	, m_mapping(NULL)
+#endif
+	{}
+
+	~MappedFile()
+	{
+		close();
+	}
+
+	bool open(char const* path)
+	{
+		close();
+
+#if defined(_WIN32)
+		m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (m_file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+		{
+			close();
+			return false;
+		}
+
+		m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!m_mapping)
+		{
+			close();
+			return false;
+		}
+
+		m_buffer = static_cast<u8 const*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!m_buffer)
+		{
+			close();
+			return false;
+		}
+
+		m_size = static_cast<size_t>(size.QuadPart);
+
+#else
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0)
+		{
+			return false;
+		}
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0)
+		{
+			::close(fd);
+			return false;
+		}
+
+		void* p = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED)
+		{
+			return false;
+		}
+
+		m_buffer = static_cast<u8 const*>(p);
+		m_size = static_cast<size_t>(st.st_size);
+
+#endif
+		return true;
+	}
+
+	void close()
+	{
+#if defined(_WIN32)
+		if (m_buffer)
+		{
+			UnmapViewOfFile(m_buffer);
+		}
+
+		if (m_mapping)
+		{
+			CloseHandle(m_mapping);
+			m_mapping = NULL;
+		}
+
+		if (m_file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(m_file);
+			m_file = INVALID_HANDLE_VALUE;
+		}
+
+#else
+		if (m_buffer)
+		{
+			munmap(const_cast<u8*>(m_buffer), m_size);
+		}
+
+#endif
+		m_buffer = NULL;
+		m_size = 0;
+	}
+
+	u8 const* get_buffer() const
+	{
+		return m_buffer;
+	}
+
+	size_t get_size() const
+	{
+		return m_size;
+	}
+
+private:
+	u8 const*	m_buffer;
+	size_t		m_size;
+#if defined(_WIN32)
+	HANDLE		m_file;
+	HANDLE		m_mapping;
+#endif
+
+	MappedFile(MappedFile const&);
+	MappedFile& operator=(MappedFile const&);
+};
+
+#endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_MAPPED_FILE_H_
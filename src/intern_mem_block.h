@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "intern_base.h"
 
 class MemBlock
@@ -11,6 +12,7 @@ public:
 	MemBlock()
 	: m_buffer(NULL)
 	, m_size(0)
+	, m_capacity(0)
 	{}
 
 	~MemBlock()
@@ -18,8 +20,15 @@ public:
 		mf_free();
 	}
 
+	//a block from the pool keeps its buffer if it is big enough.
 	bool alloc(size_t size)
 	{
+		if (m_buffer && m_capacity >= size)
+		{
+			m_size = size;
+			return true;
+		}
+
 		mf_free();
 
 		m_buffer = (u8*)malloc(size);
@@ -29,9 +38,38 @@ public:
 		}
 
 		m_size = size;
+		m_capacity = size;
+		return true;
+	}
+
+	//keeps the bytes, the buffer may move.
+	bool resize(size_t size)
+	{
+		u8* p = (u8*)realloc(m_buffer, size);
+		if (!p)
+		{
+			return false;
+		}
+
+		m_buffer = p;
+		m_size = size;
+		m_capacity = size;
 		return true;
 	}
 
+	//drops the first bytes, the rest moves to the front. The capacity stays.
+	void erase_front(size_t size)
+	{
+		if (size >= m_size)
+		{
+			m_size = 0;
+			return;
+		}
+
+		memmove(m_buffer, m_buffer + size, m_size - size);
+		m_size -= size;
+	}
+
 	u8* get_buffer()
 	{
 		return m_buffer;
@@ -42,14 +80,20 @@ public:
 		return m_buffer;
 	}
 
-	size_t get_size()
+	size_t get_size() const
 	{
 		return m_size;
 	}
 
+	size_t get_capacity() const
+	{
+		return m_capacity;
+	}
+
 private:
 	u8*			m_buffer;
 	size_t		m_size;
+	size_t		m_capacity;
 
 	void mf_free()
 	{
@@ -58,6 +102,7 @@ private:
 			free(m_buffer);
 			m_buffer = NULL;
 			m_size = 0;
+			m_capacity = 0;
 		}
 	}
 };
@@ -0,0 +1,221 @@
+#ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_MEMORY_BUDGET_H_
+#define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_MEMORY_BUDGET_H_
+
+#include <ofMain.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "intern_base.h"
+#include "intern_resource_pool.h"
+
+namespace memory
+{
+	enum Kind
+	{
+		KindMovie,		//the file buffer
+		KindAudio,		//the pre-decoded pcm
+		KindIndex,		//the frame index and the audio packets
+		KindDecoder,	//the reference frames of libvpx, estimated
+		KindGpu,		//the plane textures and the fbo, estimated
+		KindCount,
+	};
+
+	enum State
+	{
+		StateIdle,		//loaded, not playing
+		StatePaused,
+		StatePlaying,
+		StatePinned,	//never degraded, a playlist may be pulling its audio
+	};
+
+	//What one player holds. The player sets the bytes of a kind whenever they
+	//change, on any thread, the budget only reads them.
+	class Account
+	{
+	public:
+		Account()
+		: last_active_millis(0)
+		{
+			for (u32 i = 0; i < KindCount; ++i)
+			{
+				m_bytes[i] = 0;
+			}
+		}
+
+		void set(Kind kind, size_t bytes)
+		{
+			m_bytes[kind] = bytes;
+		}
+
+		size_t get(Kind kind) const
+		{
+			return m_bytes[kind];
+		}
+
+		size_t getTotal() const
+		{
+			size_t total = 0;
+			for (u32 i = 0; i < KindCount; ++i)
+			{
+				total += m_bytes[i];
+			}
+
+			return total;
+		}
+
+		void clear()
+		{
+			for (u32 i = 0; i < KindCount; ++i)
+			{
+				m_bytes[i] = 0;
+			}
+		}
+
+		u64							last_active_millis;
+		std::function<State()>		get_state;
+		std::function<void()>		degrade;	//frees what can be loaded again
+
+	private:
+		std::atomic<size_t>			m_bytes[KindCount];
+	};
+
+	//The sum of every account and of the idle resources of the pool, against a
+	//budget (0 is none). enforce() runs on the GL thread before a load and from
+	//update(); over the budget it frees, in this order:
+	//	1. the idle resources of the pool
+	//	2. the idle players, the least recently played first
+	//	3. the paused players, the same way
+	//What a degraded player drops lands in the pool, the pool is trimmed after
+	//every degrade and the total is taken again, not worked out from the drops.
+	//A degraded player keeps its last frame on screen and loads again when it is
+	//played. The playing players are never touched, the budget is then exceeded
+	//with a warning rather than the process running out of memory later.
+	class Budget
+	{
+	public:
+		//never destroyed, a player with static storage may outlive it otherwise.
+		static Budget& instance()
+		{
+			static Budget* s_p_budget = new Budget;
+			return *s_p_budget;
+		}
+
+		void setLimit(size_t bytes)
+		{
+			m_limit = bytes;
+		}
+
+		size_t getLimit() const
+		{
+			return m_limit;
+		}
+
+		void add(Account* p_account)
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			m_accounts.push_back(p_account);
+		}
+
+		void remove(Account* p_account)
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			m_accounts.erase(std::remove(m_accounts.begin(), m_accounts.end(), p_account), m_accounts.end());
+		}
+
+		size_t getTotal()
+		{
+			size_t total = pool::ResourcePool::instance().getIdleBytes();
+			std::lock_guard<std::mutex> locker(m_mtx);
+			for (Account const* p_account : m_accounts)
+			{
+				total += p_account->getTotal();
+			}
+
+			return total;
+		}
+
+		//makes room for incoming bytes more, p_self is the account asking and is not degraded.
+		void enforce(Account const* p_self, size_t incoming)
+		{
+			size_t const limit = m_limit;
+			if (!limit)
+			{
+				return;
+			}
+
+			size_t total = getTotal() + incoming;
+			if (total <= limit)
+			{
+				m_is_warned = false;
+				return;
+			}
+
+			pool::ResourcePool::instance().trim(total - limit);
+			total = getTotal() + incoming;
+
+			std::vector<Account*> accounts;
+			{
+				std::lock_guard<std::mutex> locker(m_mtx);
+				accounts = m_accounts;
+			}
+
+			std::stable_sort(accounts.begin(), accounts.end(), [](Account const* a, Account const* b)
+			{
+				return a->last_active_millis < b->last_active_millis;
+			});
+
+			State const states[] = { StateIdle, StatePaused };
+			for (State state : states)
+			{
+				for (Account* p_account : accounts)
+				{
+					if (total <= limit)
+					{
+						m_is_warned = false;
+						return;
+					}
+
+					if (p_account == p_self || !p_account->get_state || p_account->get_state() != state || !p_account->degrade)
+					{
+						continue;
+					}
+
+					//the movie block of the player goes to the pool when it is dropped,
+					//it is only gone once the pool lets it go too.
+					p_account->degrade();
+					total = getTotal() + incoming;
+					if (total > limit)
+					{
+						pool::ResourcePool::instance().trim(total - limit);
+						total = getTotal() + incoming;
+					}
+				}
+			}
+
+			if (total > limit && !m_is_warned)
+			{
+				m_is_warned = true;
+				ofLogWarning("ofxWebMPlayer", "The memory budget of %u MB is exceeded by %u MB, every player left is playing.",
+					static_cast<u32>(limit >> 20), static_cast<u32>((total - limit) >> 20));
+			}
+		}
+
+	private:
+		std::mutex				m_mtx;
+		std::atomic<size_t>		m_limit;
+		std::vector<Account*>	m_accounts;
+		bool					m_is_warned;	//once until it is under the budget again
+
+		Budget()
+		: m_limit(0)
+		, m_is_warned(false)
+		{}
+
+		Budget(Budget const&);
+		Budget& operator=(Budget const&);
+	};
+}
+
+#endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_MEMORY_BUDGET_H_
@@ -0,0 +1,150 @@
+#ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_OFFLINE_DECODE_H_
+#define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_OFFLINE_DECODE_H_
+
+#include <string.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "vpx_decoder.h"
+#include "intern_base.h"
+
+//decodeOffline(): every GOP starts on a key frame, so the GOPs go to decoders
+//on threads of their own and the frames come back in order through a reorder
+//buffer. The buffer holds a window of frames after the next one to deliver,
+//a decoder which is further ahead waits, so the memory stays bounded and the
+//decoder of the next frame is never the one waiting.
+namespace offline
+{
+	typedef struct Image
+	{
+		u32					index;
+		s64					time_ns;
+		u32					width;
+		u32					height;
+		u32					bit_depth;
+		u32					chroma_shift_x;
+		u32					chroma_shift_y;
+		bool				is_valid;		//false if the decoder gave no image for the frame
+		std::vector<u8>		data;			//the 3 planes one after the other, no padding
+		size_t				offsets[3];
+		u32					strides[3];		//bytes
+	} Image;
+
+	//the visible samples, the decoder reuses its buffers with the next frame.
+	inline void copyImage(vpx_image_t const* p_image, Image* p_out)
+	{
+		u32 const bytes_per_sample = (p_image->fmt & VPX_IMG_FMT_HIGHBITDEPTH) ? 2 : 1;
+		p_out->width = p_image->d_w;
+		p_out->height = p_image->d_h;
+		p_out->bit_depth = bytes_per_sample == 2 ? p_image->bit_depth : 8;
+		p_out->chroma_shift_x = p_image->x_chroma_shift;
+		p_out->chroma_shift_y = p_image->y_chroma_shift;
+
+		u32 heights[3];
+		size_t size = 0;
+		for (u32 i = 0; i < 3; ++i)
+		{
+			u32 const w = i ? (p_image->d_w + p_image->x_chroma_shift) >> p_image->x_chroma_shift : p_image->d_w;
+			heights[i] = i ? (p_image->d_h + p_image->y_chroma_shift) >> p_image->y_chroma_shift : p_image->d_h;
+			p_out->strides[i] = w * bytes_per_sample;
+			p_out->offsets[i] = size;
+			size += static_cast<size_t>(p_out->strides[i]) * heights[i];
+		}
+
+		p_out->data.resize(size);
+		for (u32 i = 0; i < 3; ++i)
+		{
+			for (u32 y = 0; y < heights[i]; ++y)
+			{
+				memcpy(p_out->data.data() + p_out->offsets[i] + static_cast<size_t>(y) * p_out->strides[i],
+					p_image->planes[i] + static_cast<size_t>(y) * p_image->stride[i], p_out->strides[i]);
+			}
+		}
+
+		p_out->is_valid = true;
+	}
+
+	class ReorderBuffer
+	{
+	public:
+		explicit ReorderBuffer(u32 capacity)
+		: m_slots(capacity)
+		, m_next(0)
+		, m_is_cancelled(false)
+		{}
+
+		//an image to fill, one given back by release() if there is one.
+		std::unique_ptr<Image> acquire()
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			if (m_free.empty())
+			{
+				return std::unique_ptr<Image>(new Image);
+			}
+
+			std::unique_ptr<Image> up_image = std::move(m_free.back());
+			m_free.pop_back();
+			return up_image;
+		}
+
+		void release(std::unique_ptr<Image> up_image)
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			m_free.push_back(std::move(up_image));
+		}
+
+		//waits while the frame is past the window, false once cancelled.
+		bool push(std::unique_ptr<Image> up_image)
+		{
+			u32 const index = up_image->index;
+			std::unique_lock<std::mutex> locker(m_mtx);
+			m_cv.wait(locker, [&]() { return m_is_cancelled || index < m_next + m_slots.size(); });
+			if (m_is_cancelled)
+			{
+				return false;
+			}
+
+			m_slots[index % m_slots.size()] = std::move(up_image);
+			m_cv.notify_all();
+			return true;
+		}
+
+		//the next frame in order, null once cancelled.
+		std::unique_ptr<Image> pop()
+		{
+			std::unique_lock<std::mutex> locker(m_mtx);
+			std::unique_ptr<Image>& up_slot = m_slots[m_next % m_slots.size()];
+			m_cv.wait(locker, [&]() { return m_is_cancelled || up_slot; });
+			if (m_is_cancelled)
+			{
+				return nullptr;
+			}
+
+			std::unique_ptr<Image> up_image = std::move(up_slot);
+			++m_next;
+			m_cv.notify_all();
+			return up_image;
+		}
+
+		void cancel()
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			m_is_cancelled = true;
+			m_cv.notify_all();
+		}
+
+	private:
+		std::mutex								m_mtx;
+		std::condition_variable					m_cv;
+		std::vector<std::unique_ptr<Image>>		m_slots;
+		std::vector<std::unique_ptr<Image>>		m_free;
+		u32										m_next;
+		bool									m_is_cancelled;
+
+		ReorderBuffer(ReorderBuffer const&);
+		ReorderBuffer& operator=(ReorderBuffer const&);
+	};
+}
+
+#endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_OFFLINE_DECODE_H_
@@ -0,0 +1,357 @@
+#ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_PCM_KERNELS_H_
+#define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_PCM_KERNELS_H_
+
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "intern_base.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define USE_OFXWEBMPLAYER_X86_KERNELS
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define OFXWEBMPLAYER_TARGET_SSE2
+#define OFXWEBMPLAYER_TARGET_AVX
+#else
+#include <cpuid.h>
+#define OFXWEBMPLAYER_TARGET_SSE2 __attribute__((target("sse2")))
+#define OFXWEBMPLAYER_TARGET_AVX __attribute__((target("avx")))
+#endif
+#endif
+
+//Kernels that turn the planar float output of vorbis into interleaved, clamped
+//samples. They run once per decoded packet for the whole track, so they are a
+//large part of the audio load time.
+//
+//The clip check does not branch per sample: the kernels keep the running
+//maximum of |sample| and compare it once at the end.
+namespace audio
+{
+	namespace kernel
+	{
+		//returns true if any sample was out of [-1, 1]
+		typedef bool (*InterleaveFn)(f32 const* const* pcm, u32 frames, u32 channels, f32* dst);
+		typedef void (*ToS16Fn)(f32 const* src, s16* dst, u32 count);
+
+		struct Table
+		{
+			char const*		name;
+			InterleaveFn	interleave_mono;
+			InterleaveFn	interleave_stereo;
+			InterleaveFn	interleave_5_1;
+			InterleaveFn	interleave_any;
+			ToS16Fn			to_s16;
+
+			InterleaveFn select(u32 channels) const
+			{
+				switch (channels)
+				{
+				case 1: return interleave_mono;
+				case 2: return interleave_stereo;
+				case 6: return interleave_5_1;
+				default: return interleave_any;
+				}
+			}
+		};
+
+		//scalar ---------------------------------------------------------
+
+		inline bool interleaveAnyScalar(f32 const* const* pcm, u32 frames, u32 channels, f32* dst)
+		{
+			f32 peak = 0.f;
+			for (u32 ch = 0; ch < channels; ++ch)
+			{
+				f32* ptr = dst + ch;
+				f32 const* mono = pcm[ch];
+				for (u32 i = 0; i < frames; ++i)
+				{
+					f32 v = mono[i];
+					f32 a = v < 0.f ? -v : v;
+					peak = a > peak ? a : peak;
+					v = v > 1.f ? 1.f : v;
+					*ptr = v < -1.f ? -1.f : v;
+					ptr += channels;
+				}
+			}
+
+			return peak > 1.f;
+		}
+
+		inline void toS16Scalar(f32 const* src, s16* dst, u32 count)
+		{
+			for (u32 i = 0; i < count; ++i)
+			{
+				f32 v = src[i] * 32767.f;
+				dst[i] = static_cast<s16>(v < 0.f ? v - 0.5f : v + 0.5f);
+			}
+		}
+
+#if defined(USE_OFXWEBMPLAYER_X86_KERNELS)
+		//sse2 -----------------------------------------------------------
+
+		OFXWEBMPLAYER_TARGET_SSE2 inline __m128 clampTrack(__m128 v, __m128& peak)
+		{
+			__m128 const abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+			peak = _mm_max_ps(peak, _mm_and_ps(v, abs_mask));
+			return _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.f)), _mm_set1_ps(1.f));
+		}
+
+		OFXWEBMPLAYER_TARGET_SSE2 inline bool peakOver(__m128 peak, bool is_tail_clip)
+		{
+			return (_mm_movemask_ps(_mm_cmpgt_ps(peak, _mm_set1_ps(1.f))) != 0) || is_tail_clip;
+		}
+
+		OFXWEBMPLAYER_TARGET_SSE2 inline bool interleaveMonoSse2(f32 const* const* pcm, u32 frames, u32 /*channels*/, f32* dst)
+		{
+			f32 const* src = pcm[0];
+			__m128 peak = _mm_setzero_ps();
+			u32 i = 0;
+			for (; i + 4 <= frames; i += 4)
+			{
+				_mm_storeu_ps(dst + i, clampTrack(_mm_loadu_ps(src + i), peak));
+			}
+
+			f32 const* tail[1] = { src + i };
+			bool is_clip = interleaveAnyScalar(tail, frames - i, 1, dst + i);
+			return peakOver(peak, is_clip);
+		}
+
+		OFXWEBMPLAYER_TARGET_SSE2 inline bool interleaveStereoSse2(f32 const* const* pcm, u32 frames, u32 /*channels*/, f32* dst)
+		{
+			f32 const* l = pcm[0];
+			f32 const* r = pcm[1];
+			__m128 peak = _mm_setzero_ps();
+			u32 i = 0;
+			for (; i + 4 <= frames; i += 4)
+			{
+				__m128 vl = clampTrack(_mm_loadu_ps(l + i), peak);
+				__m128 vr = clampTrack(_mm_loadu_ps(r + i), peak);
+				_mm_storeu_ps(dst + i * 2, _mm_unpacklo_ps(vl, vr));
+				_mm_storeu_ps(dst + i * 2 + 4, _mm_unpackhi_ps(vl, vr));
+			}
+
+			f32 const* tail[2] = { l + i, r + i };
+			bool is_clip = interleaveAnyScalar(tail, frames - i, 2, dst + i * 2);
+			return peakOver(peak, is_clip);
+		}
+
+		//4 frames of 6 channels are 6 vectors: channels 0-3 go through a 4x4
+		//transpose, channels 4-5 are paired and shuffled in between.
+		OFXWEBMPLAYER_TARGET_SSE2 inline bool interleave51Sse2(f32 const* const* pcm, u32 frames, u32 /*channels*/, f32* dst)
+		{
+			__m128 peak = _mm_setzero_ps();
+			u32 i = 0;
+			for (; i + 4 <= frames; i += 4)
+			{
+				__m128 c0 = clampTrack(_mm_loadu_ps(pcm[0] + i), peak);
+				__m128 c1 = clampTrack(_mm_loadu_ps(pcm[1] + i), peak);
+				__m128 c2 = clampTrack(_mm_loadu_ps(pcm[2] + i), peak);
+				__m128 c3 = clampTrack(_mm_loadu_ps(pcm[3] + i), peak);
+				__m128 c4 = clampTrack(_mm_loadu_ps(pcm[4] + i), peak);
+				__m128 c5 = clampTrack(_mm_loadu_ps(pcm[5] + i), peak);
+
+				_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+				__m128 p01 = _mm_unpacklo_ps(c4, c5);
+				__m128 p23 = _mm_unpackhi_ps(c4, c5);
+
+				f32* out = dst + i * 6;
+				_mm_storeu_ps(out, c0);
+				_mm_storeu_ps(out + 4, _mm_shuffle_ps(p01, c1, _MM_SHUFFLE(1, 0, 1, 0)));
+				_mm_storeu_ps(out + 8, _mm_shuffle_ps(c1, p01, _MM_SHUFFLE(3, 2, 3, 2)));
+				_mm_storeu_ps(out + 12, c2);
+				_mm_storeu_ps(out + 16, _mm_shuffle_ps(p23, c3, _MM_SHUFFLE(1, 0, 1, 0)));
+				_mm_storeu_ps(out + 20, _mm_shuffle_ps(c3, p23, _MM_SHUFFLE(3, 2, 3, 2)));
+			}
+
+			f32 const* tail[6] = { pcm[0] + i, pcm[1] + i, pcm[2] + i, pcm[3] + i, pcm[4] + i, pcm[5] + i };
+			bool is_clip = interleaveAnyScalar(tail, frames - i, 6, dst + i * 6);
+			return peakOver(peak, is_clip);
+		}
+
+		//cvtps rounds to nearest and packs saturates, so no clamp is needed.
+		OFXWEBMPLAYER_TARGET_SSE2 inline void toS16Sse2(f32 const* src, s16* dst, u32 count)
+		{
+			__m128 const k = _mm_set1_ps(32767.f);
+			u32 i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				__m128i lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i), k));
+				__m128i hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 4), k));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(lo, hi));
+			}
+
+			toS16Scalar(src + i, dst + i, count - i);
+		}
+
+		//avx ------------------------------------------------------------
+
+		OFXWEBMPLAYER_TARGET_AVX inline __m256 clampTrack256(__m256 v, __m256& peak)
+		{
+			__m256 const abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+			peak = _mm256_max_ps(peak, _mm256_and_ps(v, abs_mask));
+			return _mm256_min_ps(_mm256_max_ps(v, _mm256_set1_ps(-1.f)), _mm256_set1_ps(1.f));
+		}
+
+		OFXWEBMPLAYER_TARGET_AVX inline bool peakOver256(__m256 peak, bool is_tail_clip)
+		{
+			return (_mm256_movemask_ps(_mm256_cmp_ps(peak, _mm256_set1_ps(1.f), _CMP_GT_OQ)) != 0) || is_tail_clip;
+		}
+
+		OFXWEBMPLAYER_TARGET_AVX inline bool interleaveMonoAvx(f32 const* const* pcm, u32 frames, u32 /*channels*/, f32* dst)
+		{
+			f32 const* src = pcm[0];
+			__m256 peak = _mm256_setzero_ps();
+			u32 i = 0;
+			for (; i + 8 <= frames; i += 8)
+			{
+				_mm256_storeu_ps(dst + i, clampTrack256(_mm256_loadu_ps(src + i), peak));
+			}
+
+			f32 const* tail[1] = { src + i };
+			bool is_clip = interleaveAnyScalar(tail, frames - i, 1, dst + i);
+			bool is_over = peakOver256(peak, is_clip);
+			_mm256_zeroupper();
+			return is_over;
+		}
+
+		OFXWEBMPLAYER_TARGET_AVX inline bool interleaveStereoAvx(f32 const* const* pcm, u32 frames, u32 /*channels*/, f32* dst)
+		{
+			f32 const* l = pcm[0];
+			f32 const* r = pcm[1];
+			__m256 peak = _mm256_setzero_ps();
+			u32 i = 0;
+			for (; i + 8 <= frames; i += 8)
+			{
+				__m256 vl = clampTrack256(_mm256_loadu_ps(l + i), peak);
+				__m256 vr = clampTrack256(_mm256_loadu_ps(r + i), peak);
+
+				//unpack works per 128-bit lane, the permute puts the halves in order.
+				__m256 lo = _mm256_unpacklo_ps(vl, vr);
+				__m256 hi = _mm256_unpackhi_ps(vl, vr);
+				_mm256_storeu_ps(dst + i * 2, _mm256_permute2f128_ps(lo, hi, 0x20));
+				_mm256_storeu_ps(dst + i * 2 + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+			}
+
+			f32 const* tail[2] = { l + i, r + i };
+			bool is_clip = interleaveAnyScalar(tail, frames - i, 2, dst + i * 2);
+			bool is_over = peakOver256(peak, is_clip);
+			_mm256_zeroupper();
+			return is_over;
+		}
+
+		//cpu features ---------------------------------------------------
+
+		inline void cpuid(int leaf, int regs[4])
+		{
+#if defined(_MSC_VER)
+			__cpuid(regs, leaf);
+#else
+			unsigned int a = 0, b = 0, c = 0, d = 0;
+			__get_cpuid(leaf, &a, &b, &c, &d);
+			regs[0] = a; regs[1] = b; regs[2] = c; regs[3] = d;
+#endif
+		}
+
+		inline bool hasSse2()
+		{
+			int regs[4];
+			cpuid(1, regs);
+			return (regs[3] & (1 << 26)) != 0;
+		}
+
+		//AVX needs the cpu bit and the OS saving the ymm registers.
+		inline bool hasAvx()
+		{
+			int regs[4];
+			cpuid(1, regs);
+			bool is_osxsave = (regs[2] & (1 << 27)) != 0;
+			bool is_avx = (regs[2] & (1 << 28)) != 0;
+			if (!is_osxsave || !is_avx)
+			{
+				return false;
+			}
+
+#if defined(_MSC_VER)
+			u64 xcr0 = _xgetbv(0);
+#else
+			u32 lo, hi;
+			__asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+			u64 xcr0 = (static_cast<u64>(hi) << 32) | lo;
+#endif
+			return (xcr0 & 0x6) == 0x6;
+		}
+
+#endif
+		inline Table const& scalarTable()
+		{
+			static Table const s_table =
+			{
+				"scalar",
+				interleaveAnyScalar, interleaveAnyScalar, interleaveAnyScalar, interleaveAnyScalar,
+				toS16Scalar,
+			};
+			return s_table;
+		}
+
+		inline Table detect()
+		{
+			Table table = scalarTable();
+#if defined(USE_OFXWEBMPLAYER_X86_KERNELS)
+			if (hasSse2())
+			{
+				table.name = "sse2";
+				table.interleave_mono = interleaveMonoSse2;
+				table.interleave_stereo = interleaveStereoSse2;
+				table.interleave_5_1 = interleave51Sse2;
+				table.to_s16 = toS16Sse2;
+			}
+
+			if (hasAvx())
+			{
+				table.name = "avx";
+				table.interleave_mono = interleaveMonoAvx;
+				table.interleave_stereo = interleaveStereoAvx;
+			}
+
+#endif
+			return table;
+		}
+
+		//the kernels of this cpu, detected once
+		inline Table const& get()
+		{
+			static Table const s_table = detect();
+			return s_table;
+		}
+
+		//samples per second of one interleave kernel
+		inline f64 measureInterleave(Table const& table, u32 channels, u32 frames, u32 iterations)
+		{
+			std::vector<f32> planar(static_cast<size_t>(frames) * channels);
+			std::vector<f32> interleaved(static_cast<size_t>(frames) * channels);
+			std::vector<f32 const*> pcm(channels);
+
+			for (u32 ch = 0; ch < channels; ++ch)
+			{
+				pcm[ch] = &planar[ch * frames];
+				for (u32 i = 0; i < frames; ++i)
+				{
+					planar[ch * frames + i] = ((i * 7 + ch * 13) % 256) / 112.f - 1.1f;
+				}
+			}
+
+			InterleaveFn fn = table.select(channels);
+			std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+			for (u32 n = 0; n < iterations; ++n)
+			{
+				fn(pcm.data(), frames, channels, interleaved.data());
+			}
+			std::chrono::duration<f64> elapsed = std::chrono::steady_clock::now() - begin;
+
+			return elapsed.count() > 0.0 ? (static_cast<f64>(frames) * channels * iterations) / elapsed.count() : 0.0;
+		}
+	}
+}
+
+#endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_PCM_KERNELS_H_
@@ -0,0 +1,419 @@
+#ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_PCM_STORE_H_
+#define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_PCM_STORE_H_
+
+#include <string.h>
+#include <vector>
+#include "intern_mem_block.h"
+#include "intern_pcm_kernels.h"
+
+namespace audio
+{
+	enum PcmFormat
+	{
+		PCM_F32,	//interleaved float, 4 bytes per sample
+		PCM_S16,	//interleaved int16, 2 bytes per sample
+		PCM_ADPCM,	//IMA ADPCM blocks, about 0.5 bytes per sample
+	};
+
+	namespace adpcm
+	{
+		static s32 const g_step_table[89] =
+		{
+			7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+			19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+			50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+			130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+			337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+			876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+			2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+			5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+			15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+		};
+
+		static s32 const g_index_table[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+		struct State
+		{
+			s32 predictor;
+			s32 index;
+		};
+
+		inline s32 decodeNibble(State& st, u32 nibble)
+		{
+			s32 step = g_step_table[st.index];
+			s32 delta = step >> 3;
+			if (nibble & 4) delta += step;
+			if (nibble & 2) delta += step >> 1;
+			if (nibble & 1) delta += step >> 2;
+
+			st.predictor += (nibble & 8) ? -delta : delta;
+			st.predictor = st.predictor > 32767 ? 32767 : (st.predictor < -32768 ? -32768 : st.predictor);
+
+			st.index += g_index_table[nibble & 7];
+			st.index = st.index > 88 ? 88 : (st.index < 0 ? 0 : st.index);
+			return st.predictor;
+		}
+
+		inline u32 encodeSample(State& st, s32 sample)
+		{
+			s32 diff = sample - st.predictor;
+			u32 nibble = 0;
+			if (diff < 0)
+			{
+				nibble = 8;
+				diff = -diff;
+			}
+
+			s32 step = g_step_table[st.index];
+			if (diff >= step) { nibble |= 4; diff -= step; }
+			step >>= 1;
+			if (diff >= step) { nibble |= 2; diff -= step; }
+			step >>= 1;
+			if (diff >= step) { nibble |= 1; }
+
+			//track what the decoder will see, so the error does not accumulate.
+			decodeNibble(st, nibble);
+			return nibble;
+		}
+	}
+
+	//Pre-decoded audio of one movie. It is written once in decode order and read by
+	//the audio thread, always converted back to interleaved float.
+	//
+	//ADPCM is stored in independent blocks of BlockFrames frames, every channel of a
+	//block starts with its own predictor state, so any block can be decoded alone.
+	class PcmStore
+	{
+	public:
+		enum
+		{
+			BlockFrames = 256,
+			BlockHeaderBytes = 4,
+			BlockChannelBytes = BlockHeaderBytes + BlockFrames / 2,
+		};
+
+		PcmStore()
+		: m_format(PCM_F32)
+		, m_channels(0)
+		, m_frames(0)
+		, m_written(0)
+		, m_is_clip(false)
+		, m_cached_block(~0ull)
+		, m_p_kernels(&kernel::get())
+		{}
+
+		bool alloc(PcmFormat format, u32 channels, u64 frames)
+		{
+			m_format = format;
+			m_channels = channels;
+			m_frames = frames;
+			m_written = 0;
+			m_is_clip = false;
+			m_cached_block = ~0ull;
+			adpcm::State st = { 0, 0 };
+			m_adpcm_state.assign(channels, st);
+
+			size_t size = 0;
+			switch (m_format)
+			{
+			case PCM_F32:
+				size = static_cast<size_t>(frames * channels * sizeof(f32));
+				break;
+
+			case PCM_S16:
+				size = static_cast<size_t>(frames * channels * sizeof(s16));
+				break;
+
+			case PCM_ADPCM:
+				size = static_cast<size_t>(mf_num_blocks() * mf_block_bytes());
+				m_stage.assign(static_cast<size_t>(BlockFrames) * channels, 0.f);
+				m_cache.assign(static_cast<size_t>(BlockFrames) * channels, 0.f);
+				break;
+			}
+
+			return m_mb.alloc(size ? size : 1);
+		}
+
+		//pcm[channel][frame], as vorbis gives it.
+		void write(f32 const* const* pcm, u32 frames)
+		{
+			if (m_written + frames > m_frames)
+			{
+				frames = static_cast<u32>(m_frames - m_written);
+			}
+
+			switch (m_format)
+			{
+			case PCM_F32:
+				mf_write_f32(pcm, frames);
+				break;
+
+			case PCM_S16:
+				mf_write_s16(pcm, frames);
+				break;
+
+			case PCM_ADPCM:
+				mf_write_adpcm(pcm, frames);
+				break;
+			}
+
+			m_written += frames;
+		}
+
+		//flushes the last partial ADPCM block
+		void finish()
+		{
+			if (m_format != PCM_ADPCM)
+			{
+				return;
+			}
+
+			u32 staged = static_cast<u32>(m_written % BlockFrames);
+			if (staged)
+			{
+				for (u32 ch = 0; ch < m_channels; ++ch)
+				{
+					memset(&m_stage[ch * BlockFrames + staged], 0x00, sizeof(f32) * (BlockFrames - staged));
+				}
+
+				mf_encode_block(m_written / BlockFrames);
+			}
+		}
+
+		//returns the frames copied to output (interleaved float).
+		u32 read(u64 frame_pos, f32* output, u32 frames)
+		{
+			if (frame_pos >= m_frames)
+			{
+				return 0;
+			}
+
+			if (frame_pos + frames > m_frames)
+			{
+				frames = static_cast<u32>(m_frames - frame_pos);
+			}
+
+			switch (m_format)
+			{
+			case PCM_F32:
+				memcpy(output, m_mb.get_buffer() + frame_pos * m_channels * sizeof(f32), sizeof(f32) * frames * m_channels);
+				break;
+
+			case PCM_S16:
+				mf_read_s16(reinterpret_cast<s16 const*>(m_mb.get_buffer()) + frame_pos * m_channels, output, frames * m_channels);
+				break;
+
+			case PCM_ADPCM:
+				mf_read_adpcm(frame_pos, output, frames);
+				break;
+			}
+
+			return frames;
+		}
+
+		PcmFormat getFormat() const
+		{
+			return m_format;
+		}
+
+		u32 getChannels() const
+		{
+			return m_channels;
+		}
+
+		u64 getFrames() const
+		{
+			return m_frames;
+		}
+
+		bool isClipped() const
+		{
+			return m_is_clip;
+		}
+
+		size_t getMemoryBytes()
+		{
+			return m_mb.get_size() + (m_stage.size() + m_cache.size()) * sizeof(f32);
+		}
+
+	private:
+		MemBlock			m_mb;
+		PcmFormat			m_format;
+		u32					m_channels;
+		u64					m_frames;
+		u64					m_written;
+		bool				m_is_clip;
+
+		//ADPCM encoder staging and decoder cache
+		std::vector<f32>	m_stage;
+		std::vector<f32>	m_cache;
+		u64					m_cached_block;
+		std::vector<adpcm::State>	m_adpcm_state;
+
+		kernel::Table const*	m_p_kernels;
+		std::vector<f32>		m_convert;
+
+		u64 mf_num_blocks() const
+		{
+			return (m_frames + BlockFrames - 1) / BlockFrames;
+		}
+
+		size_t mf_block_bytes() const
+		{
+			return static_cast<size_t>(BlockChannelBytes) * m_channels;
+		}
+
+		void mf_write_f32(f32 const* const* pcm, u32 frames)
+		{
+			f32* dst = reinterpret_cast<f32*>(m_mb.get_buffer()) + m_written * m_channels;
+			m_is_clip = m_p_kernels->select(m_channels)(pcm, frames, m_channels, dst) || m_is_clip;
+		}
+
+		//interleave into a small float buffer, then convert it in one pass.
+		void mf_write_s16(f32 const* const* pcm, u32 frames)
+		{
+			enum { ChunkFrames = 1024 };
+			s16* dst = reinterpret_cast<s16*>(m_mb.get_buffer()) + m_written * m_channels;
+			m_convert.resize(static_cast<size_t>(ChunkFrames) * m_channels);
+
+			kernel::InterleaveFn interleave = m_p_kernels->select(m_channels);
+			std::vector<f32 const*> chunk(pcm, pcm + m_channels);
+
+			for (u32 done = 0; done < frames; done += ChunkFrames)
+			{
+				u32 count = frames - done < static_cast<u32>(ChunkFrames) ? frames - done : static_cast<u32>(ChunkFrames);
+				for (u32 ch = 0; ch < m_channels; ++ch)
+				{
+					chunk[ch] = pcm[ch] + done;
+				}
+
+				m_is_clip = interleave(chunk.data(), count, m_channels, m_convert.data()) || m_is_clip;
+				m_p_kernels->to_s16(m_convert.data(), dst + done * m_channels, count * m_channels);
+			}
+		}
+
+		void mf_read_s16(s16 const* src, f32* dst, u32 count)
+		{
+			f32 const k = 1.f / 32768.f;
+			u32 i = 0;
+#if defined(USE_OFXWEBMPLAYER_SSE2)
+			__m128 const v_k = _mm_set1_ps(k);
+			for (; i + 8 <= count; i += 8)
+			{
+				__m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+				//sign extend by putting each int16 in the high half and shifting back
+				__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+				__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+				_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), v_k));
+				_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), v_k));
+			}
+
+#endif
+			for (; i < count; ++i)
+			{
+				dst[i] = src[i] * k;
+			}
+		}
+
+		void mf_write_adpcm(f32 const* const* pcm, u32 frames)
+		{
+			u32 done = 0;
+			while (done < frames)
+			{
+				u64 pos = m_written + done;
+				u32 staged = static_cast<u32>(pos % BlockFrames);
+				u32 count = BlockFrames - staged;
+				count = count < frames - done ? count : frames - done;
+
+				//a mono "interleave" is a clamped copy
+				for (u32 ch = 0; ch < m_channels; ++ch)
+				{
+					f32 const* mono[1] = { pcm[ch] + done };
+					m_is_clip = m_p_kernels->interleave_mono(mono, count, 1, &m_stage[ch * BlockFrames + staged]) || m_is_clip;
+				}
+
+				done += count;
+				if (staged + count == BlockFrames)
+				{
+					mf_encode_block(pos / BlockFrames);
+				}
+			}
+		}
+
+		void mf_encode_block(u64 block_idx)
+		{
+			u8* block = m_mb.get_buffer() + block_idx * mf_block_bytes();
+			for (u32 ch = 0; ch < m_channels; ++ch)
+			{
+				adpcm::State& st = m_adpcm_state[ch];
+				u8* header = block + ch * BlockChannelBytes;
+				u8* nibbles = header + BlockHeaderBytes;
+
+				s16 predictor = static_cast<s16>(st.predictor);
+				memcpy(header, &predictor, sizeof(s16));
+				header[2] = static_cast<u8>(st.index);
+				header[3] = 0;
+
+				f32 const* stage = &m_stage[ch * BlockFrames];
+				for (u32 i = 0; i < BlockFrames; i += 2)
+				{
+					u32 n0 = adpcm::encodeSample(st, static_cast<s32>(stage[i] * 32767.f));
+					u32 n1 = adpcm::encodeSample(st, static_cast<s32>(stage[i + 1] * 32767.f));
+					nibbles[i / 2] = static_cast<u8>(n0 | (n1 << 4));
+				}
+			}
+		}
+
+		void mf_decode_block(u64 block_idx)
+		{
+			f32 const k = 1.f / 32768.f;
+			u8 const* block = m_mb.get_buffer() + block_idx * mf_block_bytes();
+			for (u32 ch = 0; ch < m_channels; ++ch)
+			{
+				u8 const* header = block + ch * BlockChannelBytes;
+				u8 const* nibbles = header + BlockHeaderBytes;
+
+				s16 predictor;
+				memcpy(&predictor, header, sizeof(s16));
+
+				adpcm::State st;
+				st.predictor = predictor;
+				st.index = header[2] > 88 ? 88 : header[2];
+
+				f32* dst = &m_cache[ch];
+				for (u32 i = 0; i < BlockFrames / 2; ++i)
+				{
+					u8 byte = nibbles[i];
+					dst[0] = adpcm::decodeNibble(st, byte & 0x0f) * k;
+					dst[m_channels] = adpcm::decodeNibble(st, byte >> 4) * k;
+					dst += m_channels * 2;
+				}
+			}
+
+			m_cached_block = block_idx;
+		}
+
+		void mf_read_adpcm(u64 frame_pos, f32* output, u32 frames)
+		{
+			u32 done = 0;
+			while (done < frames)
+			{
+				u64 pos = frame_pos + done;
+				u64 block_idx = pos / BlockFrames;
+				u32 offset = static_cast<u32>(pos % BlockFrames);
+
+				if (block_idx != m_cached_block)
+				{
+					mf_decode_block(block_idx);
+				}
+
+				u32 count = BlockFrames - offset;
+				count = count < frames - done ? count : frames - done;
+				memcpy(output + done * m_channels, &m_cache[offset * m_channels], sizeof(f32) * count * m_channels);
+				done += count;
+			}
+		}
+	};
+}
+
+#endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_PCM_STORE_H_
@@ -0,0 +1,118 @@
+#ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_PLANE_SCALE_H_
+#define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_PLANE_SCALE_H_
+
+#include <vector>
+#include "intern_base.h"
+
+//Box filters that make a decoded plane smaller by an integer factor, for the
+//players of setPreviewSize(). Every sample of the output is the average of a
+//factor x factor block of the input, a block on the right or bottom edge
+//averages what is there. Halving 8 bits planes, the common 4K to 1080p case,
+//has an SSE2 path.
+namespace scale
+{
+	inline u32 getScaledSize(u32 size, u32 factor)
+	{
+		return (size + factor - 1) / factor;
+	}
+
+	//strides in samples, p_sums is scratch kept by the caller.
+	template <typename T>
+	inline void boxDownScalar(T const* src, u32 src_stride, u32 src_w, u32 src_h, u32 factor, T* dst, u32 dst_stride, std::vector<u32>* p_sums)
+	{
+		u32 const dst_w = getScaledSize(src_w, factor);
+		u32 const dst_h = getScaledSize(src_h, factor);
+		u32 const last_cols = src_w - (dst_w - 1) * factor;
+		p_sums->resize(dst_w);
+		u32* sums = p_sums->data();
+
+		for (u32 y = 0; y < dst_h; ++y)
+		{
+			u32 const row_begin = y * factor;
+			u32 const rows = (row_begin + factor <= src_h) ? factor : src_h - row_begin;
+			for (u32 x = 0; x < dst_w; ++x)
+			{
+				sums[x] = 0;
+			}
+
+			for (u32 r = 0; r < rows; ++r)
+			{
+				T const* p_row = src + static_cast<size_t>(row_begin + r) * src_stride;
+				for (u32 x = 0; x < src_w; ++x)
+				{
+					sums[x / factor] += p_row[x];
+				}
+			}
+
+			T* p_dst = dst + static_cast<size_t>(y) * dst_stride;
+			for (u32 x = 0; x < dst_w; ++x)
+			{
+				u32 const count = rows * (x + 1 < dst_w ? factor : last_cols);
+				p_dst[x] = static_cast<T>((sums[x] + count / 2) / count);
+			}
+		}
+	}
+
+	inline void halve8(u8 const* src, u32 src_stride, u32 src_w, u32 src_h, u8* dst, u32 dst_stride)
+	{
+		u32 const dst_w = getScaledSize(src_w, 2);
+		u32 const dst_h = getScaledSize(src_h, 2);
+		for (u32 y = 0; y < dst_h; ++y)
+		{
+			//the last row of an odd height is its own pair.
+			u8 const* r0 = src + static_cast<size_t>(y * 2) * src_stride;
+			u8 const* r1 = (y * 2 + 1 < src_h) ? r0 + src_stride : r0;
+			u8* p_dst = dst + static_cast<size_t>(y) * dst_stride;
+			u32 x = 0;
+
+#if defined(USE_OFXWEBMPLAYER_SSE2)
+			//16 outputs from 32 x 2 inputs, the pairs are added in 16 bits.
+			__m128i const v_low = _mm_set1_epi16(0x00FF);
+			__m128i const v_round = _mm_set1_epi16(2);
+			for (; (x + 16) * 2 <= src_w; x += 16)
+			{
+				__m128i const a0 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(r0 + x * 2));
+				__m128i const a1 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(r0 + x * 2 + 16));
+				__m128i const b0 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(r1 + x * 2));
+				__m128i const b1 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(r1 + x * 2 + 16));
+
+				__m128i s0 = _mm_add_epi16(_mm_and_si128(a0, v_low), _mm_srli_epi16(a0, 8));
+				s0 = _mm_add_epi16(s0, _mm_add_epi16(_mm_and_si128(b0, v_low), _mm_srli_epi16(b0, 8)));
+				__m128i s1 = _mm_add_epi16(_mm_and_si128(a1, v_low), _mm_srli_epi16(a1, 8));
+				s1 = _mm_add_epi16(s1, _mm_add_epi16(_mm_and_si128(b1, v_low), _mm_srli_epi16(b1, 8)));
+
+				s0 = _mm_srli_epi16(_mm_add_epi16(s0, v_round), 2);
+				s1 = _mm_srli_epi16(_mm_add_epi16(s1, v_round), 2);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(p_dst + x), _mm_packus_epi16(s0, s1));
+			}
+
+#endif
+			for (; x < dst_w; ++x)
+			{
+				u32 const c0 = x * 2;
+				u32 const c1 = (c0 + 1 < src_w) ? c0 + 1 : c0;
+				p_dst[x] = static_cast<u8>((r0[c0] + r0[c1] + r1[c0] + r1[c1] + 2) >> 2);
+			}
+		}
+	}
+
+	inline void boxDown8(u8 const* src, u32 src_stride, u32 src_w, u32 src_h, u32 factor, u8* dst, u32 dst_stride, std::vector<u32>* p_sums)
+	{
+		if (factor == 2)
+		{
+			halve8(src, src_stride, src_w, src_h, dst, dst_stride);
+		}
+		else
+		{
+			boxDownScalar(src, src_stride, src_w, src_h, factor, dst, dst_stride, p_sums);
+		}
+	}
+
+	inline void boxDown16(u16 const* src, u32 src_stride, u32 src_w, u32 src_h, u32 factor, u16* dst, u32 dst_stride, std::vector<u32>* p_sums)
+	{
+		//12 bits samples, a u32 sum holds a block of up to 1M of them.
+		boxDownScalar(src, src_stride, src_w, src_h, factor, dst, dst_stride, p_sums);
+	}
+}
+
+#endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_PLANE_SCALE_H_
@@ -0,0 +1,419 @@
+#ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_RESOURCE_POOL_H_
+#define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_RESOURCE_POOL_H_
+
+#include <ofMain.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "vpx_decoder.h"
+#include "vp8dx.h"
+#include "intern_base.h"
+#include "intern_mem_block.h"
+
+namespace pool
+{
+	typedef struct TextureKey
+	{
+		u32 count;
+		s32 internalformat;
+		u32 width[4];
+		u32 height[4];
+	} TextureKey;
+
+	inline bool operator==(TextureKey const& a, TextureKey const& b)
+	{
+		return memcmp(&a, &b, sizeof(TextureKey)) == 0;
+	}
+
+	//libvpx does not say, this is the reference frames: 4 for VP8, 8 and the one
+	//being decoded for VP9, I420 with the 32 pixels border the decoders keep.
+	inline size_t estimateDecoderBytes(vpx_codec_iface_t* p_iface, u32 width, u32 height)
+	{
+		size_t const frame = static_cast<size_t>(width + 64) * (height + 64) * 3 / 2;
+		return frame * (p_iface == vpx_codec_vp9_dx() ? 9 : 4);
+	}
+
+	//the fbo is RGB, padded to 4 bytes a pixel by most drivers.
+	inline size_t estimateFboBytes(u32 width, u32 height)
+	{
+		return static_cast<size_t>(width) * height * 4;
+	}
+
+	//What mf_unload() would destroy and the next load() create again: decoders by
+	//codec and size, plane textures by layout, fbos by size, linked shaders by
+	//their fragment source, and the movie buffers. Every player shares the one
+	//pool, a closed player leaves its resources to the next load() of any player.
+	//
+	//The GL resources are taken and given back on the GL thread. The decoders and
+	//the movie buffers may be taken by the thread of loadAsync(), every call locks.
+	class ResourcePool
+	{
+	public:
+		enum
+		{
+			MaxIdleDecoders = 4,
+			MaxIdleTextures = 8,
+			MaxIdleFbos = 4,
+			MaxIdleShaders = 8,
+			MaxIdleMemBlocks = 4,
+		};
+
+		//never destroyed, a movie buffer may come back after the statics are gone.
+		static ResourcePool& instance()
+		{
+			static ResourcePool* s_p_pool = new ResourcePool;
+			return *s_p_pool;
+		}
+
+		//a disabled pool keeps nothing, what comes back is destroyed.
+		void setEnabled(bool yes)
+		{
+			{
+				std::lock_guard<std::mutex> locker(m_mtx);
+				m_is_enabled = yes;
+			}
+
+			if (!yes)
+			{
+				clear();
+			}
+		}
+
+		//up to max_bytes of idle movie buffers, the biggest part of the pool by far.
+		void setMemBlockLimit(size_t max_bytes)
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			m_mem_block_limit = max_bytes;
+			mf_trim_mem_blocks();
+		}
+
+		//on the GL thread, before the context goes away.
+		void clear()
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			for (Decoder& decoder : m_decoders)
+			{
+				vpx_codec_destroy(&decoder.ctx);
+			}
+
+			for (Textures& textures : m_textures)
+			{
+				glDeleteTextures(4, textures.names);
+			}
+
+			m_decoders.clear();
+			m_textures.clear();
+			m_fbos.clear();
+			m_shaders.clear();
+			m_mem_blocks.clear();
+		}
+
+		//what the idle resources hold, the GL ones estimated.
+		size_t getIdleBytes()
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			size_t total = 0;
+			for (std::unique_ptr<MemBlock> const& up_mb : m_mem_blocks)
+			{
+				total += up_mb->get_capacity();
+			}
+
+			for (Decoder const& decoder : m_decoders)
+			{
+				total += estimateDecoderBytes(decoder.p_iface, decoder.width, decoder.height);
+			}
+
+			for (std::shared_ptr<ofFbo> const& sp_fbo : m_fbos)
+			{
+				total += estimateFboBytes(static_cast<u32>(sp_fbo->getWidth()), static_cast<u32>(sp_fbo->getHeight()));
+			}
+
+			return total;
+		}
+
+		//On the GL thread. Frees idle resources until about bytes are freed, the
+		//movie buffers first, they are the biggest. Returns what was freed.
+		size_t trim(size_t bytes)
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			size_t freed = 0;
+			while (freed < bytes && !m_mem_blocks.empty())
+			{
+				freed += m_mem_blocks.front()->get_capacity();
+				m_mem_blocks.erase(m_mem_blocks.begin());
+			}
+
+			while (freed < bytes && !m_decoders.empty())
+			{
+				Decoder& decoder = m_decoders.front();
+				freed += estimateDecoderBytes(decoder.p_iface, decoder.width, decoder.height);
+				vpx_codec_destroy(&decoder.ctx);
+				m_decoders.erase(m_decoders.begin());
+			}
+
+			while (freed < bytes && !m_fbos.empty())
+			{
+				ofFbo const& fbo = *m_fbos.front();
+				freed += estimateFboBytes(static_cast<u32>(fbo.getWidth()), static_cast<u32>(fbo.getHeight()));
+				m_fbos.erase(m_fbos.begin());
+			}
+
+			return freed;
+		}
+
+		//false if there is none, the caller initializes its own.
+		bool acquireDecoder(vpx_codec_iface_t* p_iface, u32 width, u32 height, vpx_codec_ctx_t* p_out)
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			for (size_t i = 0; i < m_decoders.size(); ++i)
+			{
+				Decoder const& decoder = m_decoders[i];
+				if (decoder.p_iface == p_iface && decoder.width == width && decoder.height == height)
+				{
+					*p_out = decoder.ctx;
+					m_decoders.erase(m_decoders.begin() + i);
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		//the next stream starts with a key frame, which resets what the decoder still refers to.
+		void releaseDecoder(vpx_codec_iface_t* p_iface, u32 width, u32 height, vpx_codec_ctx_t* p_ctx)
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			if (!m_is_enabled)
+			{
+				vpx_codec_destroy(p_ctx);
+				return;
+			}
+
+			if (m_decoders.size() >= MaxIdleDecoders)
+			{
+				vpx_codec_destroy(&m_decoders.front().ctx);
+				m_decoders.erase(m_decoders.begin());
+			}
+
+			Decoder decoder;
+			decoder.p_iface = p_iface;
+			decoder.width = width;
+			decoder.height = height;
+			decoder.ctx = *p_ctx;
+			m_decoders.push_back(decoder);
+		}
+
+		//4 names, their storage already has the size of the key.
+		bool acquireTextures(TextureKey const& key, GLuint* p_names)
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			for (size_t i = 0; i < m_textures.size(); ++i)
+			{
+				if (m_textures[i].key == key)
+				{
+					memcpy(p_names, m_textures[i].names, sizeof(m_textures[i].names));
+					m_textures.erase(m_textures.begin() + i);
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		void releaseTextures(TextureKey const& key, GLuint const* p_names)
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			if (!m_is_enabled)
+			{
+				glDeleteTextures(4, p_names);
+				return;
+			}
+
+			if (m_textures.size() >= MaxIdleTextures)
+			{
+				glDeleteTextures(4, m_textures.front().names);
+				m_textures.erase(m_textures.begin());
+			}
+
+			Textures textures;
+			textures.key = key;
+			memcpy(textures.names, p_names, sizeof(textures.names));
+			m_textures.push_back(textures);
+		}
+
+		//allocated with the size, nullptr if there is none.
+		std::shared_ptr<ofFbo> acquireFbo(u32 width, u32 height)
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			for (size_t i = 0; i < m_fbos.size(); ++i)
+			{
+				std::shared_ptr<ofFbo> sp_fbo = m_fbos[i];
+				if (static_cast<u32>(sp_fbo->getWidth()) == width && static_cast<u32>(sp_fbo->getHeight()) == height)
+				{
+					m_fbos.erase(m_fbos.begin() + i);
+					return sp_fbo;
+				}
+			}
+
+			return nullptr;
+		}
+
+		void releaseFbo(std::shared_ptr<ofFbo> const& sp_fbo)
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			if (!m_is_enabled || !sp_fbo->isAllocated())
+			{
+				return;
+			}
+
+			if (m_fbos.size() >= MaxIdleFbos)
+			{
+				m_fbos.erase(m_fbos.begin());
+			}
+
+			m_fbos.push_back(sp_fbo);
+		}
+
+		//linked, nullptr if there is none.
+		std::shared_ptr<ofShader> acquireShader(char const* src_frag_shader)
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			for (size_t i = 0; i < m_shaders.size(); ++i)
+			{
+				if (m_shaders[i].src_frag_shader == src_frag_shader)
+				{
+					std::shared_ptr<ofShader> sp_shader = m_shaders[i].sp_shader;
+					m_shaders.erase(m_shaders.begin() + i);
+					return sp_shader;
+				}
+			}
+
+			return nullptr;
+		}
+
+		void releaseShader(char const* src_frag_shader, std::shared_ptr<ofShader> const& sp_shader)
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			if (!m_is_enabled || !sp_shader->isLoaded())
+			{
+				return;
+			}
+
+			if (m_shaders.size() >= MaxIdleShaders)
+			{
+				m_shaders.erase(m_shaders.begin());
+			}
+
+			Shader shader;
+			shader.src_frag_shader = src_frag_shader;
+			shader.sp_shader = sp_shader;
+			m_shaders.push_back(shader);
+		}
+
+		//Always a block, the idle one which fits best if there is one. It comes back
+		//to the pool when the last reference is gone, on whatever thread that is.
+		std::shared_ptr<MemBlock> acquireMemBlock(size_t size)
+		{
+			MemBlock* p_mb = NULL;
+			{
+				std::lock_guard<std::mutex> locker(m_mtx);
+				size_t best = m_mem_blocks.size();
+				for (size_t i = 0; i < m_mem_blocks.size(); ++i)
+				{
+					//not more than twice as big, the rest would sit unused.
+					size_t capacity = m_mem_blocks[i]->get_capacity();
+					if (capacity >= size && capacity / 2 <= size &&
+						(best == m_mem_blocks.size() || capacity < m_mem_blocks[best]->get_capacity()))
+					{
+						best = i;
+					}
+				}
+
+				if (best < m_mem_blocks.size())
+				{
+					p_mb = m_mem_blocks[best].release();
+					m_mem_blocks.erase(m_mem_blocks.begin() + best);
+				}
+			}
+
+			if (!p_mb)
+			{
+				p_mb = new MemBlock;
+			}
+
+			return std::shared_ptr<MemBlock>(p_mb, [](MemBlock* p)
+			{
+				ResourcePool::instance().mf_release_mem_block(p);
+			});
+		}
+
+	private:
+		typedef struct Decoder
+		{
+			vpx_codec_iface_t*	p_iface;
+			u32					width;
+			u32					height;
+			vpx_codec_ctx_t		ctx;
+		} Decoder;
+
+		typedef struct Textures
+		{
+			TextureKey	key;
+			GLuint		names[4];
+		} Textures;
+
+		typedef struct Shader
+		{
+			char const*					src_frag_shader;
+			std::shared_ptr<ofShader>	sp_shader;
+		} Shader;
+
+		std::mutex									m_mtx;
+		bool										m_is_enabled;
+		size_t										m_mem_block_limit;
+		std::vector<Decoder>						m_decoders;
+		std::vector<Textures>						m_textures;
+		std::vector<std::shared_ptr<ofFbo>>			m_fbos;
+		std::vector<Shader>							m_shaders;
+		std::vector<std::unique_ptr<MemBlock>>		m_mem_blocks;
+
+		ResourcePool()
+		: m_is_enabled(true)
+		, m_mem_block_limit(256 * 1024 * 1024)
+		{}
+
+		void mf_release_mem_block(MemBlock* p_mb)
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			if (!m_is_enabled || !p_mb->get_capacity() || p_mb->get_capacity() > m_mem_block_limit)
+			{
+				delete p_mb;
+				return;
+			}
+
+			m_mem_blocks.push_back(std::unique_ptr<MemBlock>(p_mb));
+			mf_trim_mem_blocks();
+		}
+
+		//the oldest go first.
+		void mf_trim_mem_blocks()
+		{
+			size_t total = 0;
+			for (std::unique_ptr<MemBlock> const& up_mb : m_mem_blocks)
+			{
+				total += up_mb->get_capacity();
+			}
+
+			while (!m_mem_blocks.empty() && (m_mem_blocks.size() > MaxIdleMemBlocks || total > m_mem_block_limit))
+			{
+				total -= m_mem_blocks.front()->get_capacity();
+				m_mem_blocks.erase(m_mem_blocks.begin());
+			}
+		}
+
+		ResourcePool(ResourcePool const&);
+		ResourcePool& operator=(ResourcePool const&);
+	};
+}
+
+#endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_RESOURCE_POOL_H_
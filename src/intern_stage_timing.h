@@ -0,0 +1,149 @@
+#ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_STAGE_TIMING_H_
+#define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_STAGE_TIMING_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include "intern_base.h"
+
+//Nanosecond timings of the stages of the playback into log-linear histograms,
+//the way HdrHistogram buckets: 16 linear buckets for every power of two, so a
+//percentile is within 1/32 of the real value at any scale. Recording is one
+//atomic increment, the audio callback records from its own thread.
+namespace timing
+{
+	inline u64 now()
+	{
+		return static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	class Histogram
+	{
+	public:
+		enum
+		{
+			SubBits = 4,
+			SubCount = 1 << SubBits,
+			BucketCount = (64 - SubBits + 1) * SubCount,
+		};
+
+		Histogram()
+		{
+			reset();
+		}
+
+		void reset()
+		{
+			for (u32 i = 0; i < BucketCount; ++i)
+			{
+				m_buckets[i] = 0;
+			}
+
+			m_count = 0;
+			m_total = 0;
+			m_max = 0;
+		}
+
+		void add(u64 ns)
+		{
+			++m_buckets[getBucket(ns)];
+			++m_count;
+			m_total += ns;
+
+			u64 max = m_max;
+			while (ns > max && !m_max.compare_exchange_weak(max, ns))
+			{
+			}
+		}
+
+		u64 getCount() const { return m_count; }
+		u64 getTotal() const { return m_total; }
+		u64 getMax() const { return m_max; }
+
+		//p in [0, 1], the middle of the bucket the p-th value is in.
+		u64 getPercentile(f64 p) const
+		{
+			u64 const count = m_count;
+			if (!count)
+			{
+				return 0;
+			}
+
+			u64 const rank = std::max<u64>(1, static_cast<u64>(p * count + 0.5));
+			u64 seen = 0;
+			for (u32 i = 0; i < BucketCount; ++i)
+			{
+				seen += m_buckets[i];
+				if (seen >= rank)
+				{
+					return std::min<u64>(getBucketMiddle(i), m_max);
+				}
+			}
+
+			return m_max;
+		}
+
+	private:
+		std::atomic<u32>	m_buckets[BucketCount];
+		std::atomic<u64>	m_count;
+		std::atomic<u64>	m_total;
+		std::atomic<u64>	m_max;
+
+		static u32 getBucket(u64 ns)
+		{
+			if (ns < SubCount)
+			{
+				return static_cast<u32>(ns);
+			}
+
+			u32 msb = SubBits;
+			while (msb < 63 && (ns >> (msb + 1)))
+			{
+				++msb;
+			}
+
+			u32 const sub = static_cast<u32>(ns >> (msb - SubBits)) & (SubCount - 1);
+			return (msb - SubBits + 1) * SubCount + sub;
+		}
+
+		static u64 getBucketMiddle(u32 bucket)
+		{
+			if (bucket < SubCount)
+			{
+				return bucket;
+			}
+
+			u32 const shift = bucket / SubCount - 1;
+			u64 const low = static_cast<u64>(SubCount + bucket % SubCount) << shift;
+			return low + ((1ull << shift) >> 1);
+		}
+	};
+
+	//times the scope into a histogram, nothing when it is null.
+	class Scope
+	{
+	public:
+		explicit Scope(Histogram* p_histogram)
+		: m_p_histogram(p_histogram)
+		, m_begin(p_histogram ? now() : 0)
+		{}
+
+		~Scope()
+		{
+			if (m_p_histogram)
+			{
+				m_p_histogram->add(now() - m_begin);
+			}
+		}
+
+	private:
+		Histogram*	m_p_histogram;
+		u64			m_begin;
+
+		Scope(Scope const&);
+		Scope& operator=(Scope const&);
+	};
+}
+
+#endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_STAGE_TIMING_H_
@@ -0,0 +1,90 @@
+#ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_STATS_H_
+#define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_STATS_H_
+
+#include <atomic>
+#include "intern_base.h"
+
+//The counters of getStats(). Every count goes to the player and to the process
+//wide counters, two relaxed atomic adds, so the audio thread counts too and a
+//poll is only loads.
+namespace stats
+{
+	enum Counter
+	{
+		CounterBytesRead,
+		CounterFramesDecoded,
+		CounterFramesPresented,
+		CounterFramesDropped,
+		CounterTextureBytes,
+		CounterAudioCallbacks,
+		CounterAudioFrames,
+		CounterSeeks,
+		CounterLoads,
+		CounterCatchUpMax,		//a maximum, not a sum
+		CounterCount,
+	};
+
+	class Counters
+	{
+	public:
+		Counters()
+		{
+			reset();
+		}
+
+		void reset()
+		{
+			for (u32 i = 0; i < CounterCount; ++i)
+			{
+				m_values[i].store(0, std::memory_order_relaxed);
+			}
+		}
+
+		void add(Counter counter, u64 n)
+		{
+			m_values[counter].fetch_add(n, std::memory_order_relaxed);
+		}
+
+		void max(Counter counter, u64 n)
+		{
+			u64 cur = m_values[counter].load(std::memory_order_relaxed);
+			while (n > cur && !m_values[counter].compare_exchange_weak(cur, n, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		u64 get(Counter counter) const
+		{
+			return m_values[counter].load(std::memory_order_relaxed);
+		}
+
+	private:
+		std::atomic<u64>	m_values[CounterCount];
+	};
+
+	typedef struct Global
+	{
+		Counters			counters;
+		std::atomic<u32>	players;
+	} Global;
+
+	inline Global& global()
+	{
+		static Global s_global;
+		return s_global;
+	}
+
+	inline void add(Counters* p_player, Counter counter, u64 n)
+	{
+		p_player->add(counter, n);
+		global().counters.add(counter, n);
+	}
+
+	inline void max(Counters* p_player, Counter counter, u64 n)
+	{
+		p_player->max(counter, n);
+		global().counters.max(counter, n);
+	}
+}
+
+#endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_STATS_H_
@@ -0,0 +1,284 @@
+#ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_TRACE_H_
+#define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_TRACE_H_
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "intern_base.h"
+#include "intern_stage_timing.h"
+
+//Timestamped events of every player on every thread, for the hitches which are
+//gone by the time anyone looks. Every thread writes into a ring of its own, no
+//lock and no allocation once the ring is there; the oldest events are
+//overwritten. The ring of a thread which exits goes to the next new thread, so
+//the loader threads of a long show don't add up to a ring each. dump() writes
+//the rings as Chrome trace JSON, which chrome://tracing and ui.perfetto.dev open.
+namespace trace
+{
+	typedef struct Event
+	{
+		char const*	name;		//a string literal, only the pointer is kept
+		u64			begin_ns;
+		u64			dur_ns;		//0 is an instant event
+		u32			player_id;
+		s64			arg;		//a frame index, a byte count... -1 is none
+	} Event;
+
+	//one writer, the thread it belongs to, and any reader through copyTo().
+	class Ring
+	{
+	public:
+		Ring(u32 tid, size_t capacity)
+		: m_tid(tid)
+		, m_events(std::max<size_t>(capacity, 1))
+		, m_head(0)
+		{}
+
+		void push(Event const& e)
+		{
+			u64 const head = m_head.load(std::memory_order_relaxed);
+			m_events[head % m_events.size()] = e;
+			m_head.store(head + 1, std::memory_order_release);
+		}
+
+		//the events which were not overwritten while they were copied.
+		void copyTo(std::vector<Event>* p_out) const
+		{
+			u64 const size = m_events.size();
+			u64 const head = m_head.load(std::memory_order_acquire);
+			u64 const begin = head > size ? head - size : 0;
+
+			std::vector<Event> events;
+			events.reserve(static_cast<size_t>(head - begin));
+			for (u64 i = begin; i < head; ++i)
+			{
+				events.push_back(m_events[i % size]);
+			}
+
+			//the writer may be in the middle of the event at head_after, which goes over head_after - size.
+			u64 const head_after = m_head.load(std::memory_order_acquire);
+			u64 const overwritten = head_after + 1 > size ? head_after + 1 - size : 0;
+			size_t const skip = static_cast<size_t>(std::min<u64>(overwritten > begin ? overwritten - begin : 0, events.size()));
+			p_out->insert(p_out->end(), events.begin() + skip, events.end());
+		}
+
+		u32 getTid() const
+		{
+			return m_tid;
+		}
+
+	private:
+		u32					m_tid;
+		std::vector<Event>	m_events;
+		std::atomic<u64>	m_head;
+	};
+
+	class Tracer
+	{
+	public:
+		//never destroyed, the threads keep pointers to their rings.
+		static Tracer& instance()
+		{
+			static Tracer* s_p_tracer = new Tracer;
+			return *s_p_tracer;
+		}
+
+		void setEnabled(bool yes, size_t events_per_thread)
+		{
+			m_events_per_thread = events_per_thread;
+			m_is_enabled = yes;
+		}
+
+		bool isEnabled() const
+		{
+			return m_is_enabled.load(std::memory_order_relaxed);
+		}
+
+		u32 newPlayerId()
+		{
+			return ++m_player_count;
+		}
+
+		void add(char const* name, u64 begin_ns, u64 dur_ns, u32 player_id, s64 arg)
+		{
+			Event e;
+			e.name = name;
+			e.begin_ns = begin_ns;
+			e.dur_ns = dur_ns;
+			e.player_id = player_id;
+			e.arg = arg;
+			mf_get_ring()->push(e);
+		}
+
+		bool dump(char const* path)
+		{
+			std::vector<Ring*> rings;
+			{
+				std::lock_guard<std::mutex> locker(m_mtx);
+				for (std::unique_ptr<Ring> const& up_ring : m_rings)
+				{
+					rings.push_back(up_ring.get());
+				}
+			}
+
+			FILE* fp = fopen(path, "wb");
+			if (!fp)
+			{
+				return false;
+			}
+
+			fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+			bool is_first = true;
+			u64 const clear_ns = m_clear_ns;
+			std::vector<Event> events;
+			for (Ring const* p_ring : rings)
+			{
+				events.clear();
+				p_ring->copyTo(&events);
+				for (Event const& e : events)
+				{
+					if (e.begin_ns < clear_ns)
+					{
+						continue;
+					}
+
+					fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"ofxWebMPlayer\",\"ph\":\"%s\",\"ts\":%.3f,", is_first ? "" : ",\n",
+						e.name, e.dur_ns ? "X" : "i", e.begin_ns * 0.001);
+					if (e.dur_ns)
+					{
+						fprintf(fp, "\"dur\":%.3f,", e.dur_ns * 0.001);
+					}
+					else
+					{
+						fprintf(fp, "\"s\":\"t\",");
+					}
+
+					fprintf(fp, "\"pid\":1,\"tid\":%u,\"args\":{\"player\":%u", p_ring->getTid(), e.player_id);
+					if (e.arg >= 0)
+					{
+						fprintf(fp, ",\"arg\":%lld", static_cast<long long>(e.arg));
+					}
+
+					fprintf(fp, "}}");
+					is_first = false;
+				}
+			}
+
+			fprintf(fp, "\n]}\n");
+			bool yes = !ferror(fp);
+			fclose(fp);
+			return yes;
+		}
+
+		//drops the events so far, the rings stay for their threads.
+		void clear()
+		{
+			//a ring can not be emptied under its writer, the events before now are skipped instead.
+			m_clear_ns = timing::now();
+		}
+
+	private:
+		std::mutex							m_mtx;
+		std::vector<std::unique_ptr<Ring>>	m_rings;
+		std::vector<Ring*>					m_free_rings;	//of the threads which exited
+		std::atomic<bool>					m_is_enabled;
+		std::atomic<size_t>					m_events_per_thread;
+		std::atomic<u32>					m_player_count;
+		std::atomic<u64>					m_clear_ns;
+
+		Tracer()
+		: m_is_enabled(false)
+		, m_events_per_thread(65536)
+		, m_player_count(0)
+		, m_clear_ns(0)
+		{}
+
+		//gives the ring back when its thread exits.
+		typedef struct RingHolder
+		{
+			Ring*	p_ring;
+
+			~RingHolder()
+			{
+				if (p_ring)
+				{
+					Tracer::instance().mf_release_ring(p_ring);
+				}
+			}
+		} RingHolder;
+
+		Ring* mf_get_ring()
+		{
+			static thread_local RingHolder s_holder = { NULL };
+			if (!s_holder.p_ring)
+			{
+				std::lock_guard<std::mutex> locker(m_mtx);
+				if (!m_free_rings.empty())
+				{
+					//the events of the thread before stay, under the same tid, until they are overwritten.
+					s_holder.p_ring = m_free_rings.back();
+					m_free_rings.pop_back();
+				}
+				else
+				{
+					m_rings.push_back(std::unique_ptr<Ring>(new Ring(static_cast<u32>(m_rings.size() + 1), m_events_per_thread)));
+					s_holder.p_ring = m_rings.back().get();
+				}
+			}
+
+			return s_holder.p_ring;
+		}
+
+		void mf_release_ring(Ring* p_ring)
+		{
+			std::lock_guard<std::mutex> locker(m_mtx);
+			m_free_rings.push_back(p_ring);
+		}
+
+		Tracer(Tracer const&);
+		Tracer& operator=(Tracer const&);
+	};
+
+	//a complete event from here to the end of the scope, nothing while the tracing is off.
+	class Scope
+	{
+	public:
+		Scope(char const* name, u32 player_id, s64 arg = -1)
+		: m_name(Tracer::instance().isEnabled() ? name : NULL)
+		, m_player_id(player_id)
+		, m_arg(arg)
+		, m_begin(m_name ? timing::now() : 0)
+		{}
+
+		~Scope()
+		{
+			if (m_name)
+			{
+				Tracer::instance().add(m_name, m_begin, std::max<u64>(timing::now() - m_begin, 1), m_player_id, m_arg);
+			}
+		}
+
+	private:
+		char const*	m_name;
+		u32			m_player_id;
+		s64			m_arg;
+		u64			m_begin;
+
+		Scope(Scope const&);
+		Scope& operator=(Scope const&);
+	};
+
+	inline void instant(char const* name, u32 player_id, s64 arg = -1)
+	{
+		Tracer& tracer = Tracer::instance();
+		if (tracer.isEnabled())
+		{
+			tracer.add(name, timing::now(), 0, player_id, arg);
+		}
+	}
+}
+
+#endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_TRACE_H_
@@ -0,0 +1,429 @@
+#ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_WEBM_DEMUXER_H_
+#define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_WEBM_DEMUXER_H_
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include "webm/callback.h"
+#include "webm/webm_parser.h"
+#include "intern_base.h"
+#include "intern_webm_index.h"
+#include "intern_frame_index.h"
+
+//What load() needs to know about a track, whichever demuxer found it.
+typedef struct TrackDesc
+{
+	u32						number;
+	s32						type;			//matroska track type, same values as mkvparser::Track::Type
+	std::string				codec_id;
+	u32						width;
+	u32						height;
+	f64						frame_rate;
+	u64						default_duration_ns;
+	std::vector<u8>			codec_private;
+	bool					has_alpha;		//AlphaMode, the alpha is in the BlockAdditional's
+	mkvparser::Track const*	p_mkv_track;	//NULL with the webm parser
+} TrackDesc;
+
+//Reads from a buffer whose end can still move (a file which is being written).
+//Past the available end it returns kWouldBlock, so WebmParser::Feed() stops and
+//can be called again when more bytes are there. The positions are of the file,
+//the buffer may start further in (the live mode drops what was played).
+class WebMStreamReader : public webm::Reader
+{
+public:
+	WebMStreamReader()
+	: m_buffer(NULL)
+	, m_base(0)
+	, m_available(0)
+	, m_position(0)
+	, m_is_final(false)
+	{}
+
+	//buffer holds the file from base to available. is_final: no more bytes will
+	//come, reading past the end is the end of the file.
+	void SetBuffer(u8 const* buffer, u64 base, u64 available, bool is_final)
+	{
+		m_buffer = buffer;
+		m_base = base;
+		m_available = available;
+		m_is_final = is_final;
+	}
+
+	webm::Status Read(std::size_t num_to_read, std::uint8_t* buffer, std::uint64_t* num_actually_read) override
+	{
+		u64 n = mf_count(num_to_read);
+		*num_actually_read = n;
+		if (!n)
+		{
+			return mf_no_data();
+		}
+
+		memcpy(buffer, m_buffer + (m_position - m_base), static_cast<size_t>(n));
+		m_position += n;
+		return webm::Status(n == num_to_read ? webm::Status::kOkCompleted : webm::Status::kOkPartial);
+	}
+
+	webm::Status Skip(std::uint64_t num_to_skip, std::uint64_t* num_actually_skipped) override
+	{
+		u64 n = mf_count(num_to_skip);
+		*num_actually_skipped = n;
+		if (!n)
+		{
+			return mf_no_data();
+		}
+
+		m_position += n;
+		return webm::Status(n == num_to_skip ? webm::Status::kOkCompleted : webm::Status::kOkPartial);
+	}
+
+	std::uint64_t Position() const override
+	{
+		return m_position;
+	}
+
+private:
+	u8 const*	m_buffer;
+	u64			m_base;
+	u64			m_available;
+	u64			m_position;
+	bool		m_is_final;
+
+	u64 mf_count(u64 wanted) const
+	{
+		u64 remain = m_available > m_position ? m_available - m_position : 0;
+		return wanted < remain ? wanted : remain;
+	}
+
+	webm::Status mf_no_data() const
+	{
+		return webm::Status(m_is_final ? webm::Status::kEndOfFile : webm::Status::kWouldBlock);
+	}
+};
+
+//Demuxer on the callback parser of libwebm. Nothing of the document is kept:
+//the parser hands over the headers and the position of every frame, which go
+//straight into the frame index of the player (and the audio packet map). The
+//frame bytes themselves are only skipped, they are decoded from where they are.
+//
+//feed() stops as soon as the table holds the frame asked for, so a caller can
+//index a little at a time, and it can be called again when the data grows. It
+//is fed from the movie block, see WebMReader::Setup().
+class WebMDemuxer : public webm::Callback
+{
+public:
+	enum Result
+	{
+		RESULT_PAUSED,		//has the frame asked for
+		RESULT_WAIT_DATA,	//ran out of bytes, more may come
+		RESULT_DONE,		//end of the segment or of the file
+		RESULT_ERROR,
+	};
+
+	WebMDemuxer()
+	: m_p_frames(NULL)
+	, m_p_audio(NULL)
+	, m_frame_target(0)
+	, m_timecode_scale(1000000)
+	, m_duration_ns(-1)
+	, m_cluster_timecode(0)
+	, m_block_track(0)
+	, m_block_time_ns(0)
+	, m_is_block_key(false)
+	, m_is_in_group(false)
+	, m_video_track(0)
+	, m_audio_track(0)
+	, m_first_video_ns(-1)
+	, m_last_video_ns(-1)
+	, m_is_tracks_done(false)
+	, m_is_done(false)
+	{}
+
+	//p_audio may be NULL if the audio is not needed.
+	void setup(FrameIndex* p_frames, std::vector<sidecar::AudioPacket>* p_audio)
+	{
+		m_p_frames = p_frames;
+		m_p_audio = p_audio;
+	}
+
+	//parses until the frame index has frame_idx. 0 stops at the first frame, after the tracks.
+	Result feed(webm::Reader* p_reader, size_t frame_idx)
+	{
+		if (m_is_done)
+		{
+			return RESULT_DONE;
+		}
+
+		m_frame_target = frame_idx;
+		webm::Status status = m_parser.Feed(this, p_reader);
+
+		switch (status.code)
+		{
+		case webm::Status::kOkCompleted:
+		case webm::Status::kEndOfFile:		//a cut file, keep what is there
+			m_is_done = true;
+			m_is_tracks_done = true;
+			return RESULT_DONE;
+
+		case StatusPaused:
+			return RESULT_PAUSED;
+
+		case webm::Status::kWouldBlock:
+			return RESULT_WAIT_DATA;
+
+		default:
+			return RESULT_ERROR;
+		}
+	}
+
+	bool isTracksDone() const
+	{
+		return m_is_tracks_done;
+	}
+
+	bool isDone() const
+	{
+		return m_is_done;
+	}
+
+	std::vector<TrackDesc> const& getTracks() const
+	{
+		return m_tracks;
+	}
+
+	//-1 if the segment does not say.
+	s64 getDurationNs() const
+	{
+		return m_duration_ns;
+	}
+
+	//from the times of the blocks indexed so far, for files without a frame rate
+	//or a default duration (live captures mostly). 0 until there are two blocks.
+	f64 getVideoFrameRate() const
+	{
+		if (m_last_video_ns <= m_first_video_ns || m_p_frames->size() < 2)
+		{
+			return 0.0;
+		}
+
+		return (m_p_frames->size() - 1) * 1000000000.0 / (m_last_video_ns - m_first_video_ns);
+	}
+
+	//webm::Callback ---------------------------------------
+	webm::Status OnElementBegin(webm::ElementMetadata const& metadata, webm::Action* action) override
+	{
+		//nothing in them is needed for the playback.
+		bool is_skip = metadata.id == webm::Id::kCues || metadata.id == webm::Id::kTags || metadata.id == webm::Id::kChapters;
+		*action = is_skip ? webm::Action::kSkip : webm::Action::kRead;
+		return webm::Status(webm::Status::kOkCompleted);
+	}
+
+	webm::Status OnInfo(webm::ElementMetadata const& metadata, webm::Info const& info) override
+	{
+		m_timecode_scale = info.timecode_scale.value();
+		if (info.duration.is_present())
+		{
+			m_duration_ns = static_cast<s64>(info.duration.value() * m_timecode_scale);
+		}
+
+		return webm::Status(webm::Status::kOkCompleted);
+	}
+
+	webm::Status OnTrackEntry(webm::ElementMetadata const& metadata, webm::TrackEntry const& entry) override
+	{
+		TrackDesc desc;
+		desc.number = static_cast<u32>(entry.track_number.value());
+		desc.type = static_cast<s32>(entry.track_type.value());
+		desc.codec_id = entry.codec_id.value();
+		desc.width = 0;
+		desc.height = 0;
+		desc.frame_rate = 0.0;
+		desc.default_duration_ns = entry.default_duration.value();
+		desc.codec_private = entry.codec_private.value();
+		desc.has_alpha = false;
+		desc.p_mkv_track = NULL;
+
+		if (entry.video.is_present())
+		{
+			desc.width = static_cast<u32>(entry.video.value().pixel_width.value());
+			desc.height = static_cast<u32>(entry.video.value().pixel_height.value());
+			desc.frame_rate = entry.video.value().frame_rate.value();
+			desc.has_alpha = entry.video.value().alpha_mode.value() != 0;
+		}
+
+		if (entry.track_type.value() == webm::TrackType::kVideo && !m_video_track)
+		{
+			m_video_track = desc.number;
+		}
+		else if (entry.track_type.value() == webm::TrackType::kAudio && !m_audio_track)
+		{
+			m_audio_track = desc.number;
+		}
+
+		m_tracks.push_back(desc);
+		return webm::Status(webm::Status::kOkCompleted);
+	}
+
+	webm::Status OnClusterBegin(webm::ElementMetadata const& metadata, webm::Cluster const& cluster, webm::Action* action) override
+	{
+		//the tracks are always before the first cluster.
+		m_is_tracks_done = true;
+		m_cluster_timecode = cluster.timecode.value();
+		*action = webm::Action::kRead;
+		return webm::Status(webm::Status::kOkCompleted);
+	}
+
+	webm::Status OnSimpleBlockBegin(webm::ElementMetadata const& metadata, webm::SimpleBlock const& simple_block, webm::Action* action) override
+	{
+		if (mf_is_pause())
+		{
+			return webm::Status(StatusPaused);
+		}
+
+		mf_begin_block(simple_block);
+		m_is_block_key = simple_block.is_key_frame;
+		m_is_in_group = false;
+
+		*action = webm::Action::kRead;
+		return webm::Status(webm::Status::kOkCompleted);
+	}
+
+	webm::Status OnBlockGroupBegin(webm::ElementMetadata const& metadata, webm::Action* action) override
+	{
+		if (mf_is_pause())
+		{
+			return webm::Status(StatusPaused);
+		}
+
+		m_is_in_group = true;
+		m_group_frames.clear();
+		*action = webm::Action::kRead;
+		return webm::Status(webm::Status::kOkCompleted);
+	}
+
+	webm::Status OnBlockBegin(webm::ElementMetadata const& metadata, webm::Block const& block, webm::Action* action) override
+	{
+		mf_begin_block(block);
+		*action = webm::Action::kRead;
+		return webm::Status(webm::Status::kOkCompleted);
+	}
+
+	webm::Status OnBlockGroupEnd(webm::ElementMetadata const& metadata, webm::BlockGroup const& block_group) override
+	{
+		//a block in a group is a key frame when it refers to nothing, that is only
+		//known here, after its frames. They wait until then.
+		bool const is_key = block_group.references.empty();
+		for (size_t i = 0; i < m_group_frames.size(); ++i)
+		{
+			FrameSpan const& span = m_group_frames[i];
+			mf_push_video(span.pos, span.len, is_key && i == 0);
+		}
+
+		m_group_frames.clear();
+		m_is_in_group = false;
+
+		return webm::Status(webm::Status::kOkCompleted);
+	}
+
+	webm::Status OnFrame(webm::FrameMetadata const& metadata, webm::Reader* reader, std::uint64_t* bytes_remaining) override
+	{
+		webm::Status status;
+		do
+		{
+			std::uint64_t skipped;
+			status = reader->Skip(*bytes_remaining, &skipped);
+			*bytes_remaining -= skipped;
+		} while (status.code == webm::Status::kOkPartial);
+
+		if (!status.completed_ok())
+		{
+			return status;
+		}
+
+		//only a frame which is all there goes into the table.
+		if (m_block_track == m_video_track && m_is_in_group)
+		{
+			FrameSpan span;
+			span.pos = metadata.position;
+			span.len = static_cast<u32>(metadata.size);
+			m_group_frames.push_back(span);
+		}
+		else if (m_block_track == m_video_track)
+		{
+			//every frame of a laced key block decodes from the first one.
+			bool const is_key = m_is_block_key;
+			m_is_block_key = false;
+			mf_push_video(metadata.position, static_cast<u32>(metadata.size), is_key);
+		}
+		else if (m_block_track == m_audio_track && m_p_audio)
+		{
+			sidecar::AudioPacket packet;
+			packet.pos = metadata.position;
+			packet.reserved = 0;
+			packet.len = static_cast<u32>(metadata.size);
+			packet.time_ns = m_block_time_ns;
+			m_p_audio->push_back(packet);
+		}
+
+		return status;
+	}
+
+	webm::Status OnSegmentEnd(webm::ElementMetadata const& metadata) override
+	{
+		m_is_done = true;
+		return webm::Status(webm::Status::kOkCompleted);
+	}
+
+private:
+	enum { StatusPaused = 1 };
+
+	typedef struct FrameSpan
+	{
+		u64 pos;
+		u32 len;
+	} FrameSpan;
+
+	webm::WebmParser					m_parser;
+	std::vector<TrackDesc>				m_tracks;
+	FrameIndex*							m_p_frames;
+	std::vector<FrameSpan>				m_group_frames;
+	std::vector<sidecar::AudioPacket>*	m_p_audio;
+	size_t								m_frame_target;
+	u64									m_timecode_scale;
+	s64									m_duration_ns;
+	u64									m_cluster_timecode;
+	u64									m_block_track;
+	s64									m_block_time_ns;
+	bool								m_is_block_key;
+	bool								m_is_in_group;
+	u32									m_video_track;
+	u32									m_audio_track;
+	s64									m_first_video_ns;
+	s64									m_last_video_ns;
+	bool								m_is_tracks_done;
+	bool								m_is_done;
+
+	bool mf_is_pause() const
+	{
+		return m_is_tracks_done && m_p_frames->size() > m_frame_target;
+	}
+
+	void mf_begin_block(webm::Block const& block)
+	{
+		m_block_track = block.track_number;
+		m_block_time_ns = (static_cast<s64>(m_cluster_timecode) + block.timecode) * static_cast<s64>(m_timecode_scale);
+	}
+
+	void mf_push_video(u64 pos, u32 len, bool is_key)
+	{
+		m_p_frames->push(pos, len, m_block_time_ns, is_key);
+		if (m_first_video_ns < 0)
+		{
+			m_first_video_ns = m_block_time_ns;
+		}
+
+		m_last_video_ns = m_block_time_ns;
+	}
+};
+
+#endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_WEBM_DEMUXER_H_
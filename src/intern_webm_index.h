@@ -0,0 +1,453 @@
+#ifndef INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_WEBM_INDEX_H_
+#define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_WEBM_INDEX_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include "mkvparser/mkvparser.h"
+#include "intern_base.h"
+#include "intern_mapped_file.h"
+
+typedef struct VpxFrameInfo
+{
+	u64 pos;
+	u32 len;
+	s32 idx_key;
+} VpxFrameInfo;
+
+//The sidecar index, "<movie>.webmidx", keeps what load() would otherwise find by
+//walking every block of the movie. It is written in the byte order of the machine
+//that built it, and is only used when the size, mtime and hash of the movie still
+//match the ones in the header.
+//
+//layout:
+//	Header
+//	VpxFrameInfo	frames[frame_count]			video frames in decode order
+//	s64				frame_times[frame_count]	ns, the time of the block of each frame
+//	u32				keys[key_count]				index of every key frame
+//	AudioPacket		audio[audio_packet_count]	every frame of every audio block
+//
+//every array starts on an 8 bytes boundary, its offset is in the header. The
+//positions are 64 bits from Version 2 on, an index of another version is not
+//used and load() walks the movie, webm_index writes it again.
+namespace sidecar
+{
+	enum
+	{
+		Version = 2,
+		HashSpan = 64 * 1024,
+	};
+
+	char const Magic[8] = { 'W', 'E', 'B', 'M', 'I', 'D', 'X', 0 };
+
+	typedef struct AudioPacket
+	{
+		u64 pos;
+		u32 len;
+		u32 reserved;
+		s64 time_ns;
+	} AudioPacket;
+
+	typedef struct FileId
+	{
+		u64 size;
+		u64 mtime;
+		u64 hash;
+	} FileId;
+
+	typedef struct Header
+	{
+		char	magic[8];
+		u32		version;
+		u32		header_size;
+		FileId	file_id;
+		u32		video_track;	//track number, 0 if none
+		u32		audio_track;	//track number, 0 if none
+		u32		frame_count;
+		u32		key_count;
+		u32		audio_packet_count;
+		u32		reserved;
+		u64		frame_offset;
+		u64		frame_time_offset;
+		u64		key_offset;
+		u64		audio_offset;
+	} Header;
+
+	inline std::string getPath(std::string const& movie_path)
+	{
+		return movie_path + ".webmidx";
+	}
+
+	//FNV-1a over the size and the first and last HashSpan bytes. Hashing a whole
+	//movie of several GB would cost more than the walk the index saves, the size
+	//and mtime catch the rest.
+	inline u64 hashSpans(u64 size, u8 const* head, size_t head_len, u8 const* tail, size_t tail_len)
+	{
+		u64 h = 14695981039346656037ull;
+		for (u32 i = 0; i < 8; ++i)
+		{
+			h = (h ^ ((size >> (i * 8)) & 0xff)) * 1099511628211ull;
+		}
+
+		for (size_t i = 0; i < head_len; ++i)
+		{
+			h = (h ^ head[i]) * 1099511628211ull;
+		}
+
+		for (size_t i = 0; i < tail_len; ++i)
+		{
+			h = (h ^ tail[i]) * 1099511628211ull;
+		}
+
+		return h;
+	}
+
+	inline u64 hashMemory(u8 const* p, u64 size)
+	{
+		size_t span = static_cast<size_t>(size < static_cast<u64>(HashSpan) ? size : static_cast<u64>(HashSpan));
+		return hashSpans(size, p, span, p + size - span, span);
+	}
+
+	inline u64 hashFile(FILE* fp, u64 size)
+	{
+		size_t span = static_cast<size_t>(size < static_cast<u64>(HashSpan) ? size : static_cast<u64>(HashSpan));
+		std::vector<u8> head(span), tail(span);
+
+		if (fseek(fp, 0, SEEK_SET) != 0 || fread(head.data(), 1, span, fp) != span)
+		{
+			return 0;
+		}
+
+		//fseek takes a long, which is 32 bits on windows.
+#if defined(_WIN32)
+		if (_fseeki64(fp, static_cast<s64>(size - span), SEEK_SET) != 0)
+#else
+		if (fseeko(fp, static_cast<off_t>(size - span), SEEK_SET) != 0)
+#endif
+		{
+			return 0;
+		}
+
+		if (fread(tail.data(), 1, span, fp) != span)
+		{
+			return 0;
+		}
+
+		return hashSpans(size, head.data(), span, tail.data(), span);
+	}
+
+	inline u64 alignUp(u64 v)
+	{
+		return (v + 7) & ~static_cast<u64>(7);
+	}
+
+	//p_segment must be fully loaded. Uses the first video and the first audio track.
+	inline bool build(mkvparser::Segment const* p_segment, FileId const& file_id, std::vector<u8>* p_out)
+	{
+		mkvparser::Tracks const* p_tracks = p_segment->GetTracks();
+		if (!p_tracks)
+		{
+			return false;
+		}
+
+		mkvparser::Track const* p_video = NULL;
+		mkvparser::Track const* p_audio = NULL;
+		for (u32 i = 0; i < p_tracks->GetTracksCount(); ++i)
+		{
+			mkvparser::Track const* p_track = p_tracks->GetTrackByIndex(i);
+			if (!p_track)
+			{
+				continue;
+			}
+
+			if (!p_video && p_track->GetType() == mkvparser::Track::kVideo)
+			{
+				p_video = p_track;
+			}
+			else if (!p_audio && p_track->GetType() == mkvparser::Track::kAudio)
+			{
+				p_audio = p_track;
+			}
+		}
+
+		if (!p_video)
+		{
+			return false;
+		}
+
+		std::vector<VpxFrameInfo> frames;
+		std::vector<s64> frame_times;
+		std::vector<u32> keys;
+		std::vector<AudioPacket> audio;
+
+		mkvparser::BlockEntry const* p_entry = NULL;
+		p_video->GetFirst(p_entry);
+
+		u32 idx_key = 0;
+		while (p_entry && !p_entry->EOS())
+		{
+			mkvparser::Block const* p_block = p_entry->GetBlock();
+			if (p_block)
+			{
+				if (p_block->IsKey())
+				{
+					idx_key = static_cast<u32>(frames.size());
+					keys.push_back(idx_key);
+				}
+
+				s64 time_ns = p_block->GetTime(p_entry->GetCluster());
+				for (s32 f = 0; f < p_block->GetFrameCount(); ++f)
+				{
+					mkvparser::Block::Frame const& frame = p_block->GetFrame(f);
+
+					VpxFrameInfo f_info;
+					f_info.pos = static_cast<u64>(frame.pos);
+					f_info.len = static_cast<u32>(frame.len);
+					f_info.idx_key = idx_key;
+
+					frames.push_back(f_info);
+					frame_times.push_back(time_ns);
+				}
+			}
+
+			p_video->GetNext(p_entry, p_entry);
+		}
+
+		if (p_audio)
+		{
+			p_audio->GetFirst(p_entry);
+			while (p_entry && !p_entry->EOS())
+			{
+				mkvparser::Block const* p_block = p_entry->GetBlock();
+				if (p_block)
+				{
+					s64 time_ns = p_block->GetTime(p_entry->GetCluster());
+					for (s32 f = 0; f < p_block->GetFrameCount(); ++f)
+					{
+						mkvparser::Block::Frame const& frame = p_block->GetFrame(f);
+
+						AudioPacket packet;
+						packet.pos = static_cast<u64>(frame.pos);
+						packet.len = static_cast<u32>(frame.len);
+						packet.reserved = 0;
+						packet.time_ns = time_ns;
+						audio.push_back(packet);
+					}
+				}
+
+				p_audio->GetNext(p_entry, p_entry);
+			}
+		}
+
+		Header hdr;
+		memset(&hdr, 0x00, sizeof(hdr));
+		memcpy(hdr.magic, Magic, sizeof(Magic));
+		hdr.version = Version;
+		hdr.header_size = sizeof(Header);
+		hdr.file_id = file_id;
+		hdr.video_track = static_cast<u32>(p_video->GetNumber());
+		hdr.audio_track = p_audio ? static_cast<u32>(p_audio->GetNumber()) : 0;
+		hdr.frame_count = static_cast<u32>(frames.size());
+		hdr.key_count = static_cast<u32>(keys.size());
+		hdr.audio_packet_count = static_cast<u32>(audio.size());
+
+		hdr.frame_offset = alignUp(sizeof(Header));
+		hdr.frame_time_offset = alignUp(hdr.frame_offset + sizeof(VpxFrameInfo) * frames.size());
+		hdr.key_offset = alignUp(hdr.frame_time_offset + sizeof(s64) * frame_times.size());
+		hdr.audio_offset = alignUp(hdr.key_offset + sizeof(u32) * keys.size());
+		u64 total = hdr.audio_offset + sizeof(AudioPacket) * audio.size();
+
+		p_out->assign(static_cast<size_t>(total), 0);
+		u8* p = p_out->data();
+		memcpy(p, &hdr, sizeof(hdr));
+		if (!frames.empty())
+		{
+			memcpy(p + hdr.frame_offset, frames.data(), sizeof(VpxFrameInfo) * frames.size());
+			memcpy(p + hdr.frame_time_offset, frame_times.data(), sizeof(s64) * frame_times.size());
+		}
+
+		if (!keys.empty())
+		{
+			memcpy(p + hdr.key_offset, keys.data(), sizeof(u32) * keys.size());
+		}
+
+		if (!audio.empty())
+		{
+			memcpy(p + hdr.audio_offset, audio.data(), sizeof(AudioPacket) * audio.size());
+		}
+
+		return true;
+	}
+
+	inline bool writeFile(char const* path, std::vector<u8> const& data)
+	{
+		FILE* fp = fopen(path, "wb");
+		if (!fp)
+		{
+			return false;
+		}
+
+		size_t written = fwrite(data.data(), 1, data.size(), fp);
+		bool is_ok = (fclose(fp) == 0) && written == data.size();
+		if (!is_ok)
+		{
+			remove(path);
+		}
+
+		return is_ok;
+	}
+
+	//A mapped, validated index. The arrays point into the mapping.
+	class Index
+	{
+	public:
+		Index()
+		: m_p_hdr(NULL)
+		{}
+
+		//file_id.hash is only compared when size and mtime match, so a caller can
+		//compute it lazily through the callback.
+		template<typename HashFn>
+		bool open(char const* path, u64 file_size, u64 file_mtime, HashFn hash)
+		{
+			m_p_hdr = NULL;
+			if (!m_file.open(path))
+			{
+				return false;
+			}
+
+			size_t const size = m_file.get_size();
+			if (size < sizeof(Header))
+			{
+				return mf_reject();
+			}
+
+			Header const* p_hdr = reinterpret_cast<Header const*>(m_file.get_buffer());
+			if (memcmp(p_hdr->magic, Magic, sizeof(Magic)) != 0 ||
+				p_hdr->version != static_cast<u32>(Version) ||
+				p_hdr->header_size != sizeof(Header))
+			{
+				return mf_reject();
+			}
+
+			if (p_hdr->file_id.size != file_size || p_hdr->file_id.mtime != file_mtime)
+			{
+				return mf_reject();
+			}
+
+			if (!mf_is_in_range(p_hdr->frame_offset, sizeof(VpxFrameInfo), p_hdr->frame_count, size) ||
+				!mf_is_in_range(p_hdr->frame_time_offset, sizeof(s64), p_hdr->frame_count, size) ||
+				!mf_is_in_range(p_hdr->key_offset, sizeof(u32), p_hdr->key_count, size) ||
+				!mf_is_in_range(p_hdr->audio_offset, sizeof(AudioPacket), p_hdr->audio_packet_count, size))
+			{
+				return mf_reject();
+			}
+
+			if (p_hdr->file_id.hash != hash())
+			{
+				return mf_reject();
+			}
+
+			//a stale index with the same head and tail, the frames are read straight from these.
+			if (!mf_is_valid_entries(p_hdr, file_size))
+			{
+				return mf_reject();
+			}
+
+			m_p_hdr = p_hdr;
+			return true;
+		}
+
+		bool isOpen() const
+		{
+			return m_p_hdr != NULL;
+		}
+
+		Header const& getHeader() const
+		{
+			return *m_p_hdr;
+		}
+
+		VpxFrameInfo const* getFrames() const
+		{
+			return reinterpret_cast<VpxFrameInfo const*>(m_file.get_buffer() + m_p_hdr->frame_offset);
+		}
+
+		s64 const* getFrameTimes() const
+		{
+			return reinterpret_cast<s64 const*>(m_file.get_buffer() + m_p_hdr->frame_time_offset);
+		}
+
+		u32 const* getKeys() const
+		{
+			return reinterpret_cast<u32 const*>(m_file.get_buffer() + m_p_hdr->key_offset);
+		}
+
+		AudioPacket const* getAudioPackets() const
+		{
+			return reinterpret_cast<AudioPacket const*>(m_file.get_buffer() + m_p_hdr->audio_offset);
+		}
+
+	private:
+		MappedFile		m_file;
+		Header const*	m_p_hdr;
+
+		bool mf_reject()
+		{
+			m_file.close();
+			return false;
+		}
+
+		static bool mf_is_in_range(u64 offset, u64 elem_size, u64 count, u64 size)
+		{
+			return (offset & 7) == 0 && offset <= size && count <= (size - offset) / elem_size;
+		}
+
+		//every frame and packet inside the movie, in increasing positions, and every key a frame.
+		bool mf_is_valid_entries(Header const* p_hdr, u64 file_size) const
+		{
+			u8 const* p = m_file.get_buffer();
+			VpxFrameInfo const* frames = reinterpret_cast<VpxFrameInfo const*>(p + p_hdr->frame_offset);
+			u64 end = 0;
+			for (u32 i = 0; i < p_hdr->frame_count; ++i)
+			{
+				VpxFrameInfo const& info = frames[i];
+				if (info.pos < end || info.len > file_size || info.pos > file_size - info.len ||
+					info.idx_key < 0 || static_cast<u32>(info.idx_key) > i)
+				{
+					return false;
+				}
+
+				end = info.pos + info.len;
+			}
+
+			u32 const* keys = reinterpret_cast<u32 const*>(p + p_hdr->key_offset);
+			for (u32 i = 0; i < p_hdr->key_count; ++i)
+			{
+				if (keys[i] >= p_hdr->frame_count)
+				{
+					return false;
+				}
+			}
+
+			AudioPacket const* audio = reinterpret_cast<AudioPacket const*>(p + p_hdr->audio_offset);
+			end = 0;
+			for (u32 i = 0; i < p_hdr->audio_packet_count; ++i)
+			{
+				AudioPacket const& packet = audio[i];
+				if (packet.pos < end || packet.len > file_size || packet.pos > file_size - packet.len)
+				{
+					return false;
+				}
+
+				end = packet.pos + packet.len;
+			}
+
+			return true;
+		}
+	};
+}
+
+#endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_WEBM_INDEX_H_
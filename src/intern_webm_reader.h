@@ -2,6 +2,7 @@
 #define INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_WEBM_READER_H_
 
 #include "intern_mem_block.h"
+#include "intern_resource_pool.h"
 #include "mkvparser/mkvparser.h"
 #include "ofFileUtils.h"
 
@@ -10,6 +11,7 @@ class WebMReader : public mkvparser::IMkvReader
 public:
 	WebMReader()
 	:m_position(0)
+	,m_base(0)
 	{}
 
 	~WebMReader()
@@ -70,6 +72,10 @@ public:
 		return 0;
 	}
 
+	//The whole file goes into the movie block on this thread, the frames are
+	//decoded from there with no copy. So neither demuxer, the lazy load nor the
+	//cluster scan saves the read or the memory of the file, only the parse; a
+	//movie which is not in the file cache still loads at the speed of this read.
 	bool Setup(ofFile& file)
 	{
 		if (!file.exists() || !file.isFile())
@@ -80,9 +86,10 @@ public:
 		enum { IO_BLOCK_SIZE = 4096 };
 		char block_tmp[IO_BLOCK_SIZE];
 
-		m_sp_mb = shared_ptr<MemBlock>(new MemBlock());
+		size_t const file_size = static_cast<size_t>(file.getSize());
+		m_sp_mb = pool::ResourcePool::instance().acquireMemBlock(file_size);
 
-		bool yes = m_sp_mb->alloc(file.getSize());
+		bool yes = m_sp_mb->alloc(file_size);
 		if (!yes)
 		{
 			return false;
@@ -91,9 +98,11 @@ public:
 		size_t ptr = 0;
 		u8* m_buffer = m_sp_mb->get_buffer();
 
-		while (file.good())
+		//a file which is being written may be longer than the size taken above.
+		size_t const size = m_sp_mb->get_size();
+		while (file.good() && ptr < size)
 		{
-			file.read(block_tmp, IO_BLOCK_SIZE);
+			file.read(block_tmp, std::min<size_t>(IO_BLOCK_SIZE, size - ptr));
 			size_t read_size = file.gcount();
 			memcpy(m_buffer + ptr, block_tmp, read_size);
 			ptr += read_size;
@@ -103,6 +112,54 @@ public:
 		return true;
 	}
 
+	//For a file which is still being written: reads what was added since Setup()
+	//or the last Append(). The buffer moves, pointers into it must be taken again.
+	bool Append(ofFile& file, size_t* p_appended)
+	{
+		*p_appended = 0;
+		if (!file.exists() || !file.isFile())
+		{
+			return false;
+		}
+
+		//the block starts at m_base of the file once DropFront() was called.
+		size_t const old_size = m_sp_mb->get_size();
+		u64 const file_size = static_cast<u64>(file.getSize());
+		if (file_size <= m_base + old_size)
+		{
+			return true;
+		}
+
+		size_t const new_size = static_cast<size_t>(file_size - m_base);
+		if (!m_sp_mb->resize(new_size))
+		{
+			return false;
+		}
+
+		file.seekg(m_base + old_size);
+		file.read(reinterpret_cast<char*>(m_sp_mb->get_buffer() + old_size), new_size - old_size);
+		size_t read_size = static_cast<size_t>(file.gcount());
+
+		//the writer may not have flushed everything it reported.
+		m_sp_mb->resize(old_size + read_size);
+		*p_appended = read_size;
+		return true;
+	}
+
+	//For a file which is still being written: the bytes before base + size are
+	//not needed any more. The block holds the file from GetBase() on.
+	void DropFront(size_t size)
+	{
+		m_sp_mb->erase_front(size);
+		m_base += size;
+		m_position = m_position > size ? m_position - size : 0;
+	}
+
+	u64 GetBase() const
+	{
+		return m_base;
+	}
+
 	size_t ReadCur(unsigned char* buffer, size_t size_e, size_t count)
 	{
 		if (m_position == m_sp_mb->get_size())
@@ -160,6 +217,7 @@ public:
 private:
 	shared_ptr<MemBlock>	m_sp_mb;
 	size_t					m_position;
+	u64						m_base;		//the file offset of the first byte of the block
 };
 
 #endif//INCLUDE_OF_ADDONS_OFXWEBMPLAYER_INTERN_WEBM_READER_H_
\ No newline at end of file
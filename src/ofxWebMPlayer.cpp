@@ -1,21 +1,38 @@
 #include "ofxWebMPlayer.h"
 
+#include <limits.h>
+#include <thread>
 #include <vorbis/codec.h>
 #include "vpx_decoder.h"
 #include "vp8dx.h"
 #include "intern_webm_reader.h"
+#include "intern_webm_index.h"
+#include "intern_frame_index.h"
+#include "intern_cluster_scan.h"
+#include "mkvparser/mkvreader.h"
+#include "common/webmids.h"
+#include "intern_webm_demuxer.h"
+#include "intern_audio_dsp.h"
+#include "intern_audio_resampler.h"
+#include "intern_audio_mixer.h"
+#include "intern_pcm_kernels.h"
+#include "intern_pcm_store.h"
+#include "intern_resource_pool.h"
+#include "intern_memory_budget.h"
+#include "intern_mapped_file.h"
+#include "intern_stage_timing.h"
+#include "intern_trace.h"
+#include "intern_stats.h"
+#include "intern_alpha_decoder.h"
+#include "intern_plane_scale.h"
+#include "intern_offline_decode.h"
 #include "shader/intern_shader.h"
 
-float 	pan;
-int		sampleRate;
-bool 	bNoise = true;
-float 	volume;
+static ofxWebMPlayer::AudioOutputSettings g_audio_output_settings = { 48000, 2, 256, 2 };
 
-//------------------- for the simple sine wave synthesis
-float 	targetFrequency;
-float 	phase;
-float 	phaseAdder;
-float 	phaseAdderTarget;
+static_assert(static_cast<int>(audio::PCM_F32) == ofxWebMPlayer::AUDIO_STORAGE_F32 &&
+	static_cast<int>(audio::PCM_S16) == ofxWebMPlayer::AUDIO_STORAGE_S16 &&
+	static_cast<int>(audio::PCM_ADPCM) == ofxWebMPlayer::AUDIO_STORAGE_ADPCM, "AudioStorage must match audio::PcmFormat.");
 
 void gf_trace_codec_error(vpx_codec_ctx_t *ctx, char const* cstr_prefix)
 {
@@ -23,12 +40,114 @@ void gf_trace_codec_error(vpx_codec_ctx_t *ctx, char const* cstr_prefix)
 	ofLogError("ofxWebMPlayer", "%s\nvpx_error- %s\n%s", cstr_prefix, vpx_codec_error(ctx), cstr_detail ? cstr_detail : "");
 }
 
-typedef struct VpxFrameInfo
+//The frame count from the segment duration. 0 if the duration or the frame rate is unknown.
+static u32 gf_estimate_frame_count(s64 duration_ns, f64 frame_rate, u64 default_duration_ns)
 {
-	u32 pos;
-	u32 len;
-	s32 idx_key;
-} VpxFrameInfo;
+	f64 fps = frame_rate;
+	if (default_duration_ns)
+	{
+		fps = 1000000000.0 / default_duration_ns;
+	}
+
+	if (duration_ns <= 0 || fps <= 0.0)
+	{
+		return 0;
+	}
+
+	return static_cast<u32>(duration_ns * fps / 1000000000.0 + 0.5);
+}
+
+//The time of the last cue point, for files which do not write the duration.
+static s64 gf_get_cues_duration(mkvparser::Segment const* p_segment)
+{
+	mkvparser::Cues const* p_cues = p_segment->GetCues();
+	if (!p_cues)
+	{
+		return -1;
+	}
+
+	while (p_cues->LoadCuePoint())
+	{
+	}
+
+	mkvparser::CuePoint const* p_last = p_cues->GetLast();
+	return p_last ? p_last->GetTime(p_segment) : -1;
+}
+
+static TrackDesc gf_describe_track(mkvparser::Track const* p_track)
+{
+	TrackDesc desc;
+	desc.number = static_cast<u32>(p_track->GetNumber());
+	desc.type = static_cast<s32>(p_track->GetType());
+	desc.codec_id = p_track->GetCodecId() ? p_track->GetCodecId() : "";
+	desc.width = 0;
+	desc.height = 0;
+	desc.frame_rate = 0.0;
+	desc.default_duration_ns = p_track->GetDefaultDuration();
+	desc.has_alpha = false;
+	desc.p_mkv_track = p_track;
+
+	size_t size_of_codec_private = 0;
+	u8 const* p_codec_private = p_track->GetCodecPrivate(size_of_codec_private);
+	if (p_codec_private)
+	{
+		desc.codec_private.assign(p_codec_private, p_codec_private + size_of_codec_private);
+	}
+
+	if (desc.type == mkvparser::Track::kVideo)
+	{
+		mkvparser::VideoTrack const* p_video = static_cast<mkvparser::VideoTrack const*>(p_track);
+		desc.width = static_cast<u32>(p_video->GetWidth());
+		desc.height = static_cast<u32>(p_video->GetHeight());
+		desc.frame_rate = p_video->GetFrameRate();
+	}
+
+	return desc;
+}
+
+//AlphaMode of the Video element, mkvparser does not read it.
+static bool gf_read_alpha_mode(mkvparser::IMkvReader* p_reader, mkvparser::Track const* p_track)
+{
+	std::vector<u8> buffer(static_cast<size_t>(p_track->m_element_size));
+	if (buffer.empty() || p_reader->Read(p_track->m_element_start, static_cast<long>(buffer.size()), buffer.data()) < 0)
+	{
+		return false;
+	}
+
+	u8 const* p = buffer.data();
+	u64 pos = 0;
+	u64 end = buffer.size();
+	u32 id;
+	u64 size;
+	if (!cluster_scan::readId(p, end, &pos, &id) || id != libwebm::kMkvTrackEntry || !cluster_scan::readSize(p, end, &pos, &size))
+	{
+		return false;
+	}
+
+	while (pos < end)
+	{
+		if (!cluster_scan::readId(p, end, &pos, &id) || !cluster_scan::readSize(p, end, &pos, &size) || pos + size > end)
+		{
+			return false;
+		}
+
+		if (id == libwebm::kMkvVideo)
+		{
+			//into the children of Video.
+			end = pos + size;
+			continue;
+		}
+
+		if (id == libwebm::kMkvAlphaMode)
+		{
+			return cluster_scan::readUint(p, pos, size) != 0;
+		}
+
+		pos += size;
+	}
+
+	return false;
+}
 
 typedef struct AudioInfo
 {
@@ -60,30 +179,202 @@ struct ofxWebMPlayer::VpxMovInfo
 	f32 planes_width[4];
 	f32 planes_height[4];
 	f32 chroma_shift[2];
+	u32 bit_depth;			//8, 10 or 12, the planes have 16 bits samples above 8
+	f32 sample_scale;		//f_sample_scale of the shaders
+
+	//setPreviewSize(): the planes are box filtered down by preview_factor before
+	//the upload, planes_width and planes_height are then the scaled planes.
+	u32					preview_factor;
+	std::vector<u8>		preview_planes;
+	size_t				preview_offsets[4];
+	std::vector<u32>	preview_sums;
+	u32					region[4];		//setRegion(), x, y, w, h aligned to the chroma, w is 0 without one
 
 	vpx_codec_dec_cfg	vpx_cfg;
 	vpx_codec_ctx_t     vpx_ctx;
 	vpx_codec_iface_t*  vpx_if;
 	s32                 vpx_flags;
+	std::unique_ptr<alpha::Decoder>	up_alpha;	//null if the movie has no alpha
+	bool				is_alpha_opaque;	//the alpha plane is filled for a frame without one
 
 	u64 pre_tick_millis;
 	u64 total_tick_mills;
 	s32 cur_mov_frame_idx;
 
-	std::vector<VpxFrameInfo>	box_vpx_frame_info;
-	std::vector<u32>			box_key;
+	FrameIndex					frame_index;
+	std::shared_ptr<sidecar::Index>	sp_index;
+
+	//the segment keeps reading through the reader while the frames are indexed.
+	std::unique_ptr<WebMReader>			up_reader;
+	std::unique_ptr<mkvparser::Segment>	up_segment;
+	std::unique_ptr<WebMStreamReader>	up_stream_reader;
+	std::unique_ptr<WebMDemuxer>		up_demuxer;		//instead of the segment with DEMUXER_WEBM_PARSER
+	std::vector<sidecar::AudioPacket>	box_audio_packet;
+	std::string					live_path;		//empty if not live
+	u64							live_poll_millis;
+	u32							live_first_frame;	//the frames before were dropped from the movie block
+	u64							movie_base;		//the file offset of the movie block, only the live mode drops the front
+	mkvparser::Track const*		p_video_track;
+	mkvparser::BlockEntry const* p_next_block;	//where mf_index_frames() goes on
+	bool						is_index_done;	//false while frame_count is an estimate
 	std::shared_ptr<MemBlock>	sp_mb_movie_body;
-	std::shared_ptr<MemBlock>	sp_mb_wav_body;
+	std::shared_ptr<audio::PcmStore>	sp_pcm_store;
 
 	AudioInfo					audio_info;
 	bool						has_audio;
 	bool						has_video;
 	bool						is_audio_end;
-	u64							audio_cur_ptr;
+	u64							audio_cur_frame;
 	std::atomic<u64>			accum_samples;
 	std::atomic<u64>			audio_timestamp;
+
+	audio::MixMatrix			mix_matrix;
+	audio::GainStage			gain_stage;
+	audio::Resampler			resampler;
+	u32							audio_out_rate;
+	std::vector<f32>			audio_scratch;
+	std::vector<f32>			audio_pull;
+	std::atomic<u32>			audio_device_channels;	//set by the callback when the device has another layout, 0 if not
+
+	//loadAsync(): the thread runs mf_load_movie(), update() does mf_load_gl().
+	std::thread					load_thread;
+	std::atomic<s32>			async_state;
+	bool						is_play_pending;	//play() came before the load was done
+	vpx_image_t*				p_first_image;
+	u64							us_load_begin;
+
+	//the keys the resources go back to the pool with.
+	u32							decoder_width;
+	u32							decoder_height;
+	pool::TextureKey			texture_key;
+	char const*					src_frag_shader;
+
+	//the bytes against the memory budget. A degraded player has given back
+	//everything but the GL, its last frame stays, and loads load_name again.
+	memory::Account				memory_account;
+	std::string					load_name;
+	bool						is_degraded;
+	u32							trace_id;		//the player in the events of enableTrace()
+	stats::Counters				stats;
+	u32							catch_up_depth;	//the frames the last update decoded
+	bool						is_headless;	//loaded with enableHeadless(), no GL
+	u32							frame_checksum;
+
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+	//one histogram per stage, p_stage_timing is null while the timing is off.
+	std::unique_ptr<timing::Histogram[]>	up_stage_timing;
+	std::atomic<timing::Histogram*>			p_stage_timing;
+
+#endif
+};
+
+enum
+{
+	AsyncNone,
+	AsyncLoading,
+	AsyncReady,
+	AsyncFailed,
 };
 
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+//the histogram of a stage, null when the timing is off so the scope costs a branch.
+static timing::Histogram* gf_get_stage(timing::Histogram* p_stages, ofxWebMPlayer::Stage stage)
+{
+	return p_stages ? p_stages + stage : NULL;
+}
+
+#endif
+//the visible samples of a plane, without the stride padding.
+static void gf_get_plane_size(vpx_image_t const* p_image, u32 plane, u32* p_w, u32* p_h)
+{
+	bool const is_chroma = plane == VPX_PLANE_U || plane == VPX_PLANE_V;
+	*p_w = is_chroma ? (p_image->d_w + p_image->x_chroma_shift) >> p_image->x_chroma_shift : p_image->d_w;
+	*p_h = is_chroma ? (p_image->d_h + p_image->y_chroma_shift) >> p_image->y_chroma_shift : p_image->d_h;
+}
+
+//the rectangle of setRegion() in a plane, the whole plane without one.
+static void gf_get_region_plane(vpx_image_t const* p_image, u32 plane, u32 const* p_region, u32* p_x, u32* p_y, u32* p_w, u32* p_h)
+{
+	if (!p_region[2])
+	{
+		*p_x = 0;
+		*p_y = 0;
+		gf_get_plane_size(p_image, plane, p_w, p_h);
+		return;
+	}
+
+	bool const is_chroma = plane == VPX_PLANE_U || plane == VPX_PLANE_V;
+	u32 const shift_x = is_chroma ? p_image->x_chroma_shift : 0;
+	u32 const shift_y = is_chroma ? p_image->y_chroma_shift : 0;
+	*p_x = p_region[0] >> shift_x;
+	*p_y = p_region[1] >> shift_y;
+	*p_w = (p_region[2] + (1 << shift_x) - 1) >> shift_x;
+	*p_h = (p_region[3] + (1 << shift_y) - 1) >> shift_y;
+}
+
+//FNV-1a of the visible samples of every plane, the stride padding is not hashed.
+static u32 gf_get_image_checksum(vpx_image_t const* p_image)
+{
+	u32 hash = 2166136261u;
+	u32 const bytes_per_sample = (p_image->fmt & VPX_IMG_FMT_HIGHBITDEPTH) ? 2 : 1;
+	for (u32 i = 0; i < 4; ++i)
+	{
+		if (!p_image->planes[i])
+		{
+			continue;
+		}
+
+		u32 w, h;
+		gf_get_plane_size(p_image, i, &w, &h);
+		for (u32 y = 0; y < h; ++y)
+		{
+			u8 const* p_row = p_image->planes[i] + static_cast<size_t>(y) * p_image->stride[i];
+			for (u32 x = 0; x < w * bytes_per_sample; ++x)
+			{
+				hash = (hash ^ p_row[x]) * 16777619u;
+			}
+		}
+	}
+
+	return hash;
+}
+
+//the colour and the alpha if the frame has one, the same for the player and the reference.
+static u32 gf_get_frame_checksum(vpx_image_t const* p_image, vpx_image_t const* p_alpha)
+{
+	u32 hash = gf_get_image_checksum(p_image);
+	if (p_alpha)
+	{
+		hash ^= gf_get_image_checksum(p_alpha) * 31u;
+	}
+
+	return hash;
+}
+
+//the #define goes right after the #version line, which has to come first.
+static std::string gf_define_alpha_channel(char const* src_frag_shader)
+{
+	std::string src = src_frag_shader;
+	size_t pos = src.find("#version");
+	pos = pos == std::string::npos ? 0 : src.find('\n', pos) + 1;
+	src.insert(pos, "#define USE_ALPHA_CHANNEL\n");
+	return src;
+}
+
+//the fragment shader with USE_ALPHA_CHANNEL, built once so the pool still keys on the pointer.
+static char const* gf_get_alpha_frag_shader(char const* src_frag_shader)
+{
+	static std::string const s_alpha601 = gf_define_alpha_channel(g_cstr_frag_shader601);
+	static std::string const s_alpha709 = gf_define_alpha_channel(g_cstr_frag_shader709);
+	static std::string const s_alpha2020 = gf_define_alpha_channel(g_cstr_frag_shader2020);
+	if (src_frag_shader == g_cstr_frag_shader2020)
+	{
+		return s_alpha2020.c_str();
+	}
+
+	return src_frag_shader == g_cstr_frag_shader709 ? s_alpha709.c_str() : s_alpha601.c_str();
+}
+
 char const* g_sampler1d_name[4] =
 {
 	"tex_y",
@@ -105,18 +396,81 @@ ofxWebMPlayer::ofxWebMPlayer()
 	m_vpx_mov_info->vpx_if = NULL ;
 	m_vpx_mov_info->has_audio = false;
 	m_vpx_mov_info->has_video = false;
+	m_vpx_mov_info->p_video_track = NULL;
+	m_vpx_mov_info->p_next_block = NULL;
+	m_vpx_mov_info->is_index_done = true;
+	m_vpx_mov_info->async_state = AsyncNone;
+	m_vpx_mov_info->is_play_pending = false;
+	m_vpx_mov_info->p_first_image = NULL;
+	m_vpx_mov_info->is_alpha_opaque = false;
+	m_vpx_mov_info->src_frag_shader = NULL;
+	m_vpx_mov_info->is_degraded = false;
+	m_vpx_mov_info->trace_id = trace::Tracer::instance().newPlayerId();
+	m_vpx_mov_info->catch_up_depth = 0;
+	m_vpx_mov_info->is_headless = false;
+	m_vpx_mov_info->frame_checksum = 0;
+	m_vpx_mov_info->bit_depth = 8;
+	m_vpx_mov_info->sample_scale = 1.f;
+	m_vpx_mov_info->preview_factor = 1;
+	m_vpx_mov_info->live_first_frame = 0;
+	m_vpx_mov_info->movie_base = 0;
+	m_vpx_mov_info->audio_device_channels = 0;
+	memset(m_vpx_mov_info->region, 0x00, sizeof(m_vpx_mov_info->region));
+	++stats::global().players;
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+	m_vpx_mov_info->p_stage_timing = NULL;
+
+#endif
+	memset(m_gl_tex2d_planes, 0x00, sizeof(m_gl_tex2d_planes));
 
 	m_is_paused = false;
+	m_volume = 1.f;
+	m_pan = 0.f;
 	m_is_playing = false;
 	m_is_frame_new = false;
 	m_is_loop = false;
+	m_is_audio_chained = false;
 
 	m_enable_audio = false;
+	m_enable_index = true;
+	m_enable_lazy_load = false;
+	m_demuxer = DEMUXER_MKVPARSER;
+	m_enable_live = false;
+	m_live_latency_s = 2.f;
+	m_index_threads = 1;
+	m_audio_storage = AUDIO_STORAGE_F32;
+	m_enable_headless = false;
+	m_enable_frame_checksums = false;
+	m_preview_width = 0;
+	m_preview_height = 0;
+	memset(m_region, 0x00, sizeof(m_region));
+
+	memory::Account& account = m_vpx_mov_info->memory_account;
+	account.get_state = [this]()
+	{
+		//a playlist pulls the audio, a live movie can not be loaded again as it was.
+		if (m_is_audio_chained || m_vpx_mov_info->async_state != AsyncNone || !m_vpx_mov_info->live_path.empty())
+		{
+			return memory::StatePinned;
+		}
+
+		if (!m_is_playing)
+		{
+			return memory::StateIdle;
+		}
+
+		return m_is_paused ? memory::StatePaused : memory::StatePlaying;
+	};
+	account.degrade = [this]() { mf_degrade(); };
+	memory::Budget::instance().add(&account);
 }
 
 ofxWebMPlayer::~ofxWebMPlayer()
 {
+	mf_join_load();
+	memory::Budget::instance().remove(&m_vpx_mov_info->memory_account);
 	mf_unload();
+	--stats::global().players;
 	m_vpx_mov_info->~VpxMovInfo();
 }
 
@@ -150,7 +504,7 @@ namespace vorbis
 		void destroy();
 
 		bool decode(ogg_packet* p_pack);
-		s32 outputPCM(std::shared_ptr<MemBlock> mem_block, u32 fromIdx, u64 timestamp);
+		s32 outputPCM(audio::PcmStore* p_store);
 
 		//TMP don't recommand use those//
 		s32 getNumSamplesOfPCM_Buffer();
@@ -289,132 +643,29 @@ namespace vorbis
 		return false;
 	}
 
-#define USE_S16 0
-
-#if USE_S16
-	typedef ogg_int16_t type_of_sample;
-#else
-	typedef float type_of_sample;
-#endif
-
-	s32 Decoder::outputPCM(std::shared_ptr< MemBlock > mem_block, u32 fromIdx, u64 timestamp)
+	s32 Decoder::outputPCM(audio::PcmStore* p_store)
 	{
 		if (!m_isInit) return -1;
 
 		float **pcm;
-		s32 availableSize = static_cast<s32>(mem_block->get_size() - fromIdx);
-		if (availableSize <= 0) return -1;
-
-		//s32 availableSamples = availableSize / sizeof(type_of_sample) / m_data.info.channels;
-
-		u8* ptr = mem_block->get_buffer() + fromIdx;
-
-		//AudioHeader* p_header = (AudioHeader*)(ptr);
-		//type_of_sample* out_buffer = (type_of_sample*)(ptr + sizeof(AudioHeader));
-		type_of_sample* out_buffer = (type_of_sample*)(ptr);
-
-		bool isClip = 0;
 
 		//**pcm is a multichannel float vector.  In stereo, for
 		//example, pcm[0] is left, and pcm[1] is right.  samples is
-		//the size of each channel.  Convert the float values
-		//(-1.<=range<=1.) to whatever PCM format and write it out
+		//the size of each channel.  The store interleaves, clamps and
+		//converts them to its own format.
 
 		s32 samples = vorbis_synthesis_pcmout(&m_data.dsp_state, &pcm);
 
 		if (samples > 0)
 		{
-			int clipflag = 0;
-			s32 bout = samples;//(samples < availableSamples ? samples : availableSamples);
-#if USE_S16
-			//convert floats to 16 bit signed ints (host order) and
-			//interleave
-			for (int i = 0; i < m_data.info.channels; ++i)
-			{
-				ogg_int16_t *ptr = out_buffer + i;
-				float  *mono = pcm[i];
-
-				for (int j = 0; j < bout; ++j)
-				{
-#if 1
-					s32 val = (s32)floor(mono[j] * 32767.f + 0.5f);
-#else // optional dither 
-					int val = mono[j] * 32767.f + drand48() - 0.5f;
-#endif
-					// might as well guard against clipping;
-					if (val>32767)
-					{
-						val = 32767;
-						isClip = true;
-					}
-
-					if (val<-32768)
-					{
-						val = -32768;
-						isClip = true;
-					}
-
-					*ptr = val;
-					ptr += m_data.info.channels;
-				}
-			}
-
-			if (isClip)
-			{
-				//printf("Clipping in frame %ld\n",(long)(_data.dsp_state.sequence));
-			}
-#else
-
-			//convert floats to float
-			//src = llllrrrr
-			//dst = lrlrlrlr
-			//interleave
-			for (int i = 0; i < m_data.info.channels; ++i)
-			{
-				type_of_sample *ptr = out_buffer + i;
-				float  *mono = pcm[i];
-			
-				for (int j = 0; j < bout; ++j)
-				{
-					float val = mono[j];
-			
-					// might as well guard against clipping;
-					if (val > 1.f)
-					{
-						val = 1.f;
-						isClip = true;
-					}
-			
-					if (val < -1.f)
-					{
-						val = -1.f;
-						isClip = true;
-					}
-			
-					*ptr = val;
-					ptr += m_data.info.channels;
-				}
-			}
-			
-			if (isClip)
-			{
-				ofLogVerbose("ofxWebMPlayer", "Clipping in frame %ld\n",(long)(m_data.dsp_state.sequence));
-			}
+			p_store->write(pcm, samples);
 
-#endif
 			// tell libvorbis how many samples we actually consumed;
-			vorbis_synthesis_read(&m_data.dsp_state, bout);
-			m_isEmpty = (bout == samples);
-
-			//p_header->size_of_buffer = bout * m_data.info.channels * sizeof(type_of_sample);
-			//p_header->timestamp = timestamp;
-			return bout;
-		}
-		else
-		{
-			m_isEmpty = true;
-			return samples;
+			vorbis_synthesis_read(&m_data.dsp_state, samples);
 		}
+
+		m_isEmpty = true;
+		return samples;
 	}
 
 	s32 Decoder::getNumSamplesOfPCM_Buffer()
@@ -516,38 +767,39 @@ namespace vorbis
 		return totalSamples;
 	}
 
-	bool readOggPakcetStreamer(AudioInfo* p_audio_info, std::shared_ptr<MemBlock> mem_block, OggPacketStreamer* pOPStreamer, Decoder* pDecoder)
+	bool readOggPakcetStreamer(AudioInfo* p_audio_info, audio::PcmStore* p_store, audio::PcmFormat format, OggPacketStreamer* pOPStreamer, Decoder* pDecoder)
 	{
-		u32 bytesPerSample = sizeof(type_of_sample);
-		u32 bytesPerOggSample = bytesPerSample * pDecoder->getChannels();
-
 		u64 OggSamples;
 		u64 OggPackages;
 		vorbis::getOggTotalNumSampleAndNumPackage(pOPStreamer, pDecoder, &OggSamples, &OggPackages);
 
-		//s64 sizeBuffer = OggSamples * bytesPerOggSample + (OggPackages * sizeof(AudioHeader));
-		s64 sizeBuffer = OggSamples * bytesPerOggSample;
+		if (!p_store->alloc(format, pDecoder->getChannels(), OggSamples))
+		{
+			return false;
+		}
+
+		u32 const bits[] = { 32, 16, 4 };
 
-		mem_block->alloc(sizeBuffer);
 		p_audio_info->sample_rate			= pDecoder->getRate();
-		p_audio_info->samples_per_channel	= static_cast<u32>(OggSamples / pDecoder->getChannels());
+		p_audio_info->samples_per_channel	= static_cast<u32>(OggSamples);
 		p_audio_info->num_of_channel		= pDecoder->getChannels();
-		p_audio_info->bits_per_sample		= bytesPerSample * 8;
-		p_audio_info->total_samples			= OggSamples;
+		p_audio_info->bits_per_sample		= bits[format];
+		p_audio_info->total_samples			= static_cast<u32>(OggSamples * pDecoder->getChannels());
 		
 		ogg_packet pack;
 
 		u64 timestamp;
-		u32 idxCur = 0;
 		while (!pOPStreamer->isEnd() && pOPStreamer->getPacket(pack, &timestamp))
 		{
-			bool yes = pDecoder->decode(&pack);
-			s32 samples = pDecoder->outputPCM(mem_block, idxCur, timestamp);
-			if (samples)
-			{
-				//idxCur += samples * bytesPerOggSample + sizeof(AudioHeader);
-				idxCur += samples * bytesPerOggSample;
-			}
+			pDecoder->decode(&pack);
+			pDecoder->outputPCM(p_store);
+		}
+
+		p_store->finish();
+
+		if (p_store->isClipped())
+		{
+			ofLogVerbose("ofxWebMPlayer", "The audio is clipped.");
 		}
 
 		return true;
@@ -668,898 +920,2643 @@ private:
 	bool m_isEndPush;
 };
 
-void ofxWebMPlayer::enableAudio(bool yes)
+class OggPacketStreamerForIndex : public vorbis::OggPacketStreamer
 {
-	m_enable_audio = yes;
-}
+public:
+	OggPacketStreamerForIndex(std::shared_ptr<MemBlock> rspBuffer, sidecar::AudioPacket const* p_packets, u32 count)
+	: m_rspBuffer(rspBuffer)
+	, m_pPackets(p_packets)
+	, m_count(count)
+	, m_idx(0)
+	, m_idxPush(0)
+	, m_isEnd(false)
+	, m_isEndPush(false)
+	{}
 
-bool ofxWebMPlayer::load(string name)
-{
-	//mf_unload();
-	WebMReader reader;
+	virtual ~OggPacketStreamerForIndex() {}
 
+	void reset() override
 	{
-		ofFile file(name, ofFile::ReadOnly, true);
-		bool yes = reader.Setup(file);
-		if (!yes)
-		{
-			return false;
-		}
+		m_idx = 0;
+		m_isEnd = false;
 	}
 
-	do
+	bool getPacket(ogg_packet& pack, u64* p_timestamp) override
 	{
-		s64 pos;
-		mkvparser::EBMLHeader ebml_header;
-		s64 ret = ebml_header.Parse(&reader, pos);
-		if (ret < 0)
+		if (m_idx >= m_count)
 		{
-			ofLogError("ofxWebMPlayer", "ofxWebMPlayer::load(): This file [%s] is not WebM format", name.c_str());
-			break;
+			m_isEnd = true;
+			return false;
 		}
 
-		mkvparser::Segment* p_segment;
-		ret = mkvparser::Segment::CreateInstance(&reader, pos, p_segment);
-		if (ret < 0)
+		sidecar::AudioPacket const& packet = m_pPackets[m_idx];
+		if (p_timestamp)
 		{
-			ofLogError("ofxWebMPlayer", "load(): WebM Segment::CreateInstance() failed.");
-			break;
+			*p_timestamp = packet.time_ns;
 		}
 
-		ret = p_segment->Load();
-		if (ret < 0)
+		pack.b_o_s = 0;
+		pack.bytes = (s32)packet.len;
+		pack.e_o_s = 0;
+		pack.granulepos = -1;
+		pack.packet = m_rspBuffer->get_buffer() + packet.pos;
+		pack.packetno = 3 + m_idx; //other packet is header//
+
+		if (++m_idx == m_count)
 		{
-			ofLogError("ofxWebMPlayer", "load(): WebM Segment::Load() failed.");
-			break;
+			pack.e_o_s = 512;
+			m_isEnd = true;
 		}
 
-		mkvparser::Tracks const* p_tracks = p_segment->GetTracks();
-		u32 const num_tracks = p_tracks->GetTracksCount();
-		m_vpx_mov_info->sp_mb_movie_body = reader.GetMemBlockSptr();
-
-		for (u32 i = 0; i < num_tracks; ++i)
-		{
-			mkvparser::Track const* const p_track = p_tracks->GetTrackByIndex(i);
-			if (p_track == NULL)
-			{
-				continue;
-			}
+		return true;
+	}
 
-			s32 const track_type = p_track->GetType();
+	bool isEnd() override
+	{
+		return m_isEnd;
+	}
 
-			switch (track_type)
-			{
-			case mkvparser::Track::kVideo:
-			{
-				const char* codec_id = p_track->GetCodecId();
-				vpx_codec_iface_t* p_iface = NULL;
+	void push() override
+	{
+		m_idxPush = m_idx;
+		m_isEndPush = m_isEnd;
+	}
 
-				if (strcmp(codec_id, "V_VP8") == 0)
-				{
-					p_iface = vpx_codec_vp8_dx();
-				}
-				else if (strcmp(codec_id, "V_VP9") == 0)
-				{
-					p_iface = vpx_codec_vp9_dx();
-				}
-				else
-				{
-					ofLogError("ofxWebMPlayer", "load()-video: This codec [%s] is not support.", codec_id);
-					continue;
-				}
+	void pop() override
+	{
+		m_idx = m_idxPush;
+		m_isEnd = m_isEndPush;
+	}
 
-				m_vpx_mov_info->vpx_flags = 0;
-				// Initialize codec
-				m_vpx_mov_info->vpx_cfg.threads = 8;
-				m_vpx_mov_info->vpx_cfg.w = 0;
-				m_vpx_mov_info->vpx_cfg.h = 0;
+private:
+	std::shared_ptr<MemBlock> m_rspBuffer;
+	sidecar::AudioPacket const* m_pPackets;
+	u32 m_count;
+	u32 m_idx;
+	u32 m_idxPush;
+	bool m_isEnd;
+	bool m_isEndPush;
+};
 
-				vpx_codec_err_t err = vpx_codec_dec_init(&m_vpx_mov_info->vpx_ctx, p_iface, &m_vpx_mov_info->vpx_cfg, m_vpx_mov_info->vpx_flags);
-				if (err)
-				{
-					gf_trace_codec_error(&m_vpx_mov_info->vpx_ctx, "load()-video: Failed to initialize the decoder of VPX.");
-					continue;
-				}
+void ofxWebMPlayer::enableAudio(bool yes)
+{
+	m_enable_audio = yes;
+}
 
-				m_vpx_mov_info->vpx_if = p_iface;
+void ofxWebMPlayer::enableIndex(bool yes)
+{
+	m_enable_index = yes;
+}
 
-				ofLogNotice("ofxWebMPlayer", "load()-video: Now vpx codec is using %s.", vpx_codec_iface_name(m_vpx_mov_info->vpx_if));
+void ofxWebMPlayer::enableLazyLoad(bool yes)
+{
+	m_enable_lazy_load = yes;
+}
 
-				mkvparser::VideoTrack const* const pVideoTrack = static_cast<const mkvparser::VideoTrack*>(p_track);
+void ofxWebMPlayer::setDemuxer(Demuxer demuxer)
+{
+	m_demuxer = demuxer;
+}
 
-				m_vpx_mov_info->frame_rate = static_cast<f32>(pVideoTrack->GetFrameRate());
-				m_vpx_mov_info->frame_count = 0;
-				m_vpx_mov_info->width = static_cast<u32>(pVideoTrack->GetWidth()); //Pixels width//
-				m_vpx_mov_info->height = static_cast<u32>(pVideoTrack->GetHeight()); //Pixels height//
+void ofxWebMPlayer::setIndexThreads(unsigned int count)
+{
+	m_index_threads = count;
+}
 
-				mkvparser::BlockEntry const* pBlockEty = NULL;
-				pVideoTrack->GetFirst(pBlockEty);
+void ofxWebMPlayer::enableLive(bool yes, float latency_s)
+{
+	m_enable_live = yes;
+	m_live_latency_s = std::max(latency_s, 0.f);
+}
 
-				u32 idxKey = 0;
+bool ofxWebMPlayer::probe(string name, MovieInfo* p_out, bool read_cues)
+{
+	if (!p_out)
+	{
+		return false;
+	}
 
-				while (pBlockEty && !pBlockEty->EOS())
-				{
-					mkvparser::Block const* pBlock = pBlockEty->GetBlock();
+	MovieInfo& info = *p_out;
+	info.duration_s = 0.f;
+	info.video_codec.clear();
+	info.width = 0;
+	info.height = 0;
+	info.frame_rate = 0.f;
+	info.has_alpha = false;
+	info.video_bit_depth = 0;
+	info.audio_codec.clear();
+	info.audio_sample_rate = 0;
+	info.audio_channels = 0;
+	info.audio_bit_depth = 0;
+	info.frame_count = -1;
+	info.key_frame_count = -1;
+
+	//a file reader, only the bytes of the headers are read.
+	std::string path = ofToDataPath(name, true);
+	mkvparser::MkvReader reader;
+	if (reader.Open(path.c_str()) != 0)
+	{
+		ofLogError("ofxWebMPlayer", "probe(): Can not open [%s].", name.c_str());
+		return false;
+	}
 
-					mkvparser::BlockEntry::Kind k = pBlockEty->GetKind();
-					if (k == mkvparser::BlockEntry::kBlockGroup)
-					{
-						int c = 0;
-					}
+	s64 pos = 0;
+	mkvparser::EBMLHeader ebml_header;
+	if (ebml_header.Parse(&reader, pos) < 0)
+	{
+		ofLogError("ofxWebMPlayer", "probe(): This file [%s] is not WebM format", name.c_str());
+		return false;
+	}
 
-					//s64 tCode = pBlock->GetTimeCode(pBlockEty->GetCluster());
-					//s64 t = pBlock->GetTime(pBlockEty->GetCluster());
-					if (pBlock)
-					{
-						if (pBlock->IsKey())
-						{
-							idxKey = static_cast<u32>(m_vpx_mov_info->box_vpx_frame_info.size());
-							m_vpx_mov_info->box_key.push_back(idxKey);
-						}
+	mkvparser::Segment* p_segment;
+	if (mkvparser::Segment::CreateInstance(&reader, pos, p_segment) < 0)
+	{
+		ofLogError("ofxWebMPlayer", "probe(): WebM Segment::CreateInstance() failed.");
+		return false;
+	}
 
-						for (s32 fIdx = 0; fIdx < pBlock->GetFrameCount(); ++fIdx)
-						{
+	std::unique_ptr<mkvparser::Segment> up_segment(p_segment);
+	if (p_segment->ParseHeaders() < 0 || !p_segment->GetTracks())
+	{
+		ofLogError("ofxWebMPlayer", "probe(): WebM Segment::ParseHeaders() failed.");
+		return false;
+	}
 
-							if (fIdx > 0)
-							{
-								int c = 0;
-							}
+	s64 duration_ns = p_segment->GetInfo() ? p_segment->GetInfo()->GetDuration() : -1;
 
-							mkvparser::Block::Frame const& frame = pBlock->GetFrame(fIdx);
+	mkvparser::Track const* p_video = NULL;
+	mkvparser::Tracks const* p_tracks = p_segment->GetTracks();
+	for (u32 i = 0; i < p_tracks->GetTracksCount(); ++i)
+	{
+		mkvparser::Track const* p_track = p_tracks->GetTrackByIndex(i);
+		if (!p_track || !p_track->GetCodecId())
+		{
+			continue;
+		}
 
-							VpxFrameInfo f_info;
-							f_info.pos = (u32)frame.pos;
-							f_info.len = frame.len;
-							f_info.idx_key = idxKey;
+		if (!p_video && p_track->GetType() == mkvparser::Track::kVideo)
+		{
+			mkvparser::VideoTrack const* p_video_track = static_cast<mkvparser::VideoTrack const*>(p_track);
+			p_video = p_track;
+			info.video_codec = p_track->GetCodecId();
+			info.width = static_cast<int>(p_video_track->GetWidth());
+			info.height = static_cast<int>(p_video_track->GetHeight());
+			info.frame_rate = static_cast<float>(p_video_track->GetFrameRate());
+			if (p_track->GetDefaultDuration())
+			{
+				info.frame_rate = static_cast<float>(1000000000.0 / p_track->GetDefaultDuration());
+			}
 
-							m_vpx_mov_info->box_vpx_frame_info.push_back(f_info);
-						}
-						m_vpx_mov_info->frame_count += pBlock->GetFrameCount();
-					}
+			info.has_alpha = gf_read_alpha_mode(&reader, p_track);
+			mkvparser::Colour const* p_colour = p_video_track->GetColour();
+			//an element which is not there reads as kValueNotPresent (LLONG_MAX), not 0.
+			if (p_colour && p_colour->bits_per_channel != mkvparser::Colour::kValueNotPresent && p_colour->bits_per_channel > 0)
+			{
+				info.video_bit_depth = static_cast<int>(p_colour->bits_per_channel);
+			}
+		}
+		else if (info.audio_codec.empty() && p_track->GetType() == mkvparser::Track::kAudio)
+		{
+			mkvparser::AudioTrack const* p_audio_track = static_cast<mkvparser::AudioTrack const*>(p_track);
+			info.audio_codec = p_track->GetCodecId();
+			info.audio_sample_rate = static_cast<int>(p_audio_track->GetSamplingRate());
+			info.audio_channels = static_cast<int>(p_audio_track->GetChannels());
+			info.audio_bit_depth = static_cast<int>(p_audio_track->GetBitDepth());
+		}
+	}
 
-					pVideoTrack->GetNext(pBlockEty, pBlockEty);
-				}
+	//the cues are mostly at the end, the seek head says where.
+	if (read_cues && !p_segment->GetCues() && p_segment->GetSeekHead())
+	{
+		mkvparser::SeekHead const* p_seek_head = p_segment->GetSeekHead();
+		for (int i = 0; i < p_seek_head->GetCount(); ++i)
+		{
+			mkvparser::SeekHead::Entry const* p_entry = p_seek_head->GetEntry(i);
+			if (p_entry->id == libwebm::kMkvCues)
+			{
+				s64 parse_pos;
+				long parse_len;
+				p_segment->ParseCues(p_entry->pos, parse_pos, parse_len);
+				break;
+			}
+		}
+	}
 
-				u64 duration_ns_per_frame = pVideoTrack->GetDefaultDuration();
-				if (duration_ns_per_frame)
-				{
-					//mkvparser::SegmentInfo const* const pSegmentInfo = p_segment->GetInfo();
-					////u64 const timeCodeScale = pSegmentInfo->GetTimeCodeScale();
-					//u64 const duration_ns = pSegmentInfo->GetDuration();
-					m_vpx_mov_info->ms_per_frame = duration_ns_per_frame / 1000000;
-					m_vpx_mov_info->duration_s = static_cast<f32>(duration_ns_per_frame / 1000000000.0) * m_vpx_mov_info->frame_count;
-					m_vpx_mov_info->frame_rate = m_vpx_mov_info->frame_count / m_vpx_mov_info->duration_s;
-				}
-				else if (m_vpx_mov_info->frame_rate)
+	mkvparser::Cues const* p_cues = read_cues ? p_segment->GetCues() : NULL;
+	if (p_cues)
+	{
+		if (duration_ns <= 0)
+		{
+			duration_ns = gf_get_cues_duration(p_segment);
+		}
+
+		//a cue point of the video track is a key frame, not every key frame has to have one.
+		if (p_video)
+		{
+			while (p_cues->LoadCuePoint())
+			{
+			}
+
+			info.key_frame_count = 0;
+			for (mkvparser::CuePoint const* p_cue = p_cues->GetFirst(); p_cue; p_cue = p_cues->GetNext(p_cue))
+			{
+				if (p_cue->Find(p_video))
 				{
-					m_vpx_mov_info->ms_per_frame = 1000000000.0 / m_vpx_mov_info->frame_rate;
-					m_vpx_mov_info->duration_s = m_vpx_mov_info->frame_count / m_vpx_mov_info->frame_rate;
+					++info.key_frame_count;
 				}
-				else
-				{
-					mkvparser::SegmentInfo const* const pSegmentInfo = p_segment->GetInfo();
-					u64 const duration_ns = pSegmentInfo->GetDuration();
-					duration_ns_per_frame = duration_ns / m_vpx_mov_info->frame_count;
+			}
+		}
+	}
 
-					m_vpx_mov_info->duration_s = static_cast<f32>(duration_ns / 1000000000.0);
-					m_vpx_mov_info->ms_per_frame = duration_ns_per_frame / 1000000;
-					m_vpx_mov_info->frame_rate = m_vpx_mov_info->frame_count / m_vpx_mov_info->duration_s;
-				}
+	if (duration_ns > 0)
+	{
+		info.duration_s = static_cast<float>(duration_ns / 1000000000.0);
+	}
 
-				m_vpx_mov_info->has_video = true;
+	u64 file_size, file_mtime;
+	sidecar::Index index;
+	bool has_index = p_video && gf_get_file_stat(path.c_str(), &file_size, &file_mtime) &&
+		index.open(sidecar::getPath(path).c_str(), file_size, file_mtime, [&path, file_size]()
+		{
+			u64 hash = 0;
+			FILE* fp = fopen(path.c_str(), "rb");
+			if (fp)
+			{
+				hash = sidecar::hashFile(fp, file_size);
+				fclose(fp);
 			}
-			break;
 
+			return hash;
+		});
 
-			case mkvparser::Track::kAudio:
-				//ofLogError("ofxWebMPlayer", "load(): Audio track is not implemented yet.");
-				{
-					if (!m_enable_audio)
-					{
-						continue;
-					}
+	if (has_index && index.getHeader().video_track == static_cast<u32>(p_video->GetNumber()))
+	{
+		info.frame_count = static_cast<int>(index.getHeader().frame_count);
+		info.key_frame_count = static_cast<int>(index.getHeader().key_count);
+	}
 
-					using namespace mkvparser;
+	return true;
+}
 
-					AudioTrack const* const p_audio_track = static_cast<AudioTrack const*>(p_track);
+bool ofxWebMPlayer::buildIndex(string name)
+{
+	WebMReader reader;
+	std::string path;
 
-					size_t size_of_codec_private;
-					u8* p_data_codec_private = (u8*)p_audio_track->GetCodecPrivate(size_of_codec_private);
+	{
+		ofFile file(name, ofFile::ReadOnly, true);
+		if (!reader.Setup(file))
+		{
+			ofLogError("ofxWebMPlayer", "buildIndex(): Can not read [%s].", name.c_str());
+			return false;
+		}
 
-					// http://matroska.org/technical/specs/codecid/index.html find "A_VORBIS"
-					//
-					// When you want to decode vorbis, you need three header.
-					// Those are Identification header, Comment header and Setup header.
-					// This codec private contains these information.
-					//
-					// https://xiph.org/vorbis/doc/Vorbis_I_spec.html#x1-610004.2.1
-					//
-					//
-					// data format is base on Xiph lacing
-					// http://matroska.org/technical/specs/index.html#lacing
-					//
-					// the byte 1 = number of the packets - 1. 
-					// the byte 2 -> n = the sizes of packets.
-					// the size of the last one packet can be deduced from the total size. 
-					//
-					// the size will be coded like: 
-					// if the size is 800, the code will be 255 255 255 35.
-					// so 255 + 255 + 255 + 35 = 800.
-					//
-					// the byte n+1 -> end = the raw data of three header packets.
-					//
-					// example: 5 packets, A, B, C, D, E
-					// the size of A = 77,
-					// the size of B = 800,
-					// the size of C = 510,
-					// the size of D = 256,
-					// the size of E = 3333,
-					//
-					// the bytes will be:
-					// 1    2               =>                            n    n+1 => end
-					// 4, [77], [255, 255, 255, 35], [255, 255, 0], [255, 1], [raw data]
-					//
-					// ps: E_size = total size - (A_size + B_size + C_size + D_size);
+		path = file.getAbsolutePath();
+	}
 
-					// Because this codec private is for A_VORBIS
-					// byte 1 is must 2 (3 header)
-					// the size of Identification header must be 30 bytes,
-					// byte 2 is must 30,
-					// but the size of other header is unstable, so you need to check.
-					vorbis::Header hdr_id, hdr_comment, hdr_setup;
+	s64 pos;
+	mkvparser::EBMLHeader ebml_header;
+	if (ebml_header.Parse(&reader, pos) < 0)
+	{
+		ofLogError("ofxWebMPlayer", "buildIndex(): This file [%s] is not WebM format", name.c_str());
+		return false;
+	}
 
-					hdr_id.pack.b_o_s = 0;
-					hdr_id.pack.bytes = 0;
-					hdr_id.pack.e_o_s = 0;
-					hdr_id.pack.granulepos = 0;
-					hdr_id.pack.packet = nullptr;
-					hdr_id.pack.packetno = 0;
+	mkvparser::Segment* p_segment;
+	if (mkvparser::Segment::CreateInstance(&reader, pos, p_segment) < 0)
+	{
+		ofLogError("ofxWebMPlayer", "buildIndex(): WebM Segment::CreateInstance() failed.");
+		return false;
+	}
 
-					hdr_setup.pack = hdr_comment.pack = hdr_id.pack;
-					hdr_id.pack.b_o_s = 256;
-					hdr_comment.pack.packetno = 1;
-					hdr_comment.pack.granulepos = -1;
-					hdr_setup.pack.packetno = 2;
+	std::unique_ptr<mkvparser::Segment> up_segment(p_segment);
+	if (p_segment->Load() < 0)
+	{
+		ofLogError("ofxWebMPlayer", "buildIndex(): WebM Segment::Load() failed.");
+		return false;
+	}
 
-					u32 size_hdr_id, size_hdr_comment;
+	std::shared_ptr<MemBlock> sp_mb = reader.GetMemBlockSptr();
 
-					u8* begin = p_data_codec_private;
-					u8* end = begin + size_of_codec_private;
-					u8* ptr = begin;
+	sidecar::FileId file_id;
+	if (!gf_get_file_stat(path.c_str(), &file_id.size, &file_id.mtime))
+	{
+		return false;
+	}
+	file_id.hash = sidecar::hashMemory(sp_mb->get_buffer(), sp_mb->get_size());
 
-					if (*ptr++ != 2)
-					{
-						ofLogError("ofxWebMPlayer", "load()-audio: error");
-						continue;
-					}
+	std::vector<u8> data;
+	if (!sidecar::build(p_segment, file_id, &data))
+	{
+		ofLogError("ofxWebMPlayer", "buildIndex(): [%s] has no video track.", name.c_str());
+		return false;
+	}
 
-					//ps: the size of header id must be 30;
-					size_hdr_id = *ptr++;
-					if (size_hdr_id != 30)
-					{
-						ofLogError("ofxWebMPlayer", "load()-audio: error");
-						continue;
-					}
+	std::string index_path = sidecar::getPath(path);
+	if (!sidecar::writeFile(index_path.c_str(), data))
+	{
+		ofLogError("ofxWebMPlayer", "buildIndex(): Can not write [%s].", index_path.c_str());
+		return false;
+	}
 
-					//The comment header holds the Ogg metadata for an audio track,
-					//and so in principle it can be any length. Here that means that
-					//the length can be represented in the stream using a sequence
-					//comprising multiple bytes, so to determine the length we must
-					//loop until we find a byte whose value is less than 255.
+	return true;
+}
 
-					//decode the size for header comment;
-					size_hdr_comment = 0;
-					bool is_overflow = false;
+void ofxWebMPlayer::enableResourcePool(bool yes)
+{
+	pool::ResourcePool::instance().setEnabled(yes);
+}
 
-					for (;;)
-					{
-						u8 value = *ptr++;
+void ofxWebMPlayer::setResourcePoolMemoryLimit(size_t bytes)
+{
+	pool::ResourcePool::instance().setMemBlockLimit(bytes);
+}
 
-						if (ptr >= end)
-						{
-							is_overflow = true;
-							break;
-						}
+void ofxWebMPlayer::clearResourcePool()
+{
+	pool::ResourcePool::instance().clear();
+}
 
-						size_hdr_comment += value;
+void ofxWebMPlayer::setMemoryBudget(size_t bytes)
+{
+	memory::Budget::instance().setLimit(bytes);
+}
 
-						if (value < 255)
-							break;
-					}
+size_t ofxWebMPlayer::getTotalMemoryBytes()
+{
+	return memory::Budget::instance().getTotal();
+}
 
-					if (is_overflow)
-					{
-						ofLogError("ofxWebMPlayer", "load()-audio: error");
-						continue;
-					}
+void ofxWebMPlayer::enableTrace(bool yes, size_t events_per_thread)
+{
+	trace::Tracer::instance().setEnabled(yes, events_per_thread);
+}
 
-					//Each vorbis header begins with a byte having a distinguished
-					//value that specifies what kind of header this is, followed
-					//by the string "vorbis".  Therefore each well-formed header
-					//must be at least 7 bytes long.
+bool ofxWebMPlayer::dumpTrace(string path)
+{
+	bool yes = trace::Tracer::instance().dump(ofToDataPath(path, true).c_str());
+	if (!yes)
+	{
+		ofLogError("ofxWebMPlayer", "dumpTrace(): Failed to write [%s].", path.c_str());
+	}
 
-					if (size_hdr_comment < 7)
-					{
-						ofLogError("ofxWebMPlayer", "load()-audio: error");
-						continue;
-					}
+	return yes;
+}
 
-					//We have consumed the sequence of bytes used to represent
-					//the lengths of the individual headers.  What remains in
-					//the stream are the actual headers.  Here we don't particularly
-					//care much about the actual header payload (we defer such
-					//matters to the Vorbis decoder), but we do interrogate the
-					//first 7 bytes of each header to confirm that the headers
-					//have their correct Vorbis header-kind indicators.
+void ofxWebMPlayer::clearTrace()
+{
+	trace::Tracer::instance().clear();
+}
 
-					//p points the first header (the ident header)
-					//The Vorbis ident header has 1 as its kind indicator.
-					if (memcmp(ptr, "\x01vorbis", 7) != 0)
-					{
-						ofLogError("ofxWebMPlayer", "load()-audio: error");
-						continue;
-					}
+void ofxWebMPlayer::setAudioOutputSettings(AudioOutputSettings const& settings)
+{
+	g_audio_output_settings = settings;
+	g_audio_output_settings.num_channels = std::min(std::max(settings.num_channels, 1), static_cast<int>(audio::MaxChannels));
+}
 
-					hdr_id.pack.packet = ptr;
-					hdr_id.pack.bytes = size_hdr_id;
+ofxWebMPlayer::AudioOutputSettings const& ofxWebMPlayer::getAudioOutputSettings()
+{
+	return g_audio_output_settings;
+}
 
-					ptr += size_hdr_id;
+void ofxWebMPlayer::closeAudioOutput()
+{
+	audio::Mixer::instance().close();
+}
 
-					//The Vorbis comment header has 3 as its kind indicator.
-					if (memcmp(ptr, "\x03vorbis", 7) != 0)
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+void ofxWebMPlayer::logAudioKernelThroughput()
+{
+	audio::kernel::Table const& scalar = audio::kernel::scalarTable();
+	audio::kernel::Table const& best = audio::kernel::get();
+
+	u32 const channels[] = { 1, 2, 6 };
+	for (u32 c : channels)
+	{
+		f64 sps_scalar = audio::kernel::measureInterleave(scalar, c, 4096, 200);
+		f64 sps_best = audio::kernel::measureInterleave(best, c, 4096, 200);
+		ofLogNotice("ofxWebMPlayer", "interleave %uch: scalar %.1f Msamples/s, %s %.1f Msamples/s",
+			c, sps_scalar / 1000000.0, best.name, sps_best / 1000000.0);
+	}
+}
+#endif
+
+void ofxWebMPlayer::setAudioStorage(AudioStorage storage)
+{
+	m_audio_storage = storage;
+}
+
+size_t ofxWebMPlayer::getAudioMemoryBytes() const
+{
+	if (!m_vpx_mov_info->sp_pcm_store)
+	{
+		return 0;
+	}
+
+	return m_vpx_mov_info->sp_pcm_store->getMemoryBytes();
+}
+
+size_t ofxWebMPlayer::getIndexMemoryBytes() const
+{
+	return m_vpx_mov_info->frame_index.getMemoryBytes();
+}
+
+ofxWebMPlayer::MemoryUsage ofxWebMPlayer::getMemoryUsage() const
+{
+	memory::Account const& account = m_vpx_mov_info->memory_account;
+
+	MemoryUsage usage;
+	usage.movie_bytes = account.get(memory::KindMovie);
+	usage.audio_bytes = account.get(memory::KindAudio);
+	usage.index_bytes = account.get(memory::KindIndex);
+	usage.decoder_bytes = account.get(memory::KindDecoder);
+	usage.gpu_bytes = account.get(memory::KindGpu);
+	usage.total_bytes = account.getTotal();
+	usage.is_degraded = m_vpx_mov_info->is_degraded;
+	return usage;
+}
+
+//the counters, the gauges are left to the caller.
+static void gf_fill_stats(stats::Counters const& counters, ofxWebMPlayer::Stats* p_out)
+{
+	memset(p_out, 0x00, sizeof(*p_out));
+	p_out->bytes_read = counters.get(stats::CounterBytesRead);
+	p_out->frames_decoded = counters.get(stats::CounterFramesDecoded);
+	p_out->frames_presented = counters.get(stats::CounterFramesPresented);
+	p_out->frames_dropped = counters.get(stats::CounterFramesDropped);
+	p_out->texture_bytes_uploaded = counters.get(stats::CounterTextureBytes);
+	p_out->audio_callbacks = counters.get(stats::CounterAudioCallbacks);
+	p_out->audio_frames_out = counters.get(stats::CounterAudioFrames);
+	p_out->seeks = counters.get(stats::CounterSeeks);
+	p_out->loads = counters.get(stats::CounterLoads);
+	p_out->catch_up_depth_max = static_cast<unsigned int>(counters.get(stats::CounterCatchUpMax));
+}
+
+void ofxWebMPlayer::getStats(Stats* p_out) const
+{
+	if (!p_out)
+	{
+		return;
+	}
+
+	gf_fill_stats(m_vpx_mov_info->stats, p_out);
+	p_out->catch_up_depth = m_vpx_mov_info->catch_up_depth;
+	p_out->players = 1;
+	p_out->memory_bytes = m_vpx_mov_info->memory_account.getTotal();
+
+	//the audio thread moves the play head, the fill level is a snapshot.
+	if (m_vpx_mov_info->has_audio && m_vpx_mov_info->sp_pcm_store)
+	{
+		u64 const total = m_vpx_mov_info->sp_pcm_store->getFrames();
+		p_out->pcm_frames_total = total;
+		p_out->pcm_frames_left = total - std::min<u64>(total, m_vpx_mov_info->audio_cur_frame);
+	}
+}
+
+void ofxWebMPlayer::resetStats()
+{
+	m_vpx_mov_info->stats.reset();
+}
+
+void ofxWebMPlayer::getGlobalStats(Stats* p_out)
+{
+	if (!p_out)
+	{
+		return;
+	}
+
+	gf_fill_stats(stats::global().counters, p_out);
+	p_out->players = stats::global().players;
+	p_out->memory_bytes = memory::Budget::instance().getTotal();
+}
+
+void ofxWebMPlayer::resetGlobalStats()
+{
+	stats::global().counters.reset();
+}
+
+void ofxWebMPlayer::formatStats(Stats const& stats, std::string* p_out, std::string const& prefix)
+{
+	if (!p_out)
+	{
+		return;
+	}
+
+	typedef struct Line
+	{
+		char const*	name;
+		u64			value;
+	} Line;
+
+	Line const lines[] =
+	{
+		{ "bytes_read", stats.bytes_read },
+		{ "frames_decoded", stats.frames_decoded },
+		{ "frames_presented", stats.frames_presented },
+		{ "frames_dropped", stats.frames_dropped },
+		{ "texture_bytes_uploaded", stats.texture_bytes_uploaded },
+		{ "audio_callbacks", stats.audio_callbacks },
+		{ "audio_frames_out", stats.audio_frames_out },
+		{ "seeks", stats.seeks },
+		{ "loads", stats.loads },
+		{ "catch_up_depth", stats.catch_up_depth },
+		{ "catch_up_depth_max", stats.catch_up_depth_max },
+		{ "pcm_frames_total", stats.pcm_frames_total },
+		{ "pcm_frames_left", stats.pcm_frames_left },
+		{ "players", stats.players },
+		{ "memory_bytes", stats.memory_bytes },
+	};
+
+	for (Line const& line : lines)
+	{
+		p_out->append(prefix).append(line.name).append(" ").append(std::to_string(line.value)).append("\n");
+	}
+}
+
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+void ofxWebMPlayer::enableStageTiming(bool yes)
+{
+	if (yes && !m_vpx_mov_info->up_stage_timing)
+	{
+		m_vpx_mov_info->up_stage_timing.reset(new timing::Histogram[STAGE_COUNT]);
+	}
+
+	//the histograms stay until the player goes, the audio thread may be in one.
+	m_vpx_mov_info->p_stage_timing = yes ? m_vpx_mov_info->up_stage_timing.get() : NULL;
+}
+
+void ofxWebMPlayer::resetStageTiming()
+{
+	if (!m_vpx_mov_info->up_stage_timing)
+	{
+		return;
+	}
+
+	for (u32 i = 0; i < STAGE_COUNT; ++i)
+	{
+		m_vpx_mov_info->up_stage_timing[i].reset();
+	}
+}
+
+bool ofxWebMPlayer::getStageTiming(Stage stage, StageTiming* p_out) const
+{
+	if (!p_out || stage >= STAGE_COUNT || !m_vpx_mov_info->up_stage_timing)
+	{
+		return false;
+	}
+
+	timing::Histogram const& histogram = m_vpx_mov_info->up_stage_timing[stage];
+	p_out->count = histogram.getCount();
+	p_out->total_ns = histogram.getTotal();
+	p_out->p50_ns = histogram.getPercentile(0.50);
+	p_out->p95_ns = histogram.getPercentile(0.95);
+	p_out->p99_ns = histogram.getPercentile(0.99);
+	p_out->max_ns = histogram.getMax();
+	return true;
+}
+
+char const* ofxWebMPlayer::getStageName(Stage stage)
+{
+	static char const* s_names[STAGE_COUNT] =
+	{
+		"read",
+		"demux",
+		"decode",
+		"convert",
+		"upload",
+		"fbo",
+		"audio callback",
+	};
+
+	return stage < STAGE_COUNT ? s_names[stage] : "";
+}
+
+void ofxWebMPlayer::logStageTiming() const
+{
+	for (u32 i = 0; i < STAGE_COUNT; ++i)
+	{
+		StageTiming t;
+		if (!getStageTiming(static_cast<Stage>(i), &t) || !t.count)
+		{
+			continue;
+		}
+
+		ofLogNotice("ofxWebMPlayer", "%-14s n %8llu  p50 %9.3f  p95 %9.3f  p99 %9.3f  max %9.3f us", getStageName(static_cast<Stage>(i)), t.count,
+			t.p50_ns * 0.001, t.p95_ns * 0.001, t.p99_ns * 0.001, t.max_ns * 0.001);
+	}
+}
+
+#endif
+
+void ofxWebMPlayer::setPan(float pan)
+{
+	m_pan = ofClamp(pan, -1.f, 1.f);
+}
+
+bool ofxWebMPlayer::load(string name)
+{
+	//mf_unload();
+	mf_join_load();
+
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+	m_vpx_mov_info->us_load_begin = ofGetElapsedTimeMicros();
+
+#endif
+	m_vpx_mov_info->is_degraded = false;
+	mf_reserve_memory(name);
+	return mf_load_movie(name) && mf_load_gl();
+}
+
+void ofxWebMPlayer::loadAsync(string name)
+{
+	mf_join_load();
+
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+	m_vpx_mov_info->us_load_begin = ofGetElapsedTimeMicros();
+
+#endif
+	m_vpx_mov_info->is_degraded = false;
+	mf_reserve_memory(name);
+	m_vpx_mov_info->async_state = AsyncLoading;
+	m_vpx_mov_info->load_thread = std::thread([this, name]()
+	{
+		bool yes = mf_load_movie(name);
+		m_vpx_mov_info->async_state = yes ? AsyncReady : AsyncFailed;
+	});
+}
+
+//makes room under the memory budget for the file of the next load.
+void ofxWebMPlayer::mf_reserve_memory(string const& name)
+{
+	u64 file_size, file_mtime;
+	if (!gf_get_file_stat(ofToDataPath(name, true).c_str(), &file_size, &file_mtime))
+	{
+		file_size = 0;
+	}
+
+	memory::Account& account = m_vpx_mov_info->memory_account;
+	account.last_active_millis = ofGetElapsedTimeMillis();
+	memory::Budget::instance().enforce(&account, static_cast<size_t>(file_size));
+}
+
+//everything of load() but the GL, it runs on the thread of loadAsync().
+bool ofxWebMPlayer::mf_load_movie(string name)
+{
+	trace::Scope trace_scope("load.movie", m_vpx_mov_info->trace_id);
+	std::unique_ptr<WebMReader> up_reader(new WebMReader);
+	WebMReader& reader = *up_reader;
+	std::shared_ptr<sidecar::Index> sp_index;
+
+	{
+		ofFile file(name, ofFile::ReadOnly, true);
+		bool yes;
+		{
+			trace::Scope trace_scope("load.read", m_vpx_mov_info->trace_id);
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+			timing::Scope scope(gf_get_stage(m_vpx_mov_info->p_stage_timing, STAGE_READ));
+
+#endif
+			yes = reader.Setup(file);
+		}
+
+		if (!yes)
+		{
+			return false;
+		}
+
+		stats::add(&m_vpx_mov_info->stats, stats::CounterBytesRead, reader.GetMemBlockSptr()->get_size());
+
+		if (m_enable_live)
+		{
+			m_vpx_mov_info->live_path = file.getAbsolutePath();
+			m_vpx_mov_info->live_poll_millis = mf_get_millis();
+		}
+		else if (m_enable_index)
+		{
+			std::string path = file.getAbsolutePath();
+			std::shared_ptr<MemBlock> sp_mb = reader.GetMemBlockSptr();
+
+			u64 file_size, file_mtime;
+			sp_index = std::make_shared<sidecar::Index>();
+			yes = gf_get_file_stat(path.c_str(), &file_size, &file_mtime) &&
+				sp_index->open(sidecar::getPath(path).c_str(), file_size, file_mtime, [&sp_mb]()
+				{
+					return sidecar::hashMemory(sp_mb->get_buffer(), sp_mb->get_size());
+				});
+
+			if (yes)
+			{
+				ofLogNotice("ofxWebMPlayer", "load(): Using the index of [%s].", name.c_str());
+			}
+			else
+			{
+				sp_index = nullptr;
+			}
+		}
+	}
+
+	do
+	{
+		s64 ret;
+		std::vector<TrackDesc> tracks;
+		s64 duration_ns = -1;
+		bool is_scanned = false;
+		u32 scan_video_track = 0;
+		u32 scan_audio_track = 0;
+		m_vpx_mov_info->sp_mb_movie_body = reader.GetMemBlockSptr();
+
+		//the index has the blocks already, it only needs the track headers from mkvparser.
+		bool const is_live = m_enable_live;
+		bool const is_stream = (m_demuxer == DEMUXER_WEBM_PARSER || is_live) && !sp_index;
+		bool const is_lazy = m_enable_lazy_load && !sp_index && !is_stream;
+
+		if (is_stream)
+		{
+			MemBlock* p_mb = m_vpx_mov_info->sp_mb_movie_body.get();
+			m_vpx_mov_info->up_stream_reader.reset(new WebMStreamReader);
+			m_vpx_mov_info->up_stream_reader->SetBuffer(p_mb->get_buffer(), 0, p_mb->get_size(), !is_live);
+
+			m_vpx_mov_info->up_demuxer.reset(new WebMDemuxer);
+			WebMDemuxer* p_demuxer = m_vpx_mov_info->up_demuxer.get();
+			p_demuxer->setup(&m_vpx_mov_info->frame_index, &m_vpx_mov_info->box_audio_packet);
+
+			//the headers and the first frame, the rest is fed as the playback goes.
+			//Live takes everything written so far, the playback starts near the end.
+			WebMDemuxer::Result result = p_demuxer->feed(m_vpx_mov_info->up_stream_reader.get(), is_live ? UINT_MAX : 0);
+			if (is_live)
+			{
+				result = static_cast<WebMDemuxer::Result>(mf_wait_live_start(&reader, result));
+			}
+
+			if (result == WebMDemuxer::RESULT_ERROR || !p_demuxer->isTracksDone())
+			{
+				ofLogError("ofxWebMPlayer", "ofxWebMPlayer::load(): This file [%s] is not WebM format", name.c_str());
+				break;
+			}
+
+			tracks = p_demuxer->getTracks();
+			duration_ns = p_demuxer->getDurationNs();
+			for (TrackDesc& desc : tracks)
+			{
+				if (desc.type == mkvparser::Track::kVideo && !desc.frame_rate && !desc.default_duration_ns)
+				{
+					//once, a live capture is not measured again as it grows, that
+					//would move the clock to another frame, maybe back in the GOP.
+					desc.frame_rate = p_demuxer->getVideoFrameRate();
+				}
+			}
+
+			//the audio is decoded up front, it needs every packet.
+			bool has_audio_track = false;
+			for (TrackDesc const& desc : tracks)
+			{
+				has_audio_track = has_audio_track || desc.type == mkvparser::Track::kAudio;
+			}
+
+			if (m_enable_audio && has_audio_track && !is_live)
+			{
+				p_demuxer->feed(m_vpx_mov_info->up_stream_reader.get(), UINT_MAX);
+			}
+		}
+		else
+		{
+			s64 pos;
+			mkvparser::EBMLHeader ebml_header;
+			ret = ebml_header.Parse(&reader, pos);
+			if (ret < 0)
+			{
+				ofLogError("ofxWebMPlayer", "ofxWebMPlayer::load(): This file [%s] is not WebM format", name.c_str());
+				break;
+			}
+
+			mkvparser::Segment* p_segment;
+			ret = mkvparser::Segment::CreateInstance(&reader, pos, p_segment);
+			if (ret < 0)
+			{
+				ofLogError("ofxWebMPlayer", "load(): WebM Segment::CreateInstance() failed.");
+				break;
+			}
+
+			m_vpx_mov_info->up_segment.reset(p_segment);
+
+			//With an index only the headers are needed, the blocks are already known.
+			//The lazy load parses the headers and the first cluster, the next clusters
+			//are loaded when the track walks into them (the bytes are all in the movie
+			//block already). Otherwise, with setIndexThreads() other than 1, the
+			//clusters are scanned in parallel, Segment::Load() is the fallback.
+			bool const is_scan = !sp_index && !is_lazy && m_index_threads != 1;
+			trace::Scope trace_scope("load.demux", m_vpx_mov_info->trace_id);
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+			timing::Scope scope(gf_get_stage(m_vpx_mov_info->p_stage_timing, STAGE_DEMUX));
+
+#endif
+			if (sp_index || is_lazy || is_scan)
+			{
+				ret = p_segment->ParseHeaders();
+				if (ret >= 0 && is_lazy)
+				{
+					ret = p_segment->LoadCluster();
+				}
+				else if (ret >= 0 && is_scan)
+				{
+					is_scanned = mf_scan_clusters(p_segment, &scan_video_track, &scan_audio_track);
+					if (!is_scanned)
 					{
-						ofLogError("ofxWebMPlayer", "load()-audio: error");
-						continue;
+						ret = p_segment->Load();
 					}
+				}
+			}
+			else
+			{
+				ret = p_segment->Load();
+			}
 
-					hdr_comment.pack.packet = ptr;
-					hdr_comment.pack.bytes = size_hdr_comment;
+			if (ret < 0)
+			{
+				ofLogError("ofxWebMPlayer", "load(): WebM Segment::Load() failed.");
+				break;
+			}
+
+			mkvparser::Tracks const* p_tracks = p_segment->GetTracks();
+			u32 const num_tracks = p_tracks->GetTracksCount();
+			for (u32 i = 0; i < num_tracks; ++i)
+			{
+				mkvparser::Track const* const p_track = p_tracks->GetTrackByIndex(i);
+				if (p_track != NULL)
+				{
+					tracks.push_back(gf_describe_track(p_track));
+					tracks.back().has_alpha = p_track->GetType() == mkvparser::Track::kVideo && gf_read_alpha_mode(&reader, p_track);
+				}
+			}
+
+			duration_ns = p_segment->GetInfo()->GetDuration();
+			if (duration_ns <= 0)
+			{
+				duration_ns = gf_get_cues_duration(p_segment);
+			}
+		}
+
+		m_vpx_mov_info->sp_index = sp_index;
+
+		for (TrackDesc const& desc : tracks)
+		{
+			switch (desc.type)
+			{
+			case mkvparser::Track::kVideo:
+			{
+				const char* codec_id = desc.codec_id.c_str();
+				vpx_codec_iface_t* p_iface = NULL;
+
+				if (strcmp(codec_id, "V_VP8") == 0)
+				{
+					p_iface = vpx_codec_vp8_dx();
+				}
+				else if (strcmp(codec_id, "V_VP9") == 0)
+				{
+					p_iface = vpx_codec_vp9_dx();
+				}
+				else
+				{
+					ofLogError("ofxWebMPlayer", "load()-video: This codec [%s] is not support.", codec_id);
+					continue;
+				}
+
+				m_vpx_mov_info->vpx_flags = 0;
+				// Initialize codec
+				m_vpx_mov_info->vpx_cfg.threads = 8;
+				m_vpx_mov_info->vpx_cfg.w = 0;
+				m_vpx_mov_info->vpx_cfg.h = 0;
+
+				//a decoder of the same codec and size left by a closed player, or a new one.
+				m_vpx_mov_info->decoder_width = desc.width;
+				m_vpx_mov_info->decoder_height = desc.height;
+				if (!pool::ResourcePool::instance().acquireDecoder(p_iface, desc.width, desc.height, &m_vpx_mov_info->vpx_ctx))
+				{
+					vpx_codec_err_t err = vpx_codec_dec_init(&m_vpx_mov_info->vpx_ctx, p_iface, &m_vpx_mov_info->vpx_cfg, m_vpx_mov_info->vpx_flags);
+					if (err)
+					{
+						gf_trace_codec_error(&m_vpx_mov_info->vpx_ctx, "load()-video: Failed to initialize the decoder of VPX.");
+						continue;
+					}
+				}
+
+				m_vpx_mov_info->vpx_if = p_iface;
+
+				ofLogNotice("ofxWebMPlayer", "load()-video: Now vpx codec is using %s.", vpx_codec_iface_name(m_vpx_mov_info->vpx_if));
+
+				m_vpx_mov_info->up_alpha = nullptr;
+				m_vpx_mov_info->is_alpha_opaque = false;
+				if (desc.has_alpha)
+				{
+					m_vpx_mov_info->up_alpha.reset(new alpha::Decoder);
+					if (!m_vpx_mov_info->up_alpha->setup(p_iface, desc.width, desc.height))
+					{
+						ofLogWarning("ofxWebMPlayer", "load()-video: Failed to initialize the decoder of the alpha, it is opaque.");
+						m_vpx_mov_info->up_alpha = nullptr;
+					}
+				}
+
+				m_vpx_mov_info->frame_rate = static_cast<f32>(desc.frame_rate);
+				m_vpx_mov_info->frame_count = 0;
+				m_vpx_mov_info->width = desc.width; //Pixels width//
+				m_vpx_mov_info->height = desc.height; //Pixels height//
+
+				if (sp_index && sp_index->getHeader().video_track == desc.number)
+				{
+					//no parsing, but the frames still go into the compact index.
+					u32 const frame_count = sp_index->getHeader().frame_count;
+					VpxFrameInfo const* p_frames = sp_index->getFrames();
+					s64 const* p_times = sp_index->getFrameTimes();
+					FrameIndex& frame_index = m_vpx_mov_info->frame_index;
+					frame_index.reserve(frame_count);
+					for (u32 i = 0; i < frame_count; ++i)
+					{
+						frame_index.push(p_frames[i].pos, p_frames[i].len, p_times[i], p_frames[i].idx_key == static_cast<s32>(i));
+					}
+
+					m_vpx_mov_info->frame_count = frame_count;
+					m_vpx_mov_info->is_index_done = true;
+				}
+				else if (is_scanned && scan_video_track == desc.number)
+				{
+					m_vpx_mov_info->frame_count = static_cast<u32>(m_vpx_mov_info->frame_index.size());
+					m_vpx_mov_info->is_index_done = true;
+				}
+				else
+				{
+					m_vpx_mov_info->p_video_track = desc.p_mkv_track;
+					m_vpx_mov_info->p_next_block = NULL;
+					m_vpx_mov_info->is_index_done = false;
+					if (desc.p_mkv_track)
+					{
+						desc.p_mkv_track->GetFirst(m_vpx_mov_info->p_next_block);
+					}
+
+					//from the duration, or the last cue, so the index grows without copies.
+					u32 estimate = gf_estimate_frame_count(duration_ns, desc.frame_rate, desc.default_duration_ns);
+					m_vpx_mov_info->frame_index.reserve(estimate);
+					if (estimate && (is_lazy || is_stream))
+					{
+						m_vpx_mov_info->frame_count = estimate;
+						mf_index_frames(0);
+					}
+					else
+					{
+						mf_index_frames(UINT_MAX);
+					}
+				}
+
+				u64 duration_ns_per_frame = desc.default_duration_ns;
+				if (duration_ns_per_frame)
+				{
+					//mkvparser::SegmentInfo const* const pSegmentInfo = p_segment->GetInfo();
+					////u64 const timeCodeScale = pSegmentInfo->GetTimeCodeScale();
+					//u64 const duration_ns = pSegmentInfo->GetDuration();
+					m_vpx_mov_info->ms_per_frame = duration_ns_per_frame / 1000000;
+					m_vpx_mov_info->duration_s = static_cast<f32>(duration_ns_per_frame / 1000000000.0) * m_vpx_mov_info->frame_count;
+					m_vpx_mov_info->frame_rate = m_vpx_mov_info->frame_count / m_vpx_mov_info->duration_s;
+				}
+				else if (m_vpx_mov_info->frame_rate)
+				{
+					m_vpx_mov_info->ms_per_frame = 1000000000.0 / m_vpx_mov_info->frame_rate;
+					m_vpx_mov_info->duration_s = m_vpx_mov_info->frame_count / m_vpx_mov_info->frame_rate;
+				}
+				else
+				{
+					if (duration_ns <= 0 || !m_vpx_mov_info->frame_count)
+					{
+						ofLogError("ofxWebMPlayer", "load()-video: The frame rate is unknown.");
+						continue;
+					}
+
+					duration_ns_per_frame = duration_ns / m_vpx_mov_info->frame_count;
+
+					m_vpx_mov_info->duration_s = static_cast<f32>(duration_ns / 1000000000.0);
+					m_vpx_mov_info->ms_per_frame = duration_ns_per_frame / 1000000;
+					m_vpx_mov_info->frame_rate = m_vpx_mov_info->frame_count / m_vpx_mov_info->duration_s;
+				}
+
+				ofLogNotice("ofxWebMPlayer", "load()-video: %u frames indexed, %u KB of index.",
+					static_cast<u32>(m_vpx_mov_info->frame_index.size()), static_cast<u32>(m_vpx_mov_info->frame_index.getMemoryBytes() / 1024));
+
+				m_vpx_mov_info->has_video = true;
+			}
+			break;
+
+
+			case mkvparser::Track::kAudio:
+				//ofLogError("ofxWebMPlayer", "load(): Audio track is not implemented yet.");
+				{
+					if (!m_enable_audio)
+					{
+						continue;
+					}
+
+					if (is_live)
+					{
+						ofLogWarning("ofxWebMPlayer", "load()-audio: The audio is not played in the live mode.");
+						continue;
+					}
+
+					size_t size_of_codec_private = desc.codec_private.size();
+					u8* p_data_codec_private = (u8*)desc.codec_private.data();
+					if (!size_of_codec_private)
+					{
+						ofLogError("ofxWebMPlayer", "load()-audio: error");
+						continue;
+					}
+
+					// http://matroska.org/technical/specs/codecid/index.html find "A_VORBIS"
+					//
+					// When you want to decode vorbis, you need three header.
+					// Those are Identification header, Comment header and Setup header.
+					// This codec private contains these information.
+					//
+					// https://xiph.org/vorbis/doc/Vorbis_I_spec.html#x1-610004.2.1
+					//
+					//
+					// data format is base on Xiph lacing
+					// http://matroska.org/technical/specs/index.html#lacing
+					//
+					// the byte 1 = number of the packets - 1. 
+					// the byte 2 -> n = the sizes of packets.
+					// the size of the last one packet can be deduced from the total size. 
+					//
+					// the size will be coded like: 
+					// if the size is 800, the code will be 255 255 255 35.
+					// so 255 + 255 + 255 + 35 = 800.
+					//
+					// the byte n+1 -> end = the raw data of three header packets.
+					//
+					// example: 5 packets, A, B, C, D, E
+					// the size of A = 77,
+					// the size of B = 800,
+					// the size of C = 510,
+					// the size of D = 256,
+					// the size of E = 3333,
+					//
+					// the bytes will be:
+					// 1    2               =>                            n    n+1 => end
+					// 4, [77], [255, 255, 255, 35], [255, 255, 0], [255, 1], [raw data]
+					//
+					// ps: E_size = total size - (A_size + B_size + C_size + D_size);
+
+					// Because this codec private is for A_VORBIS
+					// byte 1 is must 2 (3 header)
+					// the size of Identification header must be 30 bytes,
+					// byte 2 is must 30,
+					// but the size of other header is unstable, so you need to check.
+					vorbis::Header hdr_id, hdr_comment, hdr_setup;
+
+					hdr_id.pack.b_o_s = 0;
+					hdr_id.pack.bytes = 0;
+					hdr_id.pack.e_o_s = 0;
+					hdr_id.pack.granulepos = 0;
+					hdr_id.pack.packet = nullptr;
+					hdr_id.pack.packetno = 0;
+
+					hdr_setup.pack = hdr_comment.pack = hdr_id.pack;
+					hdr_id.pack.b_o_s = 256;
+					hdr_comment.pack.packetno = 1;
+					hdr_comment.pack.granulepos = -1;
+					hdr_setup.pack.packetno = 2;
+
+					u32 size_hdr_id, size_hdr_comment;
+
+					u8* begin = p_data_codec_private;
+					u8* end = begin + size_of_codec_private;
+					u8* ptr = begin;
+
+					if (*ptr++ != 2)
+					{
+						ofLogError("ofxWebMPlayer", "load()-audio: error");
+						continue;
+					}
+
+					//ps: the size of header id must be 30;
+					size_hdr_id = *ptr++;
+					if (size_hdr_id != 30)
+					{
+						ofLogError("ofxWebMPlayer", "load()-audio: error");
+						continue;
+					}
+
+					//The comment header holds the Ogg metadata for an audio track,
+					//and so in principle it can be any length. Here that means that
+					//the length can be represented in the stream using a sequence
+					//comprising multiple bytes, so to determine the length we must
+					//loop until we find a byte whose value is less than 255.
+
+					//decode the size for header comment;
+					size_hdr_comment = 0;
+					bool is_overflow = false;
+
+					for (;;)
+					{
+						u8 value = *ptr++;
+
+						if (ptr >= end)
+						{
+							is_overflow = true;
+							break;
+						}
+
+						size_hdr_comment += value;
+
+						if (value < 255)
+							break;
+					}
+
+					if (is_overflow)
+					{
+						ofLogError("ofxWebMPlayer", "load()-audio: error");
+						continue;
+					}
+
+					//Each vorbis header begins with a byte having a distinguished
+					//value that specifies what kind of header this is, followed
+					//by the string "vorbis".  Therefore each well-formed header
+					//must be at least 7 bytes long.
+
+					if (size_hdr_comment < 7)
+					{
+						ofLogError("ofxWebMPlayer", "load()-audio: error");
+						continue;
+					}
+
+					//We have consumed the sequence of bytes used to represent
+					//the lengths of the individual headers.  What remains in
+					//the stream are the actual headers.  Here we don't particularly
+					//care much about the actual header payload (we defer such
+					//matters to the Vorbis decoder), but we do interrogate the
+					//first 7 bytes of each header to confirm that the headers
+					//have their correct Vorbis header-kind indicators.
+
+					//p points the first header (the ident header)
+					//The Vorbis ident header has 1 as its kind indicator.
+					if (memcmp(ptr, "\x01vorbis", 7) != 0)
+					{
+						ofLogError("ofxWebMPlayer", "load()-audio: error");
+						continue;
+					}
+
+					hdr_id.pack.packet = ptr;
+					hdr_id.pack.bytes = size_hdr_id;
+
+					ptr += size_hdr_id;
+
+					//The Vorbis comment header has 3 as its kind indicator.
+					if (memcmp(ptr, "\x03vorbis", 7) != 0)
+					{
+						ofLogError("ofxWebMPlayer", "load()-audio: error");
+						continue;
+					}
+
+					hdr_comment.pack.packet = ptr;
+					hdr_comment.pack.bytes = size_hdr_comment;
+
+					ptr += size_hdr_comment;
+
+					if (memcmp(ptr, "\x05vorbis", 7) != 0)
+					{
+						ofLogError("ofxWebMPlayer", "load()-audio: error");
+						continue;
+					}
+
+					hdr_setup.pack.packet = ptr;
+					hdr_setup.pack.bytes = static_cast<long>(end - ptr);
+
+					if (hdr_setup.pack.bytes < 7)
+					{
+						ofLogError("ofxWebMPlayer", "load()-audio: error");
+						continue;
+					}
+
+
+					//We are satisfied that the CodecPrivate value is well-formed,
+					//and so we now create the audio stream for this movie;
+					vorbis::Decoder decoder;
+					std::unique_ptr<vorbis::OggPacketStreamer> up_streamer;
+					if (sp_index && sp_index->getHeader().audio_track == desc.number)
+					{
+						up_streamer.reset(new OggPacketStreamerForIndex(m_vpx_mov_info->sp_mb_movie_body, sp_index->getAudioPackets(), sp_index->getHeader().audio_packet_count));
+					}
+					else if (is_stream || (is_scanned && scan_audio_track == desc.number))
+					{
+						std::vector<sidecar::AudioPacket> const& box = m_vpx_mov_info->box_audio_packet;
+						up_streamer.reset(new OggPacketStreamerForIndex(m_vpx_mov_info->sp_mb_movie_body, box.data(), static_cast<u32>(box.size())));
+					}
+					else
+					{
+						//the audio is decoded up front, this loads every cluster even with the lazy load.
+						up_streamer.reset(new OggPacketStreamerForWebm(m_vpx_mov_info->sp_mb_movie_body, static_cast<mkvparser::AudioTrack const*>(desc.p_mkv_track)));
+					}
+
+					bool yes = decoder.init(hdr_id, hdr_comment, hdr_setup);
+					if (!yes)
+					{
+						ofLogError("ofxWebMPlayer", "load()-audio: decoder init failed.");
+						continue;
+					}
+
+					m_vpx_mov_info->sp_pcm_store = std::shared_ptr< audio::PcmStore >(new audio::PcmStore);
+					trace::Scope trace_scope("load.audio", m_vpx_mov_info->trace_id);
+					yes = vorbis::readOggPakcetStreamer(&m_vpx_mov_info->audio_info, m_vpx_mov_info->sp_pcm_store.get(), static_cast<audio::PcmFormat>(m_audio_storage), up_streamer.get(), &decoder);
+					if (!yes)
+					{
+						m_vpx_mov_info->sp_pcm_store = nullptr;
+						ofLogError("ofxWebMPlayer", "load()-audio: decoder init failed.");
+						continue;
+					}
+
+					ofLogNotice("ofxWebMPlayer", "load()-audio: %u Hz, %u channels, %u bits per sample, %u KB.",
+						m_vpx_mov_info->audio_info.sample_rate, m_vpx_mov_info->audio_info.num_of_channel,
+						m_vpx_mov_info->audio_info.bits_per_sample, static_cast<u32>(m_vpx_mov_info->sp_pcm_store->getMemoryBytes() / 1024));
+
+					m_vpx_mov_info->has_audio = true;
+				}
+				break;
+
+			case mkvparser::Track::kSubtitle:
+				ofLogError("ofxWebMPlayer", "load(): Subtitle track is not implemented yet.");
+				break;
+
+			case mkvparser::Track::kMetadata:
+				ofLogError("ofxWebMPlayer", "load(): Metadata track is not implemented yet.");
+				break;
+			}
+		}
+
+		if (!m_vpx_mov_info->has_video || !m_vpx_mov_info->frame_count)
+		{
+			ofLogError("ofxWebMPlayer", "load(): No video frame in [%s].", name.c_str());
+			break;
+		}
+
+		m_vpx_mov_info->cur_mov_frame_idx = 0;
+		m_vpx_mov_info->pre_tick_millis = 0;
+		m_vpx_mov_info->total_tick_mills = 0;
+
+		FrameIndex::Frame const f_info = m_vpx_mov_info->frame_index.get(0);
+		{
+			trace::Scope trace_scope("decode", m_vpx_mov_info->trace_id, 0);
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+			timing::Scope scope(gf_get_stage(m_vpx_mov_info->p_stage_timing, STAGE_DECODE));
+
+#endif
+			mf_post_alpha(0);
+			ret = vpx_codec_decode(&m_vpx_mov_info->vpx_ctx, mf_get_movie_bytes(f_info.pos), f_info.len, NULL, 0);
+			stats::add(&m_vpx_mov_info->stats, stats::CounterFramesDecoded, 1);
+		}
+
+		if (ret < 0)
+		{
+			gf_trace_codec_error(&m_vpx_mov_info->vpx_ctx, "load(): Failed to decode frame.");
+			break;
+		}
+
+		vpx_codec_iter_t iter = NULL;
+		vpx_image_t* vpxImage;
+		{
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+			timing::Scope scope(gf_get_stage(m_vpx_mov_info->p_stage_timing, STAGE_CONVERT));
+
+#endif
+			vpxImage = vpx_codec_get_frame(&m_vpx_mov_info->vpx_ctx, &iter);
+		}
+
+		if (!vpxImage)
+		{
+			ofLogError("ofxWebMPlayer", "load(): vpx_codec_get_frame() failed.");
+			break;
+		}
+
+		//10 and 12 bits come as the same layouts in 16 bits samples.
+		bool const is_high_bit_depth = (vpxImage->fmt & VPX_IMG_FMT_HIGHBITDEPTH) != 0;
+		u32 const fmt = vpxImage->fmt & ~VPX_IMG_FMT_HIGHBITDEPTH;
+		if (fmt != VPX_IMG_FMT_I420 && fmt != VPX_IMG_FMT_I422 && fmt != VPX_IMG_FMT_I444 && fmt != VPX_IMG_FMT_444A)
+		{
+			ofLogError("ofxWebMPlayer", "load(): The image format 0x%x of [%s] is not supported.", vpxImage->fmt, name.c_str());
+			break;
+		}
+
+		u32 const bytes_per_sample = is_high_bit_depth ? 2 : 1;
+		m_vpx_mov_info->bit_depth = is_high_bit_depth ? vpxImage->bit_depth : 8;
+		m_vpx_mov_info->sample_scale = is_high_bit_depth ? 65535.f / ((1 << vpxImage->bit_depth) - 1) : 1.f;
+		if (is_high_bit_depth)
+		{
+			ofLogNotice("ofxWebMPlayer", "load()-video: %u bits per sample.", m_vpx_mov_info->bit_depth);
+		}
+
+		m_vpx_mov_info->planes_count = 0;
+
+		for (u32 i = 0; i < 4; ++i)
+		{
+			if (!vpxImage->planes[i])
+			{
+				continue;
+			}
+
+			m_vpx_mov_info->planes_width[i] = vpxImage->stride[i] / bytes_per_sample;
+
+			switch (i)
+			{
+			case VPX_PLANE_Y:
+				m_vpx_mov_info->planes_height[i] = vpxImage->d_h;
+				break;
+
+			case VPX_PLANE_U:
+			case VPX_PLANE_V:
+				if (fmt == VPX_IMG_FMT_I420)
+				{
+					m_vpx_mov_info->planes_height[i] = vpxImage->d_h / 2;
+					m_vpx_mov_info->chroma_shift[0] = 0.5f;
+					m_vpx_mov_info->chroma_shift[1] = 0.5f;
+				}
+				else if (fmt == VPX_IMG_FMT_I444 || fmt == VPX_IMG_FMT_444A)
+				{
+					m_vpx_mov_info->planes_height[i] = vpxImage->d_h;
+					m_vpx_mov_info->chroma_shift[0] = 1.f;
+					m_vpx_mov_info->chroma_shift[1] = 1.f;
+				}
+				else if (fmt == VPX_IMG_FMT_I422)
+				{
+					m_vpx_mov_info->planes_height[i] = vpxImage->d_h;
+					m_vpx_mov_info->chroma_shift[0] = 0.5f;
+					m_vpx_mov_info->chroma_shift[1] = 1.f;
+				}
+				break;
+			}
+
+			++m_vpx_mov_info->planes_count;
+		}
+
+		//the alpha is the 4th plane, the Y of its own image.
+		if (m_vpx_mov_info->up_alpha)
+		{
+			vpx_image_t const* p_alpha = m_vpx_mov_info->up_alpha->wait();
+			if (p_alpha)
+			{
+				m_vpx_mov_info->planes_width[3] = p_alpha->stride[VPX_PLANE_Y] / bytes_per_sample;
+				m_vpx_mov_info->planes_height[3] = p_alpha->d_h;
+				m_vpx_mov_info->planes_count = 4;
+			}
+			else
+			{
+				ofLogWarning("ofxWebMPlayer", "load(): The first frame of [%s] has no alpha, it is opaque.", name.c_str());
+				m_vpx_mov_info->up_alpha = nullptr;
+			}
+		}
+
+		//setRegion(), moved to the chroma samples so every plane starts on the same pixel.
+		u32* region = m_vpx_mov_info->region;
+		memset(region, 0x00, sizeof(m_vpx_mov_info->region));
+		if (m_region[2] && m_region[3] && m_region[0] < vpxImage->d_w && m_region[1] < vpxImage->d_h)
+		{
+			region[0] = m_region[0] & ~((1u << vpxImage->x_chroma_shift) - 1);
+			region[1] = m_region[1] & ~((1u << vpxImage->y_chroma_shift) - 1);
+			region[2] = std::min(m_region[0] + m_region[2], vpxImage->d_w) - region[0];
+			region[3] = std::min(m_region[1] + m_region[3], vpxImage->d_h) - region[1];
+			for (u32 i = 0; i < m_vpx_mov_info->planes_count; ++i)
+			{
+				u32 x, y, w, h;
+				gf_get_region_plane(vpxImage, i == 3 ? VPX_PLANE_Y : i, region, &x, &y, &w, &h);
+				m_vpx_mov_info->planes_width[i] = w;
+				m_vpx_mov_info->planes_height[i] = h;
+			}
+
+			ofLogNotice("ofxWebMPlayer", "load()-video: The region is %u x %u at %u, %u.", region[2], region[3], region[0], region[1]);
+		}
+
+		u32 const view_width = region[2] ? region[2] : vpxImage->d_w;
+		u32 const view_height = region[2] ? region[3] : vpxImage->d_h;
+
+		//the smallest factor which fits the preview size, the planes become that much smaller.
+		u32 factor = 1;
+		if (m_preview_width)
+		{
+			factor = std::max(factor, scale::getScaledSize(view_width, m_preview_width));
+		}
+
+		if (m_preview_height)
+		{
+			factor = std::max(factor, scale::getScaledSize(view_height, m_preview_height));
+		}
+
+		m_vpx_mov_info->preview_factor = factor;
+		if (factor > 1)
+		{
+			size_t preview_bytes = 0;
+			for (u32 i = 0; i < m_vpx_mov_info->planes_count; ++i)
+			{
+				u32 x, y, w, h;
+				gf_get_region_plane(vpxImage, i == 3 ? VPX_PLANE_Y : i, region, &x, &y, &w, &h);
+				//rows of 4 samples, the default unpack alignment.
+				m_vpx_mov_info->planes_width[i] = (scale::getScaledSize(w, factor) + 3) & ~3u;
+				m_vpx_mov_info->planes_height[i] = scale::getScaledSize(h, factor);
+				m_vpx_mov_info->preview_offsets[i] = preview_bytes;
+				preview_bytes += static_cast<size_t>(m_vpx_mov_info->planes_width[i] * m_vpx_mov_info->planes_height[i]) * bytes_per_sample;
+			}
+
+			m_vpx_mov_info->preview_planes.resize(preview_bytes);
+			ofLogNotice("ofxWebMPlayer", "load()-video: The preview is %u x %u, 1/%u of the movie.",
+				scale::getScaledSize(view_width, factor), scale::getScaledSize(view_height, factor), factor);
+		}
+
+		//kept by the decoder until the next frame is decoded.
+		m_vpx_mov_info->p_first_image = vpxImage;
+		m_vpx_mov_info->up_reader = std::move(up_reader);
+		m_vpx_mov_info->load_name = name;
+		mf_charge_memory();
+		return true;
+
+	} while (0); //Failed
+
+	//isLoaded() is false again, the decoder of a movie which failed after it was
+	//made goes back to the pool like in close().
+	if (m_vpx_mov_info->vpx_if)
+	{
+		pool::ResourcePool::instance().releaseDecoder(m_vpx_mov_info->vpx_if, m_vpx_mov_info->decoder_width, m_vpx_mov_info->decoder_height, &m_vpx_mov_info->vpx_ctx);
+		m_vpx_mov_info->vpx_if = NULL;
+	}
+
+	m_vpx_mov_info->has_video = false;
+	m_vpx_mov_info->has_audio = false;
+	m_vpx_mov_info->sp_pcm_store = nullptr;
+	m_vpx_mov_info->p_next_block = NULL;
+	m_vpx_mov_info->is_index_done = true;
+	m_vpx_mov_info->up_alpha = nullptr;
+	m_vpx_mov_info->up_segment = nullptr;
+	m_vpx_mov_info->up_demuxer = nullptr;
+	m_vpx_mov_info->live_path.clear();
+	m_vpx_mov_info->frame_index.clear();
+	m_vpx_mov_info->box_audio_packet.clear();
+
+
+	return false;
+}
+
+//the textures, the shader and the first frame on them, on the GL thread.
+bool ofxWebMPlayer::mf_load_gl()
+{
+	trace::Scope trace_scope("load.gl", m_vpx_mov_info->trace_id);
+	vpx_image_t* vpxImage = m_vpx_mov_info->p_first_image;
+	m_vpx_mov_info->p_first_image = NULL;
+
+	m_vpx_mov_info->is_headless = m_enable_headless;
+	if (m_vpx_mov_info->is_headless)
+	{
+		mf_convert_vpx_img_to_texture(vpxImage);
+		mf_on_loaded();
+		return true;
+	}
+
+	do
+	{
+		char const* src_vert_shader = g_cstr_vert_shader;
+		char const* src_frag_shader = NULL;
+
+		GLenum error = glGetError();
+		//Clear gl error;
+		if (error != GL_NO_ERROR)
+		{
+			ofLogWarning("ofxWebMPlayer", "load(): Clear GL Error(%d): someone is bad...", error);
+		}
+		
+		pool::ResourcePool& pool = pool::ResourcePool::instance();
+
+		GLint internalformat;
+		GLenum format = GL_NO_ERROR;
+		GLenum type = GL_UNSIGNED_BYTE;
+
+		if (vpxImage->fmt & VPX_IMG_FMT_PLANAR)
+		{
+			//16 bits normalized, f_sample_scale brings 10 and 12 bits to 1.0.
+			bool const is_high_bit_depth = (vpxImage->fmt & VPX_IMG_FMT_HIGHBITDEPTH) != 0;
+			internalformat = is_high_bit_depth ? GL_R16 : GL_R8;
+			format = GL_RED;
+			type = is_high_bit_depth ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+
+			switch (vpxImage->cs)
+			{
+			default:
+			case VPX_CS_BT_601:
+				src_frag_shader = g_cstr_frag_shader601;
+				break;
+
+			case VPX_CS_BT_709:
+				src_frag_shader = g_cstr_frag_shader709;
+				break;
+
+			case VPX_CS_BT_2020:
+				src_frag_shader = g_cstr_frag_shader2020;
+				break;
+			}
+
+			if (m_vpx_mov_info->up_alpha)
+			{
+				src_frag_shader = gf_get_alpha_frag_shader(src_frag_shader);
+			}
+		}
+		else if (vpxImage->fmt == VPX_IMG_FMT_ARGB_LE)
+		{
+			//frag_shader_path += "BGRA";
+			internalformat = GL_RGBA;
+			format = GL_BGRA;
+		}
+		else if (vpxImage->fmt == VPX_IMG_FMT_ARGB)
+		{
+			//frag_shader_path += "ARGB";
+			internalformat = GL_RGBA;
+			format = GL_BGRA;
+		}
+
+		pool::TextureKey& texture_key = m_vpx_mov_info->texture_key;
+		memset(&texture_key, 0x00, sizeof(texture_key));
+		texture_key.count = m_vpx_mov_info->planes_count;
+		texture_key.internalformat = internalformat;
+		for (u32 i = 0; i < m_vpx_mov_info->planes_count; ++i)
+		{
+			texture_key.width[i] = static_cast<u32>(m_vpx_mov_info->planes_width[i]);
+			texture_key.height[i] = static_cast<u32>(m_vpx_mov_info->planes_height[i]);
+		}
+
+		//textures of the same layout are only updated, mf_convert_vpx_img_to_texture() does that.
+		bool const is_pooled_textures = pool.acquireTextures(texture_key, m_gl_tex2d_planes);
+		if (!is_pooled_textures)
+		{
+			memset(m_gl_tex2d_planes, 0x00, sizeof(m_gl_tex2d_planes));
+			glGenTextures(4, m_gl_tex2d_planes);
+			//glEnable(GL_TEXTURE_2D);
+		}
+
+		for (u32 i = 0; i < m_vpx_mov_info->planes_count && !is_pooled_textures; ++i)
+		{
+			//glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, m_gl_tex2d_planes[i]);
+			//a preview or a region is only allocated, mf_convert_vpx_img_to_texture() fills it.
+			u8 const* p_plane = (m_vpx_mov_info->preview_factor > 1 || m_vpx_mov_info->region[2]) ? NULL : vpxImage->planes[i];
+			glTexImage2D(GL_TEXTURE_2D, 0, internalformat, m_vpx_mov_info->planes_width[i], m_vpx_mov_info->planes_height[i], 0, format, type, p_plane);
+
+			error = glGetError();
+			if (error != GL_NO_ERROR)
+			{
+				ofLogWarning("ofxWebMPlayer", "glGetError(%d)", error);
+			}
+
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		}
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+		//glDisable(GL_TEXTURE_2D);
+
+		ofFbo::Settings settings;
+		u32 view_x, view_y, view_width, view_height;
+		gf_get_region_plane(vpxImage, VPX_PLANE_Y, m_vpx_mov_info->region, &view_x, &view_y, &view_width, &view_height);
+		settings.width = scale::getScaledSize(view_width, m_vpx_mov_info->preview_factor);
+		settings.height = scale::getScaledSize(view_height, m_vpx_mov_info->preview_factor);
+		settings.textureTarget = GL_TEXTURE_2D;
+		settings.internalformat = GL_RGBA;
+
+		m_sp_fbo = pool.acquireFbo(settings.width, settings.height);
+		if (!m_sp_fbo)
+		{
+			m_sp_fbo = std::make_shared<ofFbo>();
+			m_sp_fbo->allocate(settings);
+		}
+
+		//setup shader, a linked one from the pool needs nothing.
+		m_vpx_mov_info->src_frag_shader = src_frag_shader;
+		m_sp_shader = pool.acquireShader(src_frag_shader);
+		if (!m_sp_shader)
+		{
+			m_sp_shader = std::make_shared<ofShader>();
+
+			bool yes = m_sp_shader->setupShaderFromSource(GL_VERTEX_SHADER, src_vert_shader);
+			if (!yes)
+			{
+				break;
+			}
+
+			yes = m_sp_shader->setupShaderFromSource(GL_FRAGMENT_SHADER, src_frag_shader);
+			if (!yes)
+			{
+				break;
+			}
+
+			if (ofIsGLProgrammableRenderer()) 
+			{
+				m_sp_shader->bindDefaults();
+			}
+
+			yes = m_sp_shader->linkProgram();
+			if (!yes)
+			{
+				break;
+			}
+		}
+
+		m_mesh_quard.clear();
+		m_mesh_quard.setMode(OF_PRIMITIVE_TRIANGLE_STRIP);
+		m_mesh_quard.addVertex(ofVec3f(0.f, 0.f, 0.f));
+		m_mesh_quard.addVertex(ofVec3f(0.f, settings.height, 0.f));
+		m_mesh_quard.addVertex(ofVec3f(settings.width, 0.f, 0.f));
+		m_mesh_quard.addVertex(ofVec3f(settings.width, settings.height, 0.f));
+
+		mf_convert_vpx_img_to_texture(vpxImage);
+		mf_on_loaded();
+		return true;
+
+	} while (0); //Failed
+
+	ofLogError("ofxWebMPlayer", "load(): The shader of the planes failed.");
+	mf_unload();
+	return false;
+}
+
+//the first frame is presented, with or without GL.
+void ofxWebMPlayer::mf_on_loaded()
+{
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+	ms_info.us_time_to_first_frame = ofGetElapsedTimeMicros() - m_vpx_mov_info->us_load_begin;
+
+#endif
+	stats::add(&m_vpx_mov_info->stats, stats::CounterLoads, 1);
+
+	//the decoder and the GL are known only now.
+	mf_charge_memory();
+	memory::Budget::instance().enforce(&m_vpx_mov_info->memory_account, 0);
+}
+
+//finishes a loadAsync() on the GL thread once the movie is ready.
+void ofxWebMPlayer::mf_finish_load()
+{
+	s32 const state = m_vpx_mov_info->async_state;
+	if (state == AsyncNone || state == AsyncLoading)
+	{
+		return;
+	}
+
+	m_vpx_mov_info->load_thread.join();
+	m_vpx_mov_info->async_state = AsyncNone;
+
+	bool const is_play_pending = m_vpx_mov_info->is_play_pending;
+	m_vpx_mov_info->is_play_pending = false;
+
+	if (state == AsyncReady && mf_load_gl() && is_play_pending)
+	{
+		play();
+	}
+}
+
+//waits for a loadAsync() still running, what it loaded is left for mf_unload().
+void ofxWebMPlayer::mf_join_load()
+{
+	if (m_vpx_mov_info->load_thread.joinable())
+	{
+		m_vpx_mov_info->load_thread.join();
+	}
+
+	m_vpx_mov_info->async_state = AsyncNone;
+	m_vpx_mov_info->is_play_pending = false;
+	m_vpx_mov_info->p_first_image = NULL;
+}
+
+void ofxWebMPlayer::play()
+{
+	if (m_vpx_mov_info->async_state != AsyncNone)
+	{
+		m_vpx_mov_info->is_play_pending = true;
+		return;
+	}
+
+	if (!mf_restore())
+	{
+		return;
+	}
+
+	if (!m_is_playing)
+	{
+		m_vpx_mov_info->total_tick_mills = 0;
+		if (m_vpx_mov_info->cur_mov_frame_idx == m_vpx_mov_info->frame_count - 1)
+		{
+			m_vpx_mov_info->cur_mov_frame_idx = -1;
+		}
+
+		//a playlist pulls the audio itself, see ofxWebMPlaylist.
+		if (m_vpx_mov_info->has_audio && !m_is_audio_chained)
+		{
+			AudioOutputSettings const& settings = g_audio_output_settings;
+			u32 const src_rate = m_vpx_mov_info->audio_info.sample_rate;
+
+			//still registered if the movie ended by itself, keep the callback away while resetting.
+			audio::Mixer& mixer = audio::Mixer::instance();
+			mixer.removeSource(this);
+
+			if (!mixer.open(settings.sample_rate ? settings.sample_rate : src_rate, settings.num_channels, settings.buffer_size, settings.num_buffers))
+			{
+				ofLogError("ofxWebMPlayer", "play(): Failed to open the audio output device.");
+			}
+
+			m_vpx_mov_info->audio_cur_frame = 0;
+			m_vpx_mov_info->accum_samples = 0;
+			m_vpx_mov_info->is_audio_end = false;
+			mf_setup_audio_chain(mixer.getSampleRate(), mixer.getChannels());
+
+			if (!mixer.addSource(this))
+			{
+				ofLogError("ofxWebMPlayer", "play(): Too many players with audio are playing.");
+			}
+		}
+
+	}
+
+	m_is_playing = true;
+	m_is_paused = false;
+	m_vpx_mov_info->pre_tick_millis = mf_get_millis();
+	m_vpx_mov_info->memory_account.last_active_millis = ofGetElapsedTimeMillis();
+}
+
+void ofxWebMPlayer::stop()
+{
+	if (!m_is_playing)
+	{
+		return;
+	}
+
+	m_is_playing = false;
+
+	if (m_vpx_mov_info->has_audio)
+	{
+		audio::Mixer::instance().removeSource(this);
+	}
+}
+
+ofTexture* ofxWebMPlayer::getTexturePtr()
+{
+	if (!m_sp_fbo)
+	{
+		//nothing loaded, an empty texture as before the fbo came from the pool.
+		static ofFbo s_fbo;
+		return &s_fbo.getTexture();
+	}
+
+	return &m_sp_fbo->getTexture();
+};
+
+float ofxWebMPlayer::getWidth() const
+{
+	if (!isLoaded())
+	{
+		return 0.f;
+	}
+
+	return m_vpx_mov_info->width;
+}
+
+float ofxWebMPlayer::getHeight() const
+{
+	if (!isLoaded())
+	{
+		return 0.f;
+	}
+
+	return m_vpx_mov_info->height;
+}
+
+bool ofxWebMPlayer::isPaused() const
+{
+	return m_is_paused;
+}
+
+bool ofxWebMPlayer::isLoaded() const
+{
+	return m_vpx_mov_info->vpx_if != NULL && m_vpx_mov_info->async_state == AsyncNone;
+}
+
+bool ofxWebMPlayer::isPlaying() const
+{
+	return m_is_playing;
+}
+
+float ofxWebMPlayer::getPosition() const
+{
+	if (!isLoaded())
+	{
+		return 0.f;
+	}
+
+	return m_position;
+}
+
+float ofxWebMPlayer::getSpeed() const
+{
+	return 1.f;
+}
+
+float ofxWebMPlayer::getDuration() const
+{
+	if (!isLoaded())
+	{
+		return 0.f;
+	}
+
+	return m_vpx_mov_info->duration_s;
+}
+
+bool ofxWebMPlayer::getIsMovieDone() const
+{
+	return !m_is_playing;
+}
+
+void ofxWebMPlayer::setPaused(bool bPause)
+{
+	m_is_paused = bPause;
+}
+
+void ofxWebMPlayer::setPosition(float pct)
+{
+	if (!isLoaded() || !mf_restore())
+	{
+		return;
+	}
+
+	pct = ofClamp(pct, 0.f, 1.f);
+	u32 frame_idx = static_cast<u32>((m_vpx_mov_info->frame_count - 1) * pct);
+	if (!m_vpx_mov_info->is_index_done && !mf_index_frames(frame_idx))
+	{
+		//the movie is shorter than its duration said.
+		frame_idx = m_vpx_mov_info->frame_count - 1;
+	}
+	else if (m_vpx_mov_info->is_index_done)
+	{
+		//by the time of the frames, which holds for a variable frame rate too.
+		FrameIndex const& frame_index = m_vpx_mov_info->frame_index;
+		s64 const first_ns = frame_index.getTime(0);
+		s64 const last_ns = frame_index.getTime(m_vpx_mov_info->frame_count - 1);
+		frame_idx = frame_index.findFrame(first_ns + static_cast<s64>((last_ns - first_ns) * static_cast<f64>(pct)));
+	}
+
+	//the live mode dropped the bytes of the frames before.
+	frame_idx = std::max(frame_idx, m_vpx_mov_info->live_first_frame);
+	trace::Scope trace_scope("seek", m_vpx_mov_info->trace_id, frame_idx);
+	if (static_cast<s32>(frame_idx) == m_vpx_mov_info->cur_mov_frame_idx)
+	{
+		return;
+	}
+
+	FrameIndex const& frame_index = m_vpx_mov_info->frame_index;
+	if (m_vpx_mov_info->cur_mov_frame_idx < 0 ||
+		m_vpx_mov_info->cur_mov_frame_idx > static_cast<s32>(frame_idx) || 
+		frame_index.getKey(m_vpx_mov_info->cur_mov_frame_idx) != frame_index.getKey(frame_idx))
+	{
+		m_vpx_mov_info->cur_mov_frame_idx = frame_idx;
+		mf_set_key_frame(frame_idx);
+	}
+
+	stats::add(&m_vpx_mov_info->stats, stats::CounterSeeks, 1);
+
+	m_vpx_mov_info->pre_tick_millis = mf_get_millis();
+	m_vpx_mov_info->total_tick_mills = static_cast<u64>(m_vpx_mov_info->duration_s * 1000.f * pct);
+}
+
+void ofxWebMPlayer::setVolume(float volume)
+{
+	m_volume = ofClamp(volume, 0.f, 1.f);
+}
+
+void ofxWebMPlayer::setLoopState(ofLoopType state)
+{
+	switch (state)
+	{
+	default:
+	case OF_LOOP_NONE:
+		m_is_loop = false;
+		break;
+	case OF_LOOP_PALINDROME:
+	case OF_LOOP_NORMAL:
+		m_is_loop = true;
+		break;
+	}
+}
+
+void ofxWebMPlayer::setSpeed(float speed)
+{
+	return;
+}
 
-					ptr += size_hdr_comment;
+void ofxWebMPlayer::setFrame(int frame)
+{
+	if (!isLoaded() || !mf_restore())
+	{
+		return;
+	}
 
-					if (memcmp(ptr, "\x05vorbis", 7) != 0)
-					{
-						ofLogError("ofxWebMPlayer", "load()-audio: error");
-						continue;
-					}
+	u32 frame_idx = static_cast<u32>(std::max(frame, 0));
+	if (!mf_index_frames(frame_idx))
+	{
+		frame_idx = m_vpx_mov_info->frame_count - 1;
+	}
 
-					hdr_setup.pack.packet = ptr;
-					hdr_setup.pack.bytes = static_cast<long>(end - ptr);
+	frame_idx = std::max(frame_idx, m_vpx_mov_info->live_first_frame);
 
-					if (hdr_setup.pack.bytes < 7)
-					{
-						ofLogError("ofxWebMPlayer", "load()-audio: error");
-						continue;
-					}
+	if (static_cast<s32>(frame_idx) == m_vpx_mov_info->cur_mov_frame_idx)
+	{
+		return;
+	}
 
+	trace::Scope trace_scope("seek", m_vpx_mov_info->trace_id, frame_idx);
+	mf_decode_to(frame_idx);
+	stats::add(&m_vpx_mov_info->stats, stats::CounterSeeks, 1);
 
-					//We are satisfied that the CodecPrivate value is well-formed,
-					//and so we now create the audio stream for this movie;
-					vorbis::Decoder decoder;
-					OggPacketStreamerForWebm opsfw(m_vpx_mov_info->sp_mb_movie_body, p_audio_track);
-					bool yes = decoder.init(hdr_id, hdr_comment, hdr_setup);
-					if (!yes)
-					{
-						ofLogError("ofxWebMPlayer", "load()-audio: decoder init failed.");
-						continue;
-					}
+	//the clock goes on from the time of the frame.
+	FrameIndex const& frame_index = m_vpx_mov_info->frame_index;
+	m_vpx_mov_info->pre_tick_millis = mf_get_millis();
+	m_vpx_mov_info->total_tick_mills = static_cast<u64>((frame_index.getTime(frame_idx) - frame_index.getTime(0)) / 1000000);
+	m_position = m_vpx_mov_info->duration_s > 0.f ? m_vpx_mov_info->total_tick_mills * 0.001f / m_vpx_mov_info->duration_s : 0.f;
+}
 
-					m_vpx_mov_info->sp_mb_wav_body = std::shared_ptr< MemBlock >(new MemBlock);
-					yes = vorbis::readOggPakcetStreamer(&m_vpx_mov_info->audio_info, m_vpx_mov_info->sp_mb_wav_body, &opsfw, &decoder);
-					if (!yes)
-					{
-						m_vpx_mov_info->sp_mb_wav_body = nullptr;
-						ofLogError("ofxWebMPlayer", "load()-audio: decoder init failed.");
-						continue;
-					}
+int ofxWebMPlayer::getCurrentFrame() const
+{
+	if (!isLoaded())
+	{
+		return -1;
+	}
 
-					m_vpx_mov_info->has_audio = true;
-				}
-				break;
+	return m_vpx_mov_info->cur_mov_frame_idx;
+}
 
-			case mkvparser::Track::kSubtitle:
-				ofLogError("ofxWebMPlayer", "load(): Subtitle track is not implemented yet.");
-				break;
+int	ofxWebMPlayer::getTotalNumFrames() const
+{
+	if (!isLoaded())
+	{
+		return -1;
+	}
 
-			case mkvparser::Track::kMetadata:
-				ofLogError("ofxWebMPlayer", "load(): Metadata track is not implemented yet.");
-				break;
-			}
-		}
+	return m_vpx_mov_info->frame_count;
+}
 
-		m_vpx_mov_info->cur_mov_frame_idx = 0;
-		m_vpx_mov_info->pre_tick_millis = 0;
-		m_vpx_mov_info->total_tick_mills = 0;
+ofLoopType ofxWebMPlayer::getLoopState() const
+{
+	return m_is_loop? OF_LOOP_NORMAL: OF_LOOP_NONE;
+}
 
-		VpxFrameInfo& f_info = m_vpx_mov_info->box_vpx_frame_info[0];
-		ret = vpx_codec_decode(&m_vpx_mov_info->vpx_ctx, m_vpx_mov_info->sp_mb_movie_body->get_buffer() + f_info.pos, f_info.len, NULL, 0);
-		if (ret < 0)
-		{
-			gf_trace_codec_error(&m_vpx_mov_info->vpx_ctx, "load(): Failed to decode frame.");
-			break;
-		}
+void ofxWebMPlayer::firstFrame()
+{
+	setFrame(0);
+}
 
-		vpx_codec_iter_t iter = NULL;
-		vpx_image_t* vpxImage = vpx_codec_get_frame(&m_vpx_mov_info->vpx_ctx, &iter);
+void ofxWebMPlayer::nextFrame()
+{
+	setFrame(m_vpx_mov_info->cur_mov_frame_idx + 1);
+}
 
-		if (!vpxImage)
-		{
-			ofLogError("ofxWebMPlayer", "load(): vpx_codec_get_frame() failed.");
-			break;
-		}
+void ofxWebMPlayer::previousFrame()
+{
+	setFrame(std::max(m_vpx_mov_info->cur_mov_frame_idx - 1, 0));
+}
 
-		//if (vpxImage->fmt != VPX_IMG_FMT_I420)
-		//{
-		//	ofLogError("ofxWebMPlayer::load(): Only support the fmt I420. failed");
-		//	break;
-		//}
+void ofxWebMPlayer::setClock(std::function<unsigned long long()> get_millis)
+{
+	m_get_millis = get_millis;
+}
 
-		m_vpx_mov_info->planes_count = 0;
+void ofxWebMPlayer::enableHeadless(bool yes)
+{
+	m_enable_headless = yes;
+}
 
-		for (u32 i = 0; i < 4; ++i)
-		{
-			if (!vpxImage->planes[i])
-			{
-				continue;
-			}
+void ofxWebMPlayer::enableFrameChecksums(bool yes)
+{
+	m_enable_frame_checksums = yes;
+}
 
-			m_vpx_mov_info->planes_width[i] = vpxImage->stride[i];
+void ofxWebMPlayer::setPreviewSize(unsigned int max_width, unsigned int max_height)
+{
+	m_preview_width = max_width;
+	m_preview_height = max_height;
+}
 
-			switch (i)
-			{
-			case VPX_PLANE_Y:
-				m_vpx_mov_info->planes_height[i] = vpxImage->d_h;
-				break;
+void ofxWebMPlayer::setRegion(unsigned int x, unsigned int y, unsigned int width, unsigned int height)
+{
+	m_region[0] = x;
+	m_region[1] = y;
+	m_region[2] = width;
+	m_region[3] = height;
+}
 
-			case VPX_PLANE_U:
-			case VPX_PLANE_V:
-				if (vpxImage->fmt == VPX_IMG_FMT_I420)
-				{
-					m_vpx_mov_info->planes_height[i] = vpxImage->d_h / 2;
-					m_vpx_mov_info->chroma_shift[0] = 0.5f;
-					m_vpx_mov_info->chroma_shift[1] = 0.5f;
-				}
-				else if (vpxImage->fmt == VPX_IMG_FMT_I444 || vpxImage->fmt == VPX_IMG_FMT_444A)
-				{
-					m_vpx_mov_info->planes_height[i] = vpxImage->d_h;
-					m_vpx_mov_info->chroma_shift[0] = 1.f;
-					m_vpx_mov_info->chroma_shift[1] = 1.f;
-				}
-				else if (vpxImage->fmt == VPX_IMG_FMT_I422)
-				{
-					m_vpx_mov_info->planes_height[i] = vpxImage->d_h;
-					m_vpx_mov_info->chroma_shift[0] = 0.5f;
-					m_vpx_mov_info->chroma_shift[1] = 1.f;
-				}
-				break;
-			}
+unsigned int ofxWebMPlayer::getFrameChecksum() const
+{
+	return m_vpx_mov_info->frame_checksum;
+}
 
-			++m_vpx_mov_info->planes_count;
-		}
+bool ofxWebMPlayer::computeFrameChecksums(string name, std::vector<unsigned int>* p_out)
+{
+	if (!p_out)
+	{
+		return false;
+	}
 
-		char const* src_vert_shader = g_cstr_vert_shader;
-		char const* src_frag_shader = NULL;
+	//the movie and its index from a headless player, the frames from a decoder
+	//of its own: one vpx_codec_decode() after the other from the first frame, no
+	//seek and no key frame logic of the player, so a bug there can't hide here.
+	ofxWebMPlayer player;
+	player.enableHeadless(true);
+	player.enableAudio(false);
+	if (!player.load(name))
+	{
+		return false;
+	}
 
-		GLenum error = glGetError();
-		//Clear gl error;
-		if (error != GL_NO_ERROR)
-		{
-			ofLogWarning("ofxWebMPlayer", "load(): Clear GL Error(%d): someone is bad...", error);
-		}
-		
-		memset(m_gl_tex2d_planes, 0x00, sizeof(m_gl_tex2d_planes));
-		glGenTextures(4, m_gl_tex2d_planes);
-		//glEnable(GL_TEXTURE_2D);
+	player.mf_index_frames(UINT_MAX);
+	VpxMovInfo const* p_info = player.m_vpx_mov_info;
+	FrameIndex const& frame_index = p_info->frame_index;
+	u32 const frame_count = static_cast<u32>(frame_index.size());
+	MemBlock const* p_mb = p_info->sp_mb_movie_body.get();
+
+	vpx_codec_dec_cfg_t cfg;
+	cfg.threads = 1;
+	cfg.w = p_info->decoder_width;
+	cfg.h = p_info->decoder_height;
+	vpx_codec_ctx_t ctx;
+	vpx_codec_ctx_t alpha_ctx;
+	bool const has_alpha = static_cast<bool>(p_info->up_alpha);
+	if (vpx_codec_dec_init(&ctx, p_info->vpx_if, &cfg, 0))
+	{
+		ofLogError("ofxWebMPlayer", "computeFrameChecksums(): Failed to initialize the decoder of VPX.");
+		return false;
+	}
 
-		GLint internalformat;
-		GLenum format = GL_NO_ERROR;
+	if (has_alpha && vpx_codec_dec_init(&alpha_ctx, p_info->vpx_if, &cfg, 0))
+	{
+		ofLogError("ofxWebMPlayer", "computeFrameChecksums(): Failed to initialize the decoder of the alpha.");
+		vpx_codec_destroy(&ctx);
+		return false;
+	}
 
-		if (vpxImage->fmt & VPX_IMG_FMT_PLANAR)
+	//a frame without an image keeps the checksum of the one before, as the player does.
+	u32 checksum = 0;
+	p_out->clear();
+	p_out->reserve(frame_count);
+	for (u32 i = 0; i < frame_count; ++i)
+	{
+		FrameIndex::Frame const f_info = frame_index.get(i);
+		vpx_image_t const* p_alpha = NULL;
+		u64 pos;
+		u32 len;
+		if (has_alpha && alpha::findAdditional(p_mb->get_buffer(), f_info.pos + f_info.len, p_mb->get_size(), &pos, &len))
 		{
-			internalformat = GL_R8;
-			format = GL_RED;
-
-			switch (vpxImage->cs)
+			if (!vpx_codec_decode(&alpha_ctx, p_mb->get_buffer() + pos, len, NULL, 0))
 			{
-			default:
-			case VPX_CS_BT_601:
-				src_frag_shader = g_cstr_frag_shader601;
-				break;
-
-			case VPX_CS_BT_709:
-				src_frag_shader = g_cstr_frag_shader709;
-				break;
+				vpx_codec_iter_t iter = NULL;
+				p_alpha = vpx_codec_get_frame(&alpha_ctx, &iter);
 			}
 		}
-		else if (vpxImage->fmt == VPX_IMG_FMT_ARGB_LE)
+
+		if (vpx_codec_decode(&ctx, p_mb->get_buffer() + f_info.pos, f_info.len, NULL, 0))
 		{
-			//frag_shader_path += "BGRA";
-			internalformat = GL_RGBA;
-			format = GL_BGRA;
+			gf_trace_codec_error(&ctx, "computeFrameChecksums(): Failed to decode frame.");
 		}
-		else if (vpxImage->fmt == VPX_IMG_FMT_ARGB)
+
+		vpx_codec_iter_t iter = NULL;
+		if (vpx_image_t const* p_image = vpx_codec_get_frame(&ctx, &iter))
 		{
-			//frag_shader_path += "ARGB";
-			internalformat = GL_RGBA;
-			format = GL_BGRA;
+			checksum = gf_get_frame_checksum(p_image, p_alpha);
 		}
 
-		for (u32 i = 0; i < m_vpx_mov_info->planes_count; ++i)
-		{
-			//glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, m_gl_tex2d_planes[i]);
-			glTexImage2D(GL_TEXTURE_2D, 0, internalformat, m_vpx_mov_info->planes_width[i], m_vpx_mov_info->planes_height[i], 0, format, GL_UNSIGNED_BYTE, vpxImage->planes[i]);
+		p_out->push_back(checksum);
+	}
 
-			error = glGetError();
-			if (error != GL_NO_ERROR)
-			{
-				ofLogWarning("ofxWebMPlayer", "glGetError(%d)", error);
-			}
+	if (has_alpha)
+	{
+		vpx_codec_destroy(&alpha_ctx);
+	}
 
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		}
+	vpx_codec_destroy(&ctx);
+	return true;
+}
 
-		glBindTexture(GL_TEXTURE_2D, 0);
-		//glDisable(GL_TEXTURE_2D);
+bool ofxWebMPlayer::decodeOffline(string name, std::function<bool(OfflineFrame const&)> on_frame, unsigned int thread_count)
+{
+	//the movie and its index, from a player which never touches GL.
+	ofxWebMPlayer player;
+	player.enableHeadless(true);
+	player.enableAudio(false);
+	if (!on_frame || !player.load(name))
+	{
+		return false;
+	}
 
-		ofFbo::Settings settings;
-		settings.width = vpxImage->d_w;
-		settings.height = vpxImage->d_h;
-		settings.textureTarget = GL_TEXTURE_2D;
-		settings.internalformat = GL_RGB;
+	player.mf_index_frames(UINT_MAX);
+	VpxMovInfo const* p_info = player.m_vpx_mov_info;
+	FrameIndex const& frame_index = p_info->frame_index;
+	u32 const frame_count = static_cast<u32>(frame_index.size());
+	u8 const* p_movie = p_info->sp_mb_movie_body->get_buffer();
 
-		m_fbo.allocate(settings);
+	std::vector<u32> keys;
+	frame_index.getKeys(&keys);
+	if (keys.empty() || keys[0] != 0)
+	{
+		keys.insert(keys.begin(), 0);
+	}
 
-		//setup shader
+	//one GOP at a time per decoder, the cores left over go to the decoder itself.
+	u32 const core_count = std::max(1u, std::thread::hardware_concurrency());
+	thread_count = std::min<u32>(thread_count ? thread_count : core_count, static_cast<u32>(keys.size()));
+	vpx_codec_dec_cfg_t cfg;
+	cfg.threads = std::max(1u, core_count / thread_count);
+	cfg.w = p_info->decoder_width;
+	cfg.h = p_info->decoder_height;
+
+	offline::ReorderBuffer reorder(std::max(thread_count * 8, 16u));
+	std::atomic<u32> next_gop(0);
+	std::vector<std::thread> threads;
+	for (u32 t = 0; t < thread_count; ++t)
+	{
+		threads.emplace_back([&]()
 		{
-			bool yes = m_shader.setupShaderFromSource(GL_VERTEX_SHADER, src_vert_shader);
-			if (!yes)
+			vpx_codec_ctx_t ctx;
+			if (vpx_codec_dec_init(&ctx, p_info->vpx_if, &cfg, 0))
 			{
-				break;
+				ofLogError("ofxWebMPlayer", "decodeOffline(): Failed to initialize the decoder of VPX.");
+				reorder.cancel();
+				return;
 			}
 
-			yes = m_shader.setupShaderFromSource(GL_FRAGMENT_SHADER, src_frag_shader);
-			if (!yes)
+			for (u32 g = next_gop++; g < keys.size(); g = next_gop++)
 			{
-				break;
-			}
+				u32 const end = g + 1 < keys.size() ? keys[g + 1] : frame_count;
+				for (u32 i = keys[g]; i < end; ++i)
+				{
+					FrameIndex::Frame const f_info = frame_index.get(i);
+					if (vpx_codec_decode(&ctx, p_movie + f_info.pos, f_info.len, NULL, 0))
+					{
+						gf_trace_codec_error(&ctx, "decodeOffline(): Failed to decode frame.");
+					}
 
-			if (ofIsGLProgrammableRenderer()) 
-			{
-				m_shader.bindDefaults();
-			}
+					std::unique_ptr<offline::Image> up_image = reorder.acquire();
+					up_image->index = i;
+					up_image->time_ns = f_info.time_ns;
+					up_image->is_valid = false;
 
-			yes = m_shader.linkProgram();
-			if (!yes)
-			{
-				break;
+					vpx_codec_iter_t iter = NULL;
+					if (vpx_image_t const* p_image = vpx_codec_get_frame(&ctx, &iter))
+					{
+						offline::copyImage(p_image, up_image.get());
+					}
+
+					if (!reorder.push(std::move(up_image)))
+					{
+						vpx_codec_destroy(&ctx);
+						return;
+					}
+				}
 			}
+
+			vpx_codec_destroy(&ctx);
+		});
+	}
+
+	bool is_ok = true;
+	for (u32 i = 0; i < frame_count && is_ok; ++i)
+	{
+		std::unique_ptr<offline::Image> up_image = reorder.pop();
+		if (!up_image)
+		{
+			is_ok = false;
+			break;
 		}
 
-		m_mesh_quard.clear();
-		m_mesh_quard.setMode(OF_PRIMITIVE_TRIANGLE_STRIP);
-		m_mesh_quard.addVertex(ofVec3f(0.f, 0.f, 0.f));
-		m_mesh_quard.addVertex(ofVec3f(0.f, settings.height, 0.f));
-		m_mesh_quard.addVertex(ofVec3f(settings.width, 0.f, 0.f));
-		m_mesh_quard.addVertex(ofVec3f(settings.width, settings.height, 0.f));
+		OfflineFrame frame;
+		frame.index = up_image->index;
+		frame.time_ns = up_image->time_ns;
+		frame.width = up_image->is_valid ? up_image->width : 0;
+		frame.height = up_image->is_valid ? up_image->height : 0;
+		frame.bit_depth = up_image->is_valid ? up_image->bit_depth : p_info->bit_depth;
+		frame.chroma_shift_x = up_image->is_valid ? up_image->chroma_shift_x : 0;
+		frame.chroma_shift_y = up_image->is_valid ? up_image->chroma_shift_y : 0;
+		for (u32 p = 0; p < 3; ++p)
+		{
+			frame.planes[p] = up_image->is_valid ? up_image->data.data() + up_image->offsets[p] : NULL;
+			frame.strides[p] = up_image->is_valid ? up_image->strides[p] : 0;
+		}
 
-		mf_convert_vpx_img_to_texture(vpxImage);
+		is_ok = on_frame(frame);
+		reorder.release(std::move(up_image));
+	}
 
-		return true;
+	//wakes the decoders if it stopped early.
+	reorder.cancel();
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
 
-	} while (0); //Failed
+	return is_ok;
+}
 
+u64 ofxWebMPlayer::mf_get_millis() const
+{
+	return m_get_millis ? m_get_millis() : ofGetElapsedTimeMillis();
+}
 
-	return false;
+//the bytes at a position of the file, the block starts further in once the live mode dropped the front.
+u8 const* ofxWebMPlayer::mf_get_movie_bytes(u64 pos) const
+{
+	return m_vpx_mov_info->sp_mb_movie_body->get_buffer() + (pos - m_vpx_mov_info->movie_base);
 }
 
-void ofxWebMPlayer::loadAsync(string name)
+//the alpha of a frame to its thread, right before the colour of it is decoded.
+void ofxWebMPlayer::mf_post_alpha(u32 frame_idx)
 {
+	alpha::Decoder* p_alpha = m_vpx_mov_info->up_alpha.get();
+	if (!p_alpha)
+	{
+		return;
+	}
 
+	//the BlockAdditions follow the frame in its BlockGroup.
+	MemBlock* p_mb = m_vpx_mov_info->sp_mb_movie_body.get();
+	FrameIndex::Frame const f_info = m_vpx_mov_info->frame_index.get(frame_idx);
+	u64 pos;
+	u32 len;
+	if (alpha::findAdditional(p_mb->get_buffer(), f_info.pos + f_info.len - m_vpx_mov_info->movie_base, p_mb->get_size(), &pos, &len))
+	{
+		p_alpha->post(p_mb->get_buffer() + pos, len);
+	}
+	else
+	{
+		//or wait() would still have the alpha of the frame before.
+		p_alpha->post(NULL, 0);
+	}
 }
 
-void ofxWebMPlayer::play()
+//decodes from the key frame before frame_idx, or from the current frame if it is on the way, and presents it.
+void ofxWebMPlayer::mf_decode_to(u32 frame_idx)
 {
-	if (!m_is_playing)
+	FrameIndex const& frame_index = m_vpx_mov_info->frame_index;
+	s32 const cur_idx = m_vpx_mov_info->cur_mov_frame_idx;
+	if (cur_idx < 0 || cur_idx > static_cast<s32>(frame_idx) || frame_index.getKey(cur_idx) != frame_index.getKey(frame_idx))
 	{
-		m_vpx_mov_info->total_tick_mills = 0;
-		if (m_vpx_mov_info->cur_mov_frame_idx == m_vpx_mov_info->frame_count - 1)
+		//presents it already if it is the key frame.
+		mf_set_key_frame(frame_idx);
+		if (m_vpx_mov_info->cur_mov_frame_idx == static_cast<s32>(frame_idx))
 		{
-			m_vpx_mov_info->cur_mov_frame_idx = -1;
+			return;
 		}
+	}
 
-		if (m_vpx_mov_info->has_audio)
-		{
-			m_vpx_mov_info->audio_cur_ptr = 0;
-			m_vpx_mov_info->accum_samples = 0;
-			m_vpx_mov_info->is_audio_end = false;
-
-			m_sound_stream.setOutput(this);
-			m_sound_stream.setup(m_vpx_mov_info->audio_info.num_of_channel, 0, m_vpx_mov_info->audio_info.sample_rate, 256, 2);
+	for (s32 i = m_vpx_mov_info->cur_mov_frame_idx + 1; i <= static_cast<s32>(frame_idx); ++i)
+	{
+		FrameIndex::Frame const f_info = frame_index.get(i);
+		trace::Scope trace_scope("decode", m_vpx_mov_info->trace_id, i);
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+		timing::Scope scope(gf_get_stage(m_vpx_mov_info->p_stage_timing, STAGE_DECODE));
 
-			int width = ofGetWidth();
-			pan = (float)width * 0.5f / (float)width;
-			float height = (float)ofGetHeight();
-			float heightPct = ((height - (height * 0.5f)) / height);
-			targetFrequency = 2000.0f * heightPct;
-			phaseAdderTarget = (targetFrequency / (float)sampleRate) * TWO_PI;
+#endif
+		mf_post_alpha(i);
+		if (vpx_codec_decode(&m_vpx_mov_info->vpx_ctx, mf_get_movie_bytes(f_info.pos), f_info.len, NULL, 0))
+		{
+			gf_trace_codec_error(&m_vpx_mov_info->vpx_ctx, "mf_decode_to(): Failed to decode frame.");
 		}
 
+		stats::add(&m_vpx_mov_info->stats, stats::CounterFramesDecoded, 1);
 	}
 
-	m_is_playing = true;
-	m_is_paused = false;
-	m_vpx_mov_info->pre_tick_millis = ofGetElapsedTimeMillis();
+	m_vpx_mov_info->cur_mov_frame_idx = frame_idx;
+	mf_get_frame();
 }
 
-void ofxWebMPlayer::stop()
-{
-	if (!m_is_playing)
+float ofxWebMPlayer::mf_set_key_frame(u32 frame_idx)
+{	
+	//VpxFrameInfo& fInfo = m_vpx_mov_info->box_vpx_frame_info[frame_idx];
+
+	if (m_vpx_mov_info->vpx_if == vpx_codec_vp8_dx())
 	{
-		return;
+		if (vpx_codec_destroy(&m_vpx_mov_info->vpx_ctx))
+		{
+			gf_trace_codec_error(&m_vpx_mov_info->vpx_ctx, "mf_set_frame(): Failed to destroy the decoder of VPX");
+			return -1.f;
+		}
+		else
+		{
+			// Initialize codec
+			if (vpx_codec_dec_init(&m_vpx_mov_info->vpx_ctx, m_vpx_mov_info->vpx_if, &m_vpx_mov_info->vpx_cfg, m_vpx_mov_info->vpx_flags))
+			{
+				gf_trace_codec_error(&m_vpx_mov_info->vpx_ctx, "mf_set_frame(): Failed to initialize the decoder of VPX");
+				return -1.f;
+			}
+		}
 	}
 
-	m_is_playing = false;
+	m_vpx_mov_info->cur_mov_frame_idx = m_vpx_mov_info->frame_index.getKey(frame_idx);
+	f32 time_s = frame_idx / m_vpx_mov_info->frame_rate;
 
-	if (m_vpx_mov_info->has_audio)
+	FrameIndex::Frame const f_info = m_vpx_mov_info->frame_index.get(m_vpx_mov_info->cur_mov_frame_idx);
 	{
-		m_sound_stream.stop();
-		m_sound_stream.close();
-	}
-}
+		trace::Scope trace_scope("decode", m_vpx_mov_info->trace_id, m_vpx_mov_info->cur_mov_frame_idx);
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+		timing::Scope scope(gf_get_stage(m_vpx_mov_info->p_stage_timing, STAGE_DECODE));
 
-ofTexture* ofxWebMPlayer::getTexturePtr()
-{
-	return &m_fbo.getTexture();
-};
+#endif
+		mf_post_alpha(m_vpx_mov_info->cur_mov_frame_idx);
+		if (vpx_codec_decode(&m_vpx_mov_info->vpx_ctx, mf_get_movie_bytes(f_info.pos), f_info.len, NULL, 0))
+		{
+			gf_trace_codec_error(&m_vpx_mov_info->vpx_ctx, "mf_set_frame(): Failed to decode frame");
+		}
 
-float ofxWebMPlayer::getWidth() const
-{
-	if (!isLoaded())
+		stats::add(&m_vpx_mov_info->stats, stats::CounterFramesDecoded, 1);
+	}
+
+	if (m_vpx_mov_info->cur_mov_frame_idx == frame_idx)
 	{
-		return 0.f;
+		mf_get_frame();
 	}
 
-	return m_vpx_mov_info->width;
+	return time_s;
 }
 
-float ofxWebMPlayer::getHeight() const
+bool ofxWebMPlayer::mf_index_frames(u32 frame_idx)
 {
-	if (!isLoaded())
+	if (m_vpx_mov_info->is_index_done)
 	{
-		return 0.f;
+		return frame_idx < m_vpx_mov_info->frame_count;
 	}
 
-	return m_vpx_mov_info->height;
-}
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+	timing::Scope scope(gf_get_stage(m_vpx_mov_info->p_stage_timing, STAGE_DEMUX));
 
-bool ofxWebMPlayer::isPaused() const
-{
-	return m_is_paused;
-}
+#endif
+	bool is_end = false;
+	if (m_vpx_mov_info->up_demuxer)
+	{
+		WebMDemuxer* p_demuxer = m_vpx_mov_info->up_demuxer.get();
+		WebMDemuxer::Result result = p_demuxer->feed(m_vpx_mov_info->up_stream_reader.get(), frame_idx);
+		if (result == WebMDemuxer::RESULT_ERROR)
+		{
+			ofLogWarning("ofxWebMPlayer", "webm parser stopped at frame %u", static_cast<u32>(m_vpx_mov_info->frame_index.size()));
+		}
 
-bool ofxWebMPlayer::isLoaded() const
-{
-	return m_vpx_mov_info->vpx_if != NULL;
-}
+		is_end = p_demuxer->isDone() || result == WebMDemuxer::RESULT_ERROR;
+	}
+	else
+	{
+		mkvparser::Track const* pVideoTrack = m_vpx_mov_info->p_video_track;
+		mkvparser::BlockEntry const*& pBlockEty = m_vpx_mov_info->p_next_block;
+		FrameIndex& frame_index = m_vpx_mov_info->frame_index;
 
-bool ofxWebMPlayer::isPlaying() const
-{
-	return m_is_playing;
-}
+		while (frame_index.size() <= frame_idx)
+		{
+			if (!pBlockEty || pBlockEty->EOS())
+			{
+				is_end = true;
+				break;
+			}
 
-float ofxWebMPlayer::getPosition() const
-{
-	if (!isLoaded())
-	{
-		return 0.f;
-	}
+			mkvparser::Block const* pBlock = pBlockEty->GetBlock();
 
-	return m_position;
-}
+			//s64 tCode = pBlock->GetTimeCode(pBlockEty->GetCluster());
+			//s64 t = pBlock->GetTime(pBlockEty->GetCluster());
+			if (pBlock)
+			{
+				s64 time_ns = pBlock->GetTime(pBlockEty->GetCluster());
+				for (s32 fIdx = 0; fIdx < pBlock->GetFrameCount(); ++fIdx)
+				{
+					mkvparser::Block::Frame const& frame = pBlock->GetFrame(fIdx);
 
-float ofxWebMPlayer::getSpeed() const
-{
-	return 1.f;
-}
+					//the decoding of every frame of a key block starts from its first frame.
+					frame_index.push(frame.pos, frame.len, time_ns, fIdx == 0 && pBlock->IsKey());
+				}
+			}
 
-float ofxWebMPlayer::getDuration() const
-{
-	if (!isLoaded())
-	{
-		return 0.f;
+			//loads the next cluster when this one is done.
+			pVideoTrack->GetNext(pBlockEty, pBlockEty);
+		}
 	}
 
-	return m_vpx_mov_info->duration_s;
-}
-
-bool ofxWebMPlayer::getIsMovieDone() const
-{
-	return !m_is_playing;
-}
+	if (is_end)
+	{
+		//the real count, the estimate from the duration may be a little off.
+		m_vpx_mov_info->frame_count = static_cast<u32>(m_vpx_mov_info->frame_index.size());
+		m_vpx_mov_info->is_index_done = true;
+		if (m_vpx_mov_info->frame_rate > 0.f)
+		{
+			m_vpx_mov_info->duration_s = m_vpx_mov_info->frame_count / m_vpx_mov_info->frame_rate;
+		}
+	}
+	else if (m_vpx_mov_info->frame_count < m_vpx_mov_info->frame_index.size())
+	{
+		m_vpx_mov_info->frame_count = static_cast<u32>(m_vpx_mov_info->frame_index.size());
+		if (m_vpx_mov_info->frame_rate > 0.f)
+		{
+			m_vpx_mov_info->duration_s = m_vpx_mov_info->frame_count / m_vpx_mov_info->frame_rate;
+		}
+	}
 
-void ofxWebMPlayer::setPaused(bool bPause)
-{
-	m_is_paused = bPause;
+	m_vpx_mov_info->memory_account.set(memory::KindIndex, mf_get_index_bytes());
+	return frame_idx < m_vpx_mov_info->frame_index.size();
 }
 
-void ofxWebMPlayer::setPosition(float pct)
+bool ofxWebMPlayer::mf_scan_clusters(void* p, u32* p_video_track, u32* p_audio_track)
 {
-	if (!isLoaded())
+	mkvparser::Segment const* p_segment = static_cast<mkvparser::Segment const*>(p);
+	mkvparser::Tracks const* p_tracks = p_segment->GetTracks();
+	if (!p_tracks)
 	{
-		return;
+		return false;
 	}
 
-	pct = ofClamp(pct, 0.f, 1.f);
-	u32 frame_idx = static_cast<u32>((m_vpx_mov_info->frame_count - 1) * pct);
-	if (frame_idx == m_vpx_mov_info->cur_mov_frame_idx)
+	*p_video_track = 0;
+	*p_audio_track = 0;
+	for (u32 i = 0; i < p_tracks->GetTracksCount(); ++i)
 	{
-		return;
-	}
+		mkvparser::Track const* p_track = p_tracks->GetTrackByIndex(i);
+		if (!p_track)
+		{
+			continue;
+		}
 
-	VpxFrameInfo& cur_frame_info = m_vpx_mov_info->box_vpx_frame_info[m_vpx_mov_info->cur_mov_frame_idx];
-	VpxFrameInfo& nxt_frame_info = m_vpx_mov_info->box_vpx_frame_info[frame_idx];
+		if (!*p_video_track && p_track->GetType() == mkvparser::Track::kVideo)
+		{
+			*p_video_track = static_cast<u32>(p_track->GetNumber());
+		}
+		else if (!*p_audio_track && p_track->GetType() == mkvparser::Track::kAudio)
+		{
+			*p_audio_track = static_cast<u32>(p_track->GetNumber());
+		}
+	}
 
-	if (m_vpx_mov_info->cur_mov_frame_idx > frame_idx || 
-		cur_frame_info.idx_key != nxt_frame_info.idx_key)
+	if (!*p_video_track)
 	{
-		m_vpx_mov_info->cur_mov_frame_idx = frame_idx;
-		f32 time_s = mf_set_key_frame(frame_idx);
+		return false;
 	}
 
-	m_vpx_mov_info->pre_tick_millis = ofGetElapsedTimeMillis();
-	m_vpx_mov_info->total_tick_mills = static_cast<u64>(m_vpx_mov_info->duration_s * 1000.f * pct);
-}
+	MemBlock* p_mb = m_vpx_mov_info->sp_mb_movie_body.get();
+	u64 const size = p_mb->get_size();
+	u64 const begin = static_cast<u64>(p_segment->m_start);
+	u64 end = p_segment->m_size >= 0 ? begin + p_segment->m_size : size;
+	end = std::min(end, size);
 
-void ofxWebMPlayer::setVolume(float volume)
-{
-	return;
-}
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+	u64 us_begin = ofGetElapsedTimeMicros();
 
-void ofxWebMPlayer::setLoopState(ofLoopType state)
-{
-	switch (state)
+#endif
+	bool yes = cluster_scan::build(p_mb->get_buffer(), begin, end, p_segment->GetInfo()->GetTimeCodeScale(), *p_video_track, *p_audio_track, m_index_threads,
+		&m_vpx_mov_info->frame_index, m_enable_audio ? &m_vpx_mov_info->box_audio_packet : NULL);
+	if (!yes)
 	{
-	default:
-	case OF_LOOP_NONE:
-		m_is_loop = false;
-		break;
-	case OF_LOOP_PALINDROME:
-	case OF_LOOP_NORMAL:
-		m_is_loop = true;
-		break;
+		m_vpx_mov_info->frame_index.clear();
+		m_vpx_mov_info->box_audio_packet.clear();
+		ofLogNotice("ofxWebMPlayer", "load(): The clusters can not be scanned, walking the blocks instead.");
+		return false;
 	}
-}
 
-void ofxWebMPlayer::setSpeed(float speed)
-{
-	return;
-}
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+	ofLogNotice("ofxWebMPlayer", "load(): %u frames scanned in %u us.", static_cast<u32>(m_vpx_mov_info->frame_index.size()), static_cast<u32>(ofGetElapsedTimeMicros() - us_begin));
 
-void ofxWebMPlayer::setFrame(int frame)
-{
-	//if (!isLoaded())
-	//{
-	//	return;
-	//}
-	//
-	//size_t total_frames = m_vpx_mov_info->box_vpx_frame_info.size();
-	//if (frame < 0)
-	//{
-	//	frame = 0;
-	//}
-	//else if (frame > total_frames)
-	//{
-	//	frame = static_cast<int>(total_frames - 1);
-	//}
-	//u32 frame_idx = frame;
-	//if (frame_idx == m_vpx_mov_info->cur_mov_frame_idx)
-	//{
-	//	return;
-	//}
-	//
-	//f32 time_s = mf_set_key_frame(frame);
-	//if (time_s < 0.f)
-	//{
-	//	return;
-	//}
-	//
-	//m_vpx_mov_info->pre_tick_millis = ofGetElapsedTimeMillis();
-	//m_vpx_mov_info->total_tick_mills = static_cast<u64>(time_s * 1000.f);
+#endif
+	return true;
 }
 
-int ofxWebMPlayer::getCurrentFrame() const
+//A capture which just started may not have its tracks, or the two frames a
+//frame rate is measured from, written yet. They are polled for a while.
+s32 ofxWebMPlayer::mf_wait_live_start(void* p, s32 result)
 {
-	if (!isLoaded())
+	enum { PollMillis = 100, WaitMillis = 10000 };
+
+	WebMReader* p_reader = static_cast<WebMReader*>(p);
+	WebMDemuxer* p_demuxer = m_vpx_mov_info->up_demuxer.get();
+	auto is_started = [p_demuxer]()
 	{
-		return -1;
-	}
+		if (!p_demuxer->isTracksDone())
+		{
+			return false;
+		}
 
-	return m_vpx_mov_info->cur_mov_frame_idx;
-}
+		for (TrackDesc const& desc : p_demuxer->getTracks())
+		{
+			if (desc.type == mkvparser::Track::kVideo && !desc.frame_rate && !desc.default_duration_ns)
+			{
+				return p_demuxer->getVideoFrameRate() > 0.0;
+			}
+		}
 
-int	ofxWebMPlayer::getTotalNumFrames() const
-{
-	if (!isLoaded())
-	{
-		return -1;
-	}
+		return true;
+	};
 
-	return m_vpx_mov_info->frame_count;
-}
+	u64 const begin_millis = ofGetElapsedTimeMillis();
+	while (result != WebMDemuxer::RESULT_ERROR && !is_started() && ofGetElapsedTimeMillis() - begin_millis < WaitMillis)
+	{
+		ofSleepMillis(PollMillis);
 
-ofLoopType ofxWebMPlayer::getLoopState() const
-{
-	return m_is_loop? OF_LOOP_NORMAL: OF_LOOP_NONE;
-}
+		ofFile file(m_vpx_mov_info->live_path, ofFile::ReadOnly, true);
+		size_t appended = 0;
+		if (!p_reader->Append(file, &appended))
+		{
+			break;
+		}
 
-void ofxWebMPlayer::firstFrame()
-{
-	setFrame(0);
-}
+		if (appended)
+		{
+			stats::add(&m_vpx_mov_info->stats, stats::CounterBytesRead, appended);
+			MemBlock* p_mb = m_vpx_mov_info->sp_mb_movie_body.get();
+			m_vpx_mov_info->up_stream_reader->SetBuffer(p_mb->get_buffer(), 0, p_mb->get_size(), false);
+			result = p_demuxer->feed(m_vpx_mov_info->up_stream_reader.get(), UINT_MAX);
+		}
+	}
 
-void ofxWebMPlayer::nextFrame()
-{
+	if (!is_started())
+	{
+		ofLogWarning("ofxWebMPlayer", "load(): [%s] has no two frames to measure the frame rate from yet.", m_vpx_mov_info->live_path.c_str());
+	}
 
+	return result;
 }
 
-void ofxWebMPlayer::previousFrame()
+void ofxWebMPlayer::mf_follow_live()
 {
+	enum { PollMillis = 100 };
 
-}
+	u64 cur_millis = mf_get_millis();
+	if (cur_millis - m_vpx_mov_info->live_poll_millis < PollMillis)
+	{
+		return;
+	}
 
-float ofxWebMPlayer::mf_set_key_frame(u32 frame_idx)
-{	
-	//VpxFrameInfo& fInfo = m_vpx_mov_info->box_vpx_frame_info[frame_idx];
+	m_vpx_mov_info->live_poll_millis = cur_millis;
 
-	if (m_vpx_mov_info->vpx_if == vpx_codec_vp8_dx())
+	//the alpha decoder reads its packets in place, it has to be done with them before the block moves.
+	if (m_vpx_mov_info->up_alpha)
 	{
-		if (vpx_codec_destroy(&m_vpx_mov_info->vpx_ctx))
-		{
-			gf_trace_codec_error(&m_vpx_mov_info->vpx_ctx, "mf_set_frame(): Failed to destroy the decoder of VPX");
-			return -1.f;
-		}
-		else
-		{
-			// Initialize codec
-			if (vpx_codec_dec_init(&m_vpx_mov_info->vpx_ctx, m_vpx_mov_info->vpx_if, &m_vpx_mov_info->vpx_cfg, m_vpx_mov_info->vpx_flags))
-			{
-				gf_trace_codec_error(&m_vpx_mov_info->vpx_ctx, "mf_set_frame(): Failed to initialize the decoder of VPX");
-				return -1.f;
-			}
-		}
+		m_vpx_mov_info->up_alpha->wait();
 	}
 
-	VpxFrameInfo& fInfo = m_vpx_mov_info->box_vpx_frame_info[frame_idx];
-	m_vpx_mov_info->cur_mov_frame_idx = fInfo.idx_key;
-	f32 time_s = frame_idx / m_vpx_mov_info->frame_rate;
+	ofFile file(m_vpx_mov_info->live_path, ofFile::ReadOnly, true);
+	size_t appended = 0;
+	bool yes;
+	{
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+		timing::Scope scope(gf_get_stage(m_vpx_mov_info->p_stage_timing, STAGE_READ));
+
+#endif
+		yes = m_vpx_mov_info->up_reader->Append(file, &appended);
+	}
 
-	VpxFrameInfo& f_info = m_vpx_mov_info->box_vpx_frame_info[m_vpx_mov_info->cur_mov_frame_idx];
-	if (vpx_codec_decode(&m_vpx_mov_info->vpx_ctx, m_vpx_mov_info->sp_mb_movie_body->get_buffer() + f_info.pos, f_info.len, NULL, 0))
+	if (!yes || !appended)
 	{
-		gf_trace_codec_error(&m_vpx_mov_info->vpx_ctx, "mf_set_frame(): Failed to decode frame");
+		return;
 	}
 
-	if (m_vpx_mov_info->cur_mov_frame_idx == frame_idx)
+	stats::add(&m_vpx_mov_info->stats, stats::CounterBytesRead, appended);
+
+	//the parser only sees bytes which are really there, a cluster cut in the
+	//middle waits for the next poll.
+	WebMReader* p_reader = m_vpx_mov_info->up_reader.get();
+	MemBlock* p_mb = m_vpx_mov_info->sp_mb_movie_body.get();
+	m_vpx_mov_info->up_stream_reader->SetBuffer(p_mb->get_buffer(), p_reader->GetBase(), p_reader->GetBase() + p_mb->get_size(), false);
+	mf_index_frames(UINT_MAX);
+
+	//what is before the key frame of the current frame is not decoded again, the
+	//block keeps about the latency and a GOP. Dropped in big steps, it is a move.
+	enum { LiveDropBytes = 16 * 1024 * 1024 };
+	s32 const cur_idx = m_vpx_mov_info->cur_mov_frame_idx;
+	if (cur_idx > 0)
 	{
-		mf_get_frame();
+		FrameIndex const& frame_index = m_vpx_mov_info->frame_index;
+		u32 const key = frame_index.getKey(cur_idx);
+		u64 const key_pos = frame_index.get(key).pos;
+		if (key_pos >= p_reader->GetBase() + LiveDropBytes)
+		{
+			p_reader->DropFront(static_cast<size_t>(key_pos - p_reader->GetBase()));
+			m_vpx_mov_info->movie_base = p_reader->GetBase();
+			m_vpx_mov_info->live_first_frame = key;
+			m_vpx_mov_info->up_stream_reader->SetBuffer(p_mb->get_buffer(), p_reader->GetBase(), p_reader->GetBase() + p_mb->get_size(), false);
+		}
 	}
 
-	return time_s;
+	memory::Budget::instance().enforce(&m_vpx_mov_info->memory_account, 0);
 }
 
 void ofxWebMPlayer::mf_update(u64 delta_mills)
 {
+	if (!mf_restore())
+	{
+		return;
+	}
+
 	u32 frame_idx = 0;
 
 	m_vpx_mov_info->total_tick_mills += delta_mills;
 	f32 play_time_s;
 
-	if (m_vpx_mov_info->has_audio) 
+	if (m_vpx_mov_info->has_audio && !m_vpx_mov_info->is_audio_end) 
 	{
 		play_time_s = m_vpx_mov_info->accum_samples / (float)m_vpx_mov_info->audio_info.sample_rate;
+
+		//the tick clock follows, it takes over if the audio ends before the video.
+		m_vpx_mov_info->total_tick_mills = static_cast<u64>(play_time_s * 1000.f);
 	}
 	else
 	{
@@ -1570,6 +3567,25 @@ void ofxWebMPlayer::mf_update(u64 delta_mills)
 
 	//frame_idx = static_cast<u32>(play_time_s * 25.5);
 	frame_idx = static_cast<u32>(play_time_s * m_vpx_mov_info->frame_rate);
+	if (!m_vpx_mov_info->live_path.empty() && !m_vpx_mov_info->is_index_done)
+	{
+		mf_follow_live();
+
+		//waits when it is too close to the writer, jumps ahead when it fell behind (a stall, or the first update).
+		u32 latency_frames = static_cast<u32>(m_live_latency_s * m_vpx_mov_info->frame_rate);
+		u32 last_frame_idx = m_vpx_mov_info->frame_count - 1;
+		u32 live_frame_idx = last_frame_idx > latency_frames ? last_frame_idx - latency_frames : 0;
+		if (frame_idx > live_frame_idx || frame_idx + latency_frames < live_frame_idx)
+		{
+			frame_idx = live_frame_idx;
+			m_vpx_mov_info->total_tick_mills = static_cast<u64>(frame_idx * 1000.0 / m_vpx_mov_info->frame_rate);
+		}
+	}
+	else if (!m_vpx_mov_info->is_index_done)
+	{
+		mf_index_frames(frame_idx);
+	}
+
 	if (frame_idx >= m_vpx_mov_info->frame_count)
 	{
 		if (m_is_loop)
@@ -1601,24 +3617,41 @@ void ofxWebMPlayer::mf_update(u64 delta_mills)
 
 	if (pre_mov_frame_idx >= 0)
 	{
-		VpxFrameInfo const& f_info_pre = m_vpx_mov_info->box_vpx_frame_info[pre_mov_frame_idx];
-		VpxFrameInfo const& f_info_cur = m_vpx_mov_info->box_vpx_frame_info[m_vpx_mov_info->cur_mov_frame_idx];
-		if (f_info_pre.idx_key != f_info_cur.idx_key)
+		u32 const idx_key_pre = m_vpx_mov_info->frame_index.getKey(pre_mov_frame_idx);
+		u32 const idx_key_cur = m_vpx_mov_info->frame_index.getKey(m_vpx_mov_info->cur_mov_frame_idx);
+
+		//back in the same GOP too (the audio clock restarted), the decode goes again from its key frame.
+		if (idx_key_pre != idx_key_cur || m_vpx_mov_info->cur_mov_frame_idx < pre_mov_frame_idx)
 		{
-			pre_mov_frame_idx = f_info_cur.idx_key - 1;
+			pre_mov_frame_idx = idx_key_cur - 1;
 		}
 	}
 
+	//every frame decoded but the last one is never shown.
+	u32 const catch_up_depth = static_cast<u32>(m_vpx_mov_info->cur_mov_frame_idx - pre_mov_frame_idx);
+	m_vpx_mov_info->catch_up_depth = catch_up_depth;
+	stats::add(&m_vpx_mov_info->stats, stats::CounterFramesDecoded, catch_up_depth);
+	stats::add(&m_vpx_mov_info->stats, stats::CounterFramesDropped, catch_up_depth - 1);
+	stats::max(&m_vpx_mov_info->stats, stats::CounterCatchUpMax, catch_up_depth);
+
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+	ms_info.miss_frame_count += catch_up_depth - 1;
+
+#endif
+
 	for (s32 i = pre_mov_frame_idx + 1; i <= m_vpx_mov_info->cur_mov_frame_idx; ++i)
 	{
-		VpxFrameInfo& f_info = m_vpx_mov_info->box_vpx_frame_info[i];
+		FrameIndex::Frame const f_info = m_vpx_mov_info->frame_index.get(i);
+		trace::Scope trace_scope("decode", m_vpx_mov_info->trace_id, i);
 
 #if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
 		u64 ms_pre = ofGetElapsedTimeMillis();
+		timing::Scope scope(gf_get_stage(m_vpx_mov_info->p_stage_timing, STAGE_DECODE));
 
 #endif
 
-		if (vpx_codec_decode(&m_vpx_mov_info->vpx_ctx, m_vpx_mov_info->sp_mb_movie_body->get_buffer() + f_info.pos, f_info.len, NULL, 0))
+		mf_post_alpha(i);
+		if (vpx_codec_decode(&m_vpx_mov_info->vpx_ctx, mf_get_movie_bytes(f_info.pos), f_info.len, NULL, 0))
 		{
 			gf_trace_codec_error(&m_vpx_mov_info->vpx_ctx, "mf_update(): Failed to decode frame.");
 		}
@@ -1626,13 +3659,11 @@ void ofxWebMPlayer::mf_update(u64 delta_mills)
 #if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
 		ms_info.ms_decode_cur = ofGetElapsedTimeMillis() - ms_pre;
 		ms_info.ms_decode_worst = std::max(ms_info.ms_decode_worst, ms_info.ms_decode_cur);
-		++ms_info.miss_frame_count;
 
 #endif
 	}
 
 #if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
-	--ms_info.miss_frame_count;
 	u64 ms_pre = ofGetElapsedTimeMillis();
 
 #endif
@@ -1663,12 +3694,25 @@ void ofxWebMPlayer::forceUpdate()
 
 void ofxWebMPlayer::update()
 {
+	trace::Scope trace_scope("update", m_vpx_mov_info->trace_id);
+	mf_finish_load();
+
 	if (!m_is_playing)
 	{
 		return;
 	}
 
-	u64 cur_tick_millis = ofGetElapsedTimeMillis();
+	u32 const device_channels = m_vpx_mov_info->audio_device_channels;
+	if (device_channels && !m_is_audio_chained)
+	{
+		//the callback is kept away while the chain is built for the device layout.
+		audio::Mixer& mixer = audio::Mixer::instance();
+		mixer.removeSource(this);
+		mf_setup_audio_chain(m_vpx_mov_info->audio_out_rate, device_channels);
+		mixer.addSource(this);
+	}
+
+	u64 cur_tick_millis = mf_get_millis();
 	u64 delta_tick_millis = cur_tick_millis - m_vpx_mov_info->pre_tick_millis;
 	m_vpx_mov_info->pre_tick_millis = cur_tick_millis;
 
@@ -1677,6 +3721,7 @@ void ofxWebMPlayer::update()
 		return;
 	}
 
+	m_vpx_mov_info->memory_account.last_active_millis = ofGetElapsedTimeMillis();
 	mf_update(delta_tick_millis);
 }
 
@@ -1690,6 +3735,7 @@ bool ofxWebMPlayer::isFrameNew() const
 /// \brief Close the video source.
 void ofxWebMPlayer::close()
 {
+	mf_join_load();
 	mf_unload();
 }
 
@@ -1722,54 +3768,195 @@ ofPixels const& ofxWebMPlayer::getPixels() const
 
 ////////////////////////////////////////////////////////
 
-void ofxWebMPlayer::audioOut(float * output, int bufferSize, int nChannels)
+u32 ofxWebMPlayer::mf_read_audio_frames(float* output, u32 frames)
 {
-	if (m_is_paused || m_vpx_mov_info->is_audio_end)
+	audio::PcmStore* p_store = m_vpx_mov_info->sp_pcm_store.get();
+	u32 const channels = p_store->getChannels();
+	u64 const total_frames = p_store->getFrames();
+	if (!total_frames)
 	{
-		return;
+		return 0;
+	}
+
+	u32 done = 0;
+	while (done < frames)
+	{
+		u64 remain = total_frames - m_vpx_mov_info->audio_cur_frame;
+		if (!remain)
+		{
+			if (!m_is_loop)
+			{
+				m_vpx_mov_info->is_audio_end = true;
+				break;
+			}
+
+			m_vpx_mov_info->audio_cur_frame = 0;
+			m_vpx_mov_info->accum_samples = 0;
+			continue;
+		}
+
+		u32 count = static_cast<u32>(std::min<u64>(remain, frames - done));
+		count = p_store->read(m_vpx_mov_info->audio_cur_frame, output + done * channels, count);
+
+		m_vpx_mov_info->audio_cur_frame += count;
+		m_vpx_mov_info->accum_samples += count;
+		done += count;
 	}
 
-	int remain = m_vpx_mov_info->sp_mb_wav_body->get_size() - m_vpx_mov_info->audio_cur_ptr;
-	int extra = sizeof(float) * nChannels;
+	stats::add(&m_vpx_mov_info->stats, stats::CounterAudioFrames, done);
 
-	size_t size_of_dst = bufferSize * extra;
-	size_t size_of_src = remain < size_of_dst ?remain : size_of_dst;
-	size_t dst_offset = 0;
+	return done;
+}
 
-	if (remain < size_of_dst)
+bool ofxWebMPlayer::mf_get_audio_format(u32* p_sample_rate, u32* p_channels) const
+{
+	if (!m_vpx_mov_info->has_audio)
 	{
-		size_of_src = remain;
-		if (m_is_loop)
-		{
-			u8* ptr = m_vpx_mov_info->sp_mb_wav_body->get_buffer() + m_vpx_mov_info->audio_cur_ptr;
-			u8* buf_src = ptr;
+		return false;
+	}
+
+	*p_sample_rate = m_vpx_mov_info->audio_info.sample_rate;
+	*p_channels = m_vpx_mov_info->sp_pcm_store->getChannels();
+	return true;
+}
 
-			memcpy(output, buf_src, size_of_src);
+void ofxWebMPlayer::mf_rewind_audio()
+{
+	m_vpx_mov_info->audio_cur_frame = 0;
+	m_vpx_mov_info->accum_samples = 0;
+	m_vpx_mov_info->is_audio_end = false;
+}
 
-			m_vpx_mov_info->audio_cur_ptr = 0;
-			m_vpx_mov_info->accum_samples = 0;
+bool ofxWebMPlayer::mf_is_loading() const
+{
+	return m_vpx_mov_info->async_state != AsyncNone;
+}
+
+//how far the clock went past the last frame, when the movie ended by itself.
+u64 ofxWebMPlayer::mf_get_overrun_millis() const
+{
+	f64 const end_millis = m_vpx_mov_info->frame_count * 1000.0 / m_vpx_mov_info->frame_rate;
+	f64 const total_millis = static_cast<f64>(m_vpx_mov_info->total_tick_mills);
+	return total_millis > end_millis ? static_cast<u64>(total_millis - end_millis) : 0;
+}
+
+void ofxWebMPlayer::mf_set_play_millis(u64 millis)
+{
+	m_vpx_mov_info->total_tick_mills = millis;
+}
 
-			buf_src = m_vpx_mov_info->sp_mb_wav_body->get_buffer();
-			size_of_src = size_of_dst - remain;
-			dst_offset += (remain / sizeof(float));
+void ofxWebMPlayer::mf_render_audio_frames(float* output, u32 frames)
+{
+	audio::MixMatrix const& mat = m_vpx_mov_info->mix_matrix;
+
+	if (mat.is_identity)
+	{
+		u32 got = mf_read_audio_frames(output, frames);
+		if (got < frames)
+		{
+			memset(output + got * mat.src_channels, 0x00, sizeof(f32) * (frames - got) * mat.src_channels);
 		}
-		else
+
+		return;
+	}
+
+	//in pieces of the scratch play() allocated, the callback allocates nothing.
+	f32* src = m_vpx_mov_info->audio_scratch.data();
+	u32 const chunk_frames = mat.src_channels ? static_cast<u32>(m_vpx_mov_info->audio_scratch.size() / mat.src_channels) : 0;
+	if (!chunk_frames)
+	{
+		memset(output, 0x00, sizeof(f32) * frames * mat.dst_channels);
+		return;
+	}
+
+	for (u32 done = 0; done < frames;)
+	{
+		u32 const count = std::min(frames - done, chunk_frames);
+		u32 got = mf_read_audio_frames(src, count);
+		if (got < count)
 		{
-			m_vpx_mov_info->is_audio_end = true;
+			memset(src + got * mat.src_channels, 0x00, sizeof(f32) * (count - got) * mat.src_channels);
 		}
+
+		audio::mixChannels(mat, src, mat.src_channels, output + done * mat.dst_channels, count);
+		done += count;
+	}
+}
+
+//everything the callback uses, sized here and not in the callback.
+void ofxWebMPlayer::mf_setup_audio_chain(u32 dst_rate, u32 dst_channels)
+{
+	u32 const src_channels = m_vpx_mov_info->audio_info.num_of_channel;
+	u32 const src_rate = m_vpx_mov_info->audio_info.sample_rate;
+
+	if (!m_vpx_mov_info->resampler.setup(src_rate, dst_rate, dst_channels))
+	{
+		ofLogWarning("ofxWebMPlayer", "play(): Can not resample %d Hz to %d Hz, the pitch will be wrong.", src_rate, dst_rate);
+	}
+
+	m_vpx_mov_info->audio_out_rate = dst_rate;
+	u32 src_frames = m_vpx_mov_info->resampler.getInputFrames(g_audio_output_settings.buffer_size);
+	audio::buildMixMatrix(&m_vpx_mov_info->mix_matrix, src_channels, dst_channels);
+	m_vpx_mov_info->audio_scratch.resize(src_frames * src_channels);
+	m_vpx_mov_info->audio_pull.resize(m_vpx_mov_info->resampler.getMaxPullFrames() * dst_channels);
+
+	//start from silence, the first callback ramps up to the volume.
+	f32 gain[audio::MaxChannels] = { 0.f };
+	m_vpx_mov_info->gain_stage.reset(dst_channels, gain);
+	m_vpx_mov_info->audio_device_channels = 0;
+}
+
+void ofxWebMPlayer::audioOut(float * output, int bufferSize, int nChannels)
+{
+	if (m_is_paused || m_vpx_mov_info->is_audio_end)
+	{
+		memset(output, 0x00, sizeof(float) * bufferSize * nChannels);
+		return;
+	}
+
+	trace::Scope trace_scope("audioOut", m_vpx_mov_info->trace_id, bufferSize);
+	stats::add(&m_vpx_mov_info->stats, stats::CounterAudioCallbacks, 1);
+
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+	u64 us_pre = ofGetElapsedTimeMicros();
+	timing::Scope scope(gf_get_stage(m_vpx_mov_info->p_stage_timing, STAGE_AUDIO_CALLBACK));
+
+#endif
+
+	if (m_vpx_mov_info->mix_matrix.dst_channels != static_cast<u32>(nChannels))
+	{
+		//the device did not give us the layout of the settings, update() builds
+		//the chain again, silence until then.
+		m_vpx_mov_info->audio_device_channels = static_cast<u32>(nChannels);
+		memset(output, 0x00, sizeof(float) * bufferSize * nChannels);
+		return;
+	}
+
+	u32 const frames = static_cast<u32>(bufferSize);
+	u32 const dst_channels = m_vpx_mov_info->mix_matrix.dst_channels;
+
+	if (m_vpx_mov_info->resampler.isPassthrough())
+	{
+		mf_render_audio_frames(output, frames);
 	}
 	else
 	{
-		size_of_src = size_of_dst;
+		m_vpx_mov_info->resampler.process(output, frames, [this](f32* dst, u32 count)
+		{
+			mf_render_audio_frames(dst, count);
+		}, m_vpx_mov_info->audio_pull);
 	}
-	
-	
-	u8* ptr = m_vpx_mov_info->sp_mb_wav_body->get_buffer() + m_vpx_mov_info->audio_cur_ptr;
-	u8* buf_src = ptr;
 
-	memcpy(output + dst_offset, buf_src, size_of_src);
-	m_vpx_mov_info->audio_cur_ptr += size_of_src;
-	m_vpx_mov_info->accum_samples += (size_of_src / extra);
+	f32 gain[audio::MaxChannels];
+	audio::computeChannelGains(gain, dst_channels, m_volume, m_pan);
+	m_vpx_mov_info->gain_stage.process(output, frames, gain);
+
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+	ms_info.us_audio_out_cur = ofGetElapsedTimeMicros() - us_pre;
+	ms_info.us_audio_out_worst = std::max(ms_info.us_audio_out_worst, ms_info.us_audio_out_cur);
+	ms_info.us_audio_out_budget = static_cast<u64>(frames) * 1000000 / m_vpx_mov_info->audio_out_rate;
+
+#endif
 }
 
 
@@ -1802,7 +3989,14 @@ bool ofxWebMPlayer::getKeyFrames(std::vector<unsigned int>* p_out)
 		return false;
 	}
 
-	*p_out = m_vpx_mov_info->box_key;
+	if (!mf_restore())
+	{
+		return false;
+	}
+
+	//the lazy load has to see the whole movie for this.
+	mf_index_frames(UINT_MAX);
+	m_vpx_mov_info->frame_index.getKeys(p_out);
 	return true;
 }
 
@@ -1814,43 +4008,145 @@ bool ofxWebMPlayer::getKeyFrames(std::vector<unsigned int>* p_out)
 void ofxWebMPlayer::mf_convert_vpx_img_to_texture(void* vi)
 {
 	vpx_image_t* vpxImage = (vpx_image_t*)vi;
+	trace::Scope trace_scope("present", m_vpx_mov_info->trace_id, m_vpx_mov_info->cur_mov_frame_idx);
+
+	//the alpha decoded along with the colour, NULL if the frame had none.
+	vpx_image_t const* p_alpha = m_vpx_mov_info->up_alpha ? m_vpx_mov_info->up_alpha->wait() : NULL;
+	if (m_enable_frame_checksums)
+	{
+		m_vpx_mov_info->frame_checksum = gf_get_frame_checksum(vpxImage, p_alpha);
+	}
+
+	if (m_vpx_mov_info->is_headless)
+	{
+		stats::add(&m_vpx_mov_info->stats, stats::CounterFramesPresented, 1);
+		m_is_frame_new = true;
+		return;
+	}
+
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+	u64 ns_upload = m_vpx_mov_info->p_stage_timing ? timing::now() : 0;
 
+#endif
 	//glEnable(GL_TEXTURE_2D);
+	u64 upload_bytes = 0;
+	u32 const bytes_per_sample = m_vpx_mov_info->bit_depth > 8 ? 2 : 1;
+	GLenum const type = bytes_per_sample == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
 	for (u32 i = 0; i < m_vpx_mov_info->planes_count; ++i)
 	{
-		if (!vpxImage->planes[i])
+		if (i == 3 && !p_alpha)
+		{
+			//a frame without alpha is opaque, the plane is filled once until one has alpha again.
+			if (!m_vpx_mov_info->is_alpha_opaque)
+			{
+				u32 const w = static_cast<u32>(m_vpx_mov_info->planes_width[3]);
+				u32 const h = static_cast<u32>(m_vpx_mov_info->planes_height[3]);
+				std::vector<u8> opaque(static_cast<size_t>(w) * h * bytes_per_sample, 0xFF);
+				if (bytes_per_sample == 2)
+				{
+					std::fill_n(reinterpret_cast<u16*>(opaque.data()), static_cast<size_t>(w) * h, static_cast<u16>((1u << m_vpx_mov_info->bit_depth) - 1));
+				}
+
+				glBindTexture(GL_TEXTURE_2D, m_gl_tex2d_planes[3]);
+				glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RED, type, opaque.data());
+				m_vpx_mov_info->is_alpha_opaque = true;
+			}
+
+			continue;
+		}
+
+		if (i == 3)
+		{
+			m_vpx_mov_info->is_alpha_opaque = false;
+		}
+
+		vpx_image_t const* p_image = (i == 3 && p_alpha) ? p_alpha : vpxImage;
+		u32 const plane = (i == 3 && p_alpha) ? VPX_PLANE_Y : i;
+		u8 const* p_plane = p_image->planes[plane];
+		if (!p_plane)
 		{
 			continue;
 		}
 
+		//only the rectangle of the region is read, the upload goes through the stride.
+		u32 x, y, w, h;
+		gf_get_region_plane(p_image, plane, m_vpx_mov_info->region, &x, &y, &w, &h);
+		p_plane += static_cast<size_t>(y) * p_image->stride[plane] + x * bytes_per_sample;
+		u32 row_length = p_image->stride[plane] / bytes_per_sample;
+
+		//the preview is scaled here, so the upload and the fbo pass are of its size.
+		u32 const factor = m_vpx_mov_info->preview_factor;
+		if (factor > 1)
+		{
+			u8* p_dst = m_vpx_mov_info->preview_planes.data() + m_vpx_mov_info->preview_offsets[i];
+			u32 const dst_stride = static_cast<u32>(m_vpx_mov_info->planes_width[i]);
+			if (bytes_per_sample == 2)
+			{
+				scale::boxDown16(reinterpret_cast<u16 const*>(p_plane), p_image->stride[plane] / 2, w, h, factor,
+					reinterpret_cast<u16*>(p_dst), dst_stride, &m_vpx_mov_info->preview_sums);
+			}
+			else
+			{
+				scale::boxDown8(p_plane, p_image->stride[plane], w, h, factor, p_dst, dst_stride, &m_vpx_mov_info->preview_sums);
+			}
+
+			p_plane = p_dst;
+			row_length = dst_stride;
+		}
+
 		glBindTexture(GL_TEXTURE_2D, m_gl_tex2d_planes[i]);
-		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_vpx_mov_info->planes_width[i], m_vpx_mov_info->planes_height[i], GL_RED, GL_UNSIGNED_BYTE, vpxImage->planes[i]);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_vpx_mov_info->planes_width[i], m_vpx_mov_info->planes_height[i], GL_RED, type, p_plane);
+		upload_bytes += static_cast<u64>(m_vpx_mov_info->planes_width[i] * m_vpx_mov_info->planes_height[i]) * bytes_per_sample;
 	}
+
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	stats::add(&m_vpx_mov_info->stats, stats::CounterTextureBytes, upload_bytes);
+	stats::add(&m_vpx_mov_info->stats, stats::CounterFramesPresented, 1);
 	glBindTexture(GL_TEXTURE_2D, 0);
 	//glDisable(GL_TEXTURE_2D);
 
-	//ofPushStyle();
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+	//the calls only, the driver may copy later.
+	if (timing::Histogram* p_stage = gf_get_stage(m_vpx_mov_info->p_stage_timing, STAGE_UPLOAD))
+	{
+		p_stage->add(timing::now() - ns_upload);
+	}
+
+	timing::Scope scope(gf_get_stage(m_vpx_mov_info->p_stage_timing, STAGE_FBO));
+
+#endif
+
+	ofFbo& fbo = *m_sp_fbo;
+	ofShader& shader = *m_sp_shader;
 
-	m_fbo.begin(true);
+	//the alpha goes into the fbo as it is, not blended over what was there.
+	ofPushStyle();
+	ofDisableBlendMode();
+	fbo.begin(true);
 	{
-		m_shader.begin();
+		shader.begin();
 
-		m_shader.setUniformMatrix4f("mat4_projection", ofGetCurrentMatrix(OF_MATRIX_PROJECTION));
-		m_shader.setUniformMatrix4f("mat4_model_view", ofGetCurrentMatrix(OF_MATRIX_MODELVIEW));
-		//m_shader.setUniform2f("v2_display_size", m_vpx_mov_info->width, m_vpx_mov_info->height);
-		m_shader.setUniform4fv("v4_plane_width", m_vpx_mov_info->planes_width);
-		m_shader.setUniform4fv("v4_plane_height", m_vpx_mov_info->planes_height);
-		m_shader.setUniform2fv("v2_chroma_shift", m_vpx_mov_info->chroma_shift);
+		shader.setUniformMatrix4f("mat4_projection", ofGetCurrentMatrix(OF_MATRIX_PROJECTION));
+		shader.setUniformMatrix4f("mat4_model_view", ofGetCurrentMatrix(OF_MATRIX_MODELVIEW));
+		//shader.setUniform2f("v2_display_size", m_vpx_mov_info->width, m_vpx_mov_info->height);
+		shader.setUniform4fv("v4_plane_width", m_vpx_mov_info->planes_width);
+		shader.setUniform4fv("v4_plane_height", m_vpx_mov_info->planes_height);
+		shader.setUniform2fv("v2_chroma_shift", m_vpx_mov_info->chroma_shift);
+		shader.setUniform1f("f_sample_scale", m_vpx_mov_info->sample_scale);
 
 		for (u32 i = 0; i < m_vpx_mov_info->planes_count; ++i)
 		{
-			m_shader.setUniformTexture(g_sampler1d_name[i], GL_TEXTURE_2D, m_gl_tex2d_planes[i], i);
+			shader.setUniformTexture(g_sampler1d_name[i], GL_TEXTURE_2D, m_gl_tex2d_planes[i], i);
 		}
 
 		m_mesh_quard.draw();
-		m_shader.end();
+		shader.end();
 	}
-	m_fbo.end();
+	fbo.end();
+	ofPopStyle();
 
 	m_is_frame_new = true;
 }
@@ -1858,7 +4154,14 @@ void ofxWebMPlayer::mf_convert_vpx_img_to_texture(void* vi)
 void ofxWebMPlayer::mf_get_frame()
 {
 	vpx_codec_iter_t iter = NULL;
-	vpx_image_t* vpxImage = vpx_codec_get_frame(&m_vpx_mov_info->vpx_ctx, &iter);
+	vpx_image_t* vpxImage;
+	{
+#if defined(USE_OFXWEBMPLAYER_QA_FEATURE)
+		timing::Scope scope(gf_get_stage(m_vpx_mov_info->p_stage_timing, STAGE_CONVERT));
+
+#endif
+		vpxImage = vpx_codec_get_frame(&m_vpx_mov_info->vpx_ctx, &iter);
+	}
 
 	if (!vpxImage)
 	{
@@ -1873,32 +4176,209 @@ void ofxWebMPlayer::mf_unload()
 	if (m_vpx_mov_info->has_audio)
 	{
 		//ofScopedLock locker(m_vpx_mov_info->mtx_audio);
-		m_sound_stream.setOutput(NULL);
-		m_sound_stream.stop();
-		m_sound_stream.close();
-		m_vpx_mov_info->sp_mb_wav_body = nullptr;
+		audio::Mixer::instance().removeSource(this);
+		m_vpx_mov_info->sp_pcm_store = nullptr;
 		m_vpx_mov_info->has_audio = false;
 	}
 
 	if (m_vpx_mov_info->has_video)
 	{
+		//the decoder and the GL resources go back to the pool for the next load().
+		pool::ResourcePool& pool = pool::ResourcePool::instance();
 		if (m_vpx_mov_info->vpx_if)
 		{
-			vpx_codec_err_t err = vpx_codec_destroy(&m_vpx_mov_info->vpx_ctx);
+			//a degraded player destroyed its decoder already.
+			if (!m_vpx_mov_info->is_degraded)
+			{
+				pool.releaseDecoder(m_vpx_mov_info->vpx_if, m_vpx_mov_info->decoder_width, m_vpx_mov_info->decoder_height, &m_vpx_mov_info->vpx_ctx);
+			}
+
 			m_vpx_mov_info->vpx_if = NULL;
-			m_vpx_mov_info->box_vpx_frame_info.clear();
-			m_vpx_mov_info->box_key.clear();
+		}
+
+		m_vpx_mov_info->up_alpha = nullptr;
+		m_vpx_mov_info->preview_factor = 1;
+		std::vector<u8>().swap(m_vpx_mov_info->preview_planes);
+		m_vpx_mov_info->frame_index.clear();
+		m_vpx_mov_info->p_video_track = NULL;
+		m_vpx_mov_info->p_next_block = NULL;
+		m_vpx_mov_info->is_index_done = true;
+
+		m_mesh_quard.clear();
+		if (m_sp_fbo)
+		{
+			pool.releaseFbo(m_sp_fbo);
+			m_sp_fbo = nullptr;
+		}
+
+		if (m_sp_shader)
+		{
+			pool.releaseShader(m_vpx_mov_info->src_frag_shader, m_sp_shader);
+			m_sp_shader = nullptr;
+		}
 
-			m_mesh_quard.clear();
-			m_fbo.clear();
-			m_shader.unload();
-			glDeleteTextures(4, m_gl_tex2d_planes);
+		if (m_gl_tex2d_planes[0])
+		{
+			pool.releaseTextures(m_vpx_mov_info->texture_key, m_gl_tex2d_planes);
 			memset(m_gl_tex2d_planes, 0x00, sizeof(m_gl_tex2d_planes));
 		}
+
 		m_vpx_mov_info->has_video = false;
 	}
 
+	m_vpx_mov_info->up_segment = nullptr;
+	m_vpx_mov_info->up_demuxer = nullptr;
+	m_vpx_mov_info->up_stream_reader = nullptr;
+	m_vpx_mov_info->box_audio_packet.clear();
+	m_vpx_mov_info->live_path.clear();
+	m_vpx_mov_info->live_first_frame = 0;
+	m_vpx_mov_info->movie_base = 0;
+	m_vpx_mov_info->up_reader = nullptr;
 	m_vpx_mov_info->sp_mb_movie_body = nullptr;
+	m_vpx_mov_info->sp_index = nullptr;
+	m_vpx_mov_info->is_degraded = false;
+	m_vpx_mov_info->memory_account.clear();
+}
+
+size_t ofxWebMPlayer::mf_get_index_bytes() const
+{
+	return m_vpx_mov_info->frame_index.getMemoryBytes() + m_vpx_mov_info->box_audio_packet.capacity() * sizeof(sidecar::AudioPacket);
+}
+
+void ofxWebMPlayer::mf_charge_memory()
+{
+	VpxMovInfo* p_info = m_vpx_mov_info;
+	memory::Account& account = p_info->memory_account;
+
+	account.set(memory::KindMovie, p_info->sp_mb_movie_body ? p_info->sp_mb_movie_body->get_capacity() : 0);
+	account.set(memory::KindAudio, p_info->sp_pcm_store ? p_info->sp_pcm_store->getMemoryBytes() : 0);
+	account.set(memory::KindIndex, mf_get_index_bytes());
+
+	size_t decoder_bytes = 0;
+	if (p_info->vpx_if && !p_info->is_degraded)
+	{
+		decoder_bytes = pool::estimateDecoderBytes(p_info->vpx_if, p_info->decoder_width, p_info->decoder_height);
+		if (p_info->up_alpha)
+		{
+			decoder_bytes *= 2;
+		}
+
+		//the reference frames are 16 bits samples too.
+		if (p_info->bit_depth > 8)
+		{
+			decoder_bytes *= 2;
+		}
+
+		decoder_bytes += p_info->preview_planes.capacity();
+	}
+	account.set(memory::KindDecoder, decoder_bytes);
+
+	size_t gpu_bytes = 0;
+	if (m_sp_fbo)
+	{
+		gpu_bytes = pool::estimateFboBytes(static_cast<u32>(m_sp_fbo->getWidth()), static_cast<u32>(m_sp_fbo->getHeight()));
+	}
+
+	if (m_gl_tex2d_planes[0])
+	{
+		pool::TextureKey const& key = p_info->texture_key;
+		size_t const bytes_per_sample = key.internalformat == GL_R16 ? 2 : 1;
+		for (u32 i = 0; i < key.count; ++i)
+		{
+			gpu_bytes += static_cast<size_t>(key.width[i]) * key.height[i] * bytes_per_sample;
+		}
+	}
+	account.set(memory::KindGpu, gpu_bytes);
+}
+
+//Gives back what a load can bring again: the movie, the audio, the index and
+//the decoder. The GL stays, so the last frame is still drawn.
+void ofxWebMPlayer::mf_degrade()
+{
+	VpxMovInfo* p_info = m_vpx_mov_info;
+	if (!isLoaded() || p_info->is_degraded || !p_info->live_path.empty() || m_is_audio_chained)
+	{
+		return;
+	}
+
+	if (p_info->has_audio)
+	{
+		audio::Mixer::instance().removeSource(this);
+		p_info->sp_pcm_store = nullptr;
+		p_info->has_audio = false;
+	}
 
+	trace::instant("degrade", p_info->trace_id, p_info->cur_mov_frame_idx);
+
+	//the decoder is destroyed, not pooled, the pool is what is trimmed first. The
+	//movie block still goes back to the pool, Budget::enforce() trims it from there.
+	vpx_codec_destroy(&p_info->vpx_ctx);
+	p_info->up_alpha = nullptr;
+	std::vector<u8>().swap(p_info->preview_planes);
+
+	p_info->frame_index = FrameIndex();
+	std::vector<sidecar::AudioPacket>().swap(p_info->box_audio_packet);
+	p_info->p_video_track = NULL;
+	p_info->p_next_block = NULL;
+	p_info->up_segment = nullptr;
+	p_info->up_demuxer = nullptr;
+	p_info->up_stream_reader = nullptr;
+	p_info->up_reader = nullptr;
+	p_info->sp_mb_movie_body = nullptr;
+	p_info->sp_index = nullptr;
+	p_info->is_degraded = true;
+	mf_charge_memory();
+
+	ofLogNotice("ofxWebMPlayer", "The memory budget degraded [%s], it loads again when it is played.", p_info->load_name.c_str());
 }
 
+//loads a degraded player again and decodes up to the frame it was on, false if that failed.
+bool ofxWebMPlayer::mf_restore()
+{
+	VpxMovInfo* p_info = m_vpx_mov_info;
+	if (!p_info->is_degraded)
+	{
+		return true;
+	}
+
+	trace::Scope trace_scope("restore", p_info->trace_id);
+	s32 const frame_idx = p_info->cur_mov_frame_idx;
+	u64 const total_tick_mills = p_info->total_tick_mills;
+	u64 const audio_cur_frame = p_info->audio_cur_frame;
+	u64 const accum_samples = p_info->accum_samples;
+	bool const is_audio_end = p_info->is_audio_end;
+
+	mf_reserve_memory(p_info->load_name);
+
+	p_info->is_degraded = false;
+	p_info->has_video = false;
+	p_info->vpx_if = NULL;
+	if (!mf_load_movie(p_info->load_name))
+	{
+		ofLogError("ofxWebMPlayer", "The memory budget degraded [%s], it failed to load again.", p_info->load_name.c_str());
+		p_info->has_video = true;
+		mf_unload();
+		m_is_playing = false;
+		return false;
+	}
+
+	p_info->p_first_image = NULL;
+	if (frame_idx > 0 && mf_index_frames(frame_idx))
+	{
+		mf_decode_to(frame_idx);
+	}
+
+	p_info->total_tick_mills = total_tick_mills;
+	p_info->audio_cur_frame = audio_cur_frame;
+	p_info->accum_samples = accum_samples;
+	p_info->is_audio_end = is_audio_end;
+
+	//play() of a movie which is not playing sets the audio up itself.
+	if (m_is_playing && p_info->has_audio && !m_is_audio_chained)
+	{
+		audio::Mixer::instance().addSource(this);
+	}
+
+	mf_charge_memory();
+	return true;
+}
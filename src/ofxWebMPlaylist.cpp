@@ -0,0 +1,593 @@
+#include "ofxWebMPlaylist.h"
+
+#include <algorithm>
+#include <thread>
+#include "intern_base.h"
+#include "intern_audio_dsp.h"
+#include "intern_audio_resampler.h"
+#include "intern_audio_mixer.h"
+
+//The callback uses one of two stages, the one of the format playing. The other
+//is built on this thread for the next movie, and mf_switch() swaps them, so the
+//callback never sets anything up.
+struct ofxWebMPlaylist::AudioChain
+{
+	typedef struct Stage
+	{
+		u32					src_rate;		//0 if not built
+		audio::MixMatrix	mix_matrix;
+		audio::Resampler	resampler;
+		std::vector<f32>	scratch;
+		std::vector<f32>	pull;
+
+		bool isFor(u32 rate, u32 channels) const
+		{
+			return src_rate && src_rate == rate && mix_matrix.src_channels == channels;
+		}
+	} Stage;
+
+	u32					out_rate;
+	u32					dst_channels;
+	audio::GainStage	gain_stage;
+	Stage				stages[2];
+	std::atomic<u32>	active;				//the stage of the callback, only this thread changes it
+	std::atomic<u32>	device_channels;	//set by the callback when the device has another layout, 0 if not
+};
+
+ofxWebMPlaylist::ofxWebMPlaylist()
+{
+	enum { AudioChainSize = sizeof(AudioChain) };
+	static_assert(MaxAudioChainInsSize >= AudioChainSize, "The size of the instance is not enough.");
+
+	m_audio_chain = ::new(m_audio_chain_instance) AudioChain;
+	m_audio_chain->out_rate = 0;
+	m_audio_chain->dst_channels = 0;
+	m_audio_chain->active = 0;
+	m_audio_chain->device_channels = 0;
+	for (AudioChain::Stage& stage : m_audio_chain->stages)
+	{
+		stage.src_rate = 0;
+		memset(&stage.mix_matrix, 0x00, sizeof(stage.mix_matrix));
+	}
+
+	for (ofxWebMPlayer& player : m_players)
+	{
+		player.m_is_audio_chained = true;
+	}
+
+	m_cur_slot = 0;
+	m_cur_item = -1;
+	m_next_item = -1;
+	m_is_next_ready = false;
+	m_is_playing = false;
+	m_is_loop = false;
+	m_enable_audio = false;
+	m_is_audio_added = false;
+
+	m_is_paused = false;
+	m_volume = 1.f;
+	m_p_audio_cur = NULL;
+	m_p_audio_next = NULL;
+	m_callback_seq = 0;
+}
+
+ofxWebMPlaylist::~ofxWebMPlaylist()
+{
+	stop();
+	m_audio_chain->~AudioChain();
+}
+
+void ofxWebMPlaylist::enableAudio(bool yes)
+{
+	m_enable_audio = yes;
+}
+
+void ofxWebMPlaylist::add(std::string name)
+{
+	m_names.push_back(name);
+
+	//the list had run out, the new movie is the next one.
+	if (m_is_playing && m_next_item < 0)
+	{
+		mf_preload(m_cur_item + 1);
+	}
+}
+
+void ofxWebMPlaylist::clear()
+{
+	stop();
+	m_names.clear();
+}
+
+size_t ofxWebMPlaylist::getCount() const
+{
+	return m_names.size();
+}
+
+int ofxWebMPlaylist::getCurrentIndex() const
+{
+	return m_cur_item;
+}
+
+bool ofxWebMPlaylist::play()
+{
+	if (m_is_playing)
+	{
+		setPaused(false);
+		return true;
+	}
+
+	if (m_names.empty())
+	{
+		return false;
+	}
+
+	stop();
+
+	//the first movie has nothing to hide its load behind.
+	ofxWebMPlayer& cur = mf_cur();
+	cur.enableAudio(m_enable_audio);
+	if (!cur.load(m_names[0]))
+	{
+		ofLogError("ofxWebMPlaylist", "play(): Failed to load [%s].", m_names[0].c_str());
+		return false;
+	}
+
+	m_cur_item = 0;
+	cur.mf_rewind_audio();
+	cur.play();
+
+	u32 sample_rate, channels;
+	m_p_audio_cur = cur.mf_get_audio_format(&sample_rate, &channels) ? &cur : NULL;
+	mf_start_audio();
+
+	m_is_playing = true;
+	m_is_paused = false;
+	mf_preload(m_cur_item + 1);
+	return true;
+}
+
+void ofxWebMPlaylist::stop()
+{
+	mf_stop_audio();
+
+	for (ofxWebMPlayer& player : m_players)
+	{
+		player.close();
+	}
+
+	m_is_playing = false;
+	m_cur_item = -1;
+	m_next_item = -1;
+	m_is_next_ready = false;
+}
+
+void ofxWebMPlaylist::setPaused(bool yes)
+{
+	m_is_paused = yes;
+	mf_cur().setPaused(yes);
+}
+
+bool ofxWebMPlaylist::isPaused() const
+{
+	return m_is_paused;
+}
+
+bool ofxWebMPlaylist::isPlaying() const
+{
+	return m_is_playing;
+}
+
+void ofxWebMPlaylist::setLoop(bool yes)
+{
+	m_is_loop = yes;
+	if (m_is_playing && m_next_item < 0)
+	{
+		mf_preload(m_cur_item + 1);
+	}
+}
+
+void ofxWebMPlaylist::setVolume(float volume)
+{
+	m_volume = ofClamp(volume, 0.f, 1.f);
+}
+
+void ofxWebMPlaylist::update()
+{
+	ofxWebMPlayer& next = mf_next();
+	if (m_next_item >= 0 && !m_is_next_ready)
+	{
+		//finishes the loadAsync() on this thread.
+		next.update();
+
+		u32 sample_rate, channels;
+		if (next.isLoaded())
+		{
+			next.mf_rewind_audio();
+			m_is_next_ready = true;
+			if (next.mf_get_audio_format(&sample_rate, &channels))
+			{
+				mf_prepare_audio_stage(sample_rate, channels);
+				m_p_audio_next = &next;
+			}
+		}
+		else if (!next.mf_is_loading())
+		{
+			ofLogError("ofxWebMPlaylist", "update(): Failed to load [%s], it is skipped.", m_names[m_next_item].c_str());
+			mf_preload(m_next_item + 1);
+		}
+	}
+
+	if (!m_is_playing)
+	{
+		return;
+	}
+
+	u32 const device_channels = m_audio_chain->device_channels;
+	if (device_channels && m_is_audio_added)
+	{
+		//the callback is kept away while the stages are built for the device layout.
+		audio::Mixer& mixer = audio::Mixer::instance();
+		mixer.removeSource(this);
+		mf_build_audio_chain(device_channels);
+		mixer.addSource(this);
+	}
+
+	ofxWebMPlayer& cur = mf_cur();
+	cur.update();
+	if (cur.isPlaying())
+	{
+		return;
+	}
+
+	if (m_next_item < 0)
+	{
+		//the end of the list, the last frame stays.
+		m_is_playing = false;
+		mf_stop_audio();
+		return;
+	}
+
+	//the load is later than the movie, the last frame stays until it is there.
+	if (m_is_next_ready)
+	{
+		mf_switch();
+	}
+}
+
+bool ofxWebMPlaylist::isFrameNew() const
+{
+	return m_players[m_cur_slot].isFrameNew();
+}
+
+ofTexture* ofxWebMPlaylist::getTexturePtr()
+{
+	return mf_cur().getTexturePtr();
+}
+
+void ofxWebMPlaylist::draw(float x, float y)
+{
+	draw(x, y, getWidth(), getHeight());
+}
+
+void ofxWebMPlaylist::draw(float x, float y, float w, float h)
+{
+	if (!mf_cur().isLoaded())
+	{
+		return;
+	}
+
+	getTexturePtr()->draw(x, y, w, h);
+}
+
+float ofxWebMPlaylist::getWidth() const
+{
+	return m_players[m_cur_slot].getWidth();
+}
+
+float ofxWebMPlaylist::getHeight() const
+{
+	return m_players[m_cur_slot].getHeight();
+}
+
+ofxWebMPlayer& ofxWebMPlaylist::getCurrentPlayer()
+{
+	return mf_cur();
+}
+
+void ofxWebMPlaylist::audioOut(float* output, int bufferSize, int nChannels)
+{
+	++m_callback_seq;
+
+	AudioChain& chain = *m_audio_chain;
+	u32 const frames = static_cast<u32>(bufferSize);
+	u32 const dst_channels = static_cast<u32>(nChannels);
+
+	u32 const active = chain.active;
+	AudioChain::Stage& stage = chain.stages[active];
+
+	//the device did not give us the layout of the settings, update() builds the
+	//stages again. A movie of another format waits for mf_switch(). Silence until then.
+	if (dst_channels != chain.dst_channels)
+	{
+		chain.device_channels = dst_channels;
+	}
+
+	u32 sample_rate, channels;
+	ofxWebMPlayer* p_player = m_p_audio_cur;
+	if (m_is_paused || !p_player || !p_player->mf_get_audio_format(&sample_rate, &channels) ||
+		dst_channels != chain.dst_channels || !stage.isFor(sample_rate, channels))
+	{
+		memset(output, 0x00, sizeof(f32) * frames * dst_channels);
+		++m_callback_seq;
+		return;
+	}
+
+	if (stage.resampler.isPassthrough())
+	{
+		mf_pull_audio(active, output, frames);
+	}
+	else
+	{
+		stage.resampler.process(output, frames, [this, active](f32* dst, u32 count)
+		{
+			mf_pull_audio(active, dst, count);
+		}, stage.pull);
+	}
+
+	f32 gain[audio::MaxChannels];
+	audio::computeChannelGains(gain, dst_channels, m_volume, 0.f);
+	chain.gain_stage.process(output, frames, gain);
+
+	++m_callback_seq;
+}
+
+ofxWebMPlayer& ofxWebMPlaylist::mf_cur()
+{
+	return m_players[m_cur_slot];
+}
+
+ofxWebMPlayer& ofxWebMPlaylist::mf_next()
+{
+	return m_players[m_cur_slot ^ 1];
+}
+
+//loads the movie after the current one into the other player, item wraps with the loop.
+void ofxWebMPlaylist::mf_preload(int item)
+{
+	m_next_item = -1;
+	m_is_next_ready = false;
+
+	if (item >= static_cast<int>(m_names.size()))
+	{
+		if (!m_is_loop || m_names.empty())
+		{
+			return;
+		}
+
+		item = 0;
+	}
+
+	ofxWebMPlayer& next = mf_next();
+	next.close();
+	next.enableAudio(m_enable_audio);
+	next.loadAsync(m_names[item]);
+	m_next_item = item;
+}
+
+void ofxWebMPlaylist::mf_switch()
+{
+	ofxWebMPlayer& cur = mf_cur();
+	ofxWebMPlayer& next = mf_next();
+
+	//the clock went on past the last frame, the next movie starts that far in.
+	u64 const overrun_millis = cur.mf_get_overrun_millis();
+
+	//the samples of the next movie may be playing already, from here on they are
+	//the only ones. The callback has to be out of cur before it is closed.
+	u32 sample_rate, channels;
+	bool const has_audio = next.mf_get_audio_format(&sample_rate, &channels);
+	m_p_audio_cur = has_audio ? &next : NULL;
+	m_p_audio_next = NULL;
+	if (has_audio && m_is_audio_added)
+	{
+		mf_use_audio_stage(sample_rate, channels);
+	}
+
+	mf_wait_audio();
+
+	cur.close();
+	m_cur_slot ^= 1;
+	m_cur_item = m_next_item;
+
+	next.setPaused(m_is_paused);
+	next.play();
+	next.mf_set_play_millis(overrun_millis);
+	next.forceUpdate();
+	mf_start_audio();
+
+	mf_preload(m_cur_item + 1);
+}
+
+void ofxWebMPlaylist::mf_start_audio()
+{
+	u32 sample_rate, channels;
+	ofxWebMPlayer* p_player = m_p_audio_cur;
+	if (m_is_audio_added || !p_player || !p_player->mf_get_audio_format(&sample_rate, &channels))
+	{
+		return;
+	}
+
+	ofxWebMPlayer::AudioOutputSettings const& settings = ofxWebMPlayer::getAudioOutputSettings();
+	audio::Mixer& mixer = audio::Mixer::instance();
+	if (!mixer.open(settings.sample_rate ? settings.sample_rate : sample_rate, settings.num_channels, settings.buffer_size, settings.num_buffers))
+	{
+		ofLogError("ofxWebMPlaylist", "play(): Failed to open the audio output device.");
+	}
+
+	//not registered yet, the callback does not see the chain.
+	m_audio_chain->out_rate = mixer.getSampleRate();
+	mf_build_audio_chain(mixer.getChannels());
+
+	if (!mixer.addSource(this))
+	{
+		ofLogError("ofxWebMPlaylist", "play(): Too many players with audio are playing.");
+		return;
+	}
+
+	m_is_audio_added = true;
+}
+
+void ofxWebMPlaylist::mf_stop_audio()
+{
+	m_p_audio_cur = NULL;
+	m_p_audio_next = NULL;
+
+	if (m_is_audio_added)
+	{
+		//waits for the callback too.
+		audio::Mixer::instance().removeSource(this);
+		m_is_audio_added = false;
+	}
+}
+
+//odd means a callback is running, wait for the next even value.
+void ofxWebMPlaylist::mf_wait_audio()
+{
+	u32 seq = m_callback_seq.load();
+	if (seq & 1)
+	{
+		while (m_callback_seq.load() == seq)
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+//both stages for the layout of the device, the callback must not be running.
+void ofxWebMPlaylist::mf_build_audio_chain(u32 dst_channels)
+{
+	AudioChain& chain = *m_audio_chain;
+	chain.dst_channels = dst_channels;
+	chain.device_channels = 0;
+	chain.active = 0;
+	chain.stages[0].src_rate = 0;
+	chain.stages[1].src_rate = 0;
+
+	//start from silence, the first callback ramps up to the volume.
+	f32 gain[audio::MaxChannels] = { 0.f };
+	chain.gain_stage.reset(dst_channels, gain);
+
+	u32 sample_rate, channels;
+	ofxWebMPlayer* p_cur = m_p_audio_cur;
+	if (p_cur && p_cur->mf_get_audio_format(&sample_rate, &channels))
+	{
+		mf_setup_audio_stage(0, sample_rate, channels);
+	}
+
+	ofxWebMPlayer* p_next = m_p_audio_next;
+	if (p_next && p_next->mf_get_audio_format(&sample_rate, &channels))
+	{
+		mf_prepare_audio_stage(sample_rate, channels);
+	}
+}
+
+//the stage the callback does not use, built for the next movie if its format is another.
+void ofxWebMPlaylist::mf_prepare_audio_stage(u32 sample_rate, u32 channels)
+{
+	AudioChain& chain = *m_audio_chain;
+	u32 const idle = chain.active ^ 1;
+	if (!chain.dst_channels || chain.stages[chain.active].isFor(sample_rate, channels) || chain.stages[idle].isFor(sample_rate, channels))
+	{
+		return;
+	}
+
+	mf_setup_audio_stage(idle, sample_rate, channels);
+}
+
+//the callback goes on with the stage of the format, mf_wait_audio() after it
+//and the other stage is free to build again.
+void ofxWebMPlaylist::mf_use_audio_stage(u32 sample_rate, u32 channels)
+{
+	AudioChain& chain = *m_audio_chain;
+	if (chain.stages[chain.active].isFor(sample_rate, channels))
+	{
+		return;
+	}
+
+	mf_prepare_audio_stage(sample_rate, channels);
+	chain.active = chain.active ^ 1;
+}
+
+//everything the callback needs for the format, allocated here and not in the callback.
+void ofxWebMPlaylist::mf_setup_audio_stage(u32 index, u32 src_rate, u32 src_channels)
+{
+	AudioChain& chain = *m_audio_chain;
+	AudioChain::Stage& stage = chain.stages[index];
+	if (!stage.resampler.setup(src_rate, chain.out_rate, chain.dst_channels))
+	{
+		ofLogWarning("ofxWebMPlaylist", "Can not resample %u Hz to %u Hz, the pitch will be wrong.", src_rate, chain.out_rate);
+	}
+
+	audio::buildMixMatrix(&stage.mix_matrix, src_channels, chain.dst_channels);
+	u32 src_frames = stage.resampler.getInputFrames(ofxWebMPlayer::getAudioOutputSettings().buffer_size);
+	stage.scratch.resize(src_frames * stage.mix_matrix.src_channels);
+	stage.pull.resize(stage.resampler.getMaxPullFrames() * chain.dst_channels);
+	stage.src_rate = src_rate;
+}
+
+//the source frames of the current movie, then of the next one, in the layout of the device.
+void ofxWebMPlaylist::mf_pull_audio(u32 index, f32* output, u32 frames)
+{
+	AudioChain::Stage& stage = m_audio_chain->stages[index];
+	audio::MixMatrix const& mat = stage.mix_matrix;
+	u32 const chunk_frames = mat.src_channels ? static_cast<u32>(stage.scratch.size() / mat.src_channels) : 0;
+
+	u32 done = 0;
+	while (done < frames)
+	{
+		u32 sample_rate, channels;
+		ofxWebMPlayer* p_player = m_p_audio_cur;
+		if (!p_player || !p_player->mf_get_audio_format(&sample_rate, &channels) || !stage.isFor(sample_rate, channels))
+		{
+			//a movie of another format goes on after mf_switch().
+			break;
+		}
+
+		f32* dst = output + done * mat.dst_channels;
+		u32 want = frames - done;
+		u32 got;
+		if (mat.is_identity)
+		{
+			got = p_player->mf_read_audio_frames(dst, want);
+		}
+		else
+		{
+			//in pieces of the scratch, it is not grown here.
+			want = std::min(want, chunk_frames);
+			if (!want)
+			{
+				break;
+			}
+
+			got = p_player->mf_read_audio_frames(stage.scratch.data(), want);
+			audio::mixChannels(mat, stage.scratch.data(), mat.src_channels, dst, got);
+		}
+
+		done += got;
+		if (got < want)
+		{
+			//the end of the movie, the next one goes on from here.
+			ofxWebMPlayer* p_next = m_p_audio_next;
+			if (!p_next || p_next == p_player || !m_p_audio_cur.compare_exchange_strong(p_player, p_next))
+			{
+				break;
+			}
+		}
+	}
+
+	if (done < frames)
+	{
+		memset(output + done * mat.dst_channels, 0x00, sizeof(f32) * (frames - done) * mat.dst_channels);
+	}
+}
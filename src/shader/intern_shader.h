@@ -1,5 +1,6 @@
 #include "shader.vert.h" 
 #include "shader601.frag.h" 
 #include "shader709.frag.h" 
+#include "shader2020.frag.h" 
 #include "shaderARGB.frag.h" 
 #include "shaderBGRA.frag.h" 
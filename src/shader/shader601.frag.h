@@ -11,6 +11,7 @@ in vec4 pixel_coord;
 uniform vec4 v4_plane_width;
 uniform vec4 v4_plane_height;
 uniform vec2 v2_chroma_shift;
+uniform float f_sample_scale;		//1.0, or 65535 / 1023 and 65535 / 4095 for 10 and 12 bits in 16 bits
 
 uniform sampler2D tex_y;
 uniform sampler2D tex_u;
@@ -30,9 +31,9 @@ void main()
 	vec2 tex_uv_coord = vec2(uv_coord.x / v4_plane_width.y, uv_coord.y / v4_plane_height.y);
 	
 	vec3 yuv;
-	yuv.x = texture(tex_y, tex_y_coord).x;
-	yuv.y = texture(tex_u, tex_uv_coord).x;
-	yuv.z = texture(tex_v, tex_uv_coord).x;
+	yuv.x = texture(tex_y, tex_y_coord).x * f_sample_scale;
+	yuv.y = texture(tex_u, tex_uv_coord).x * f_sample_scale;
+	yuv.z = texture(tex_v, tex_uv_coord).x * f_sample_scale;
 	
 	vec3 ycbcr = vec3(yuv.x - 0.0625, yuv.y - 0.5, yuv.z - 0.5);
 	vec3 rgb;
@@ -42,7 +43,7 @@ void main()
 	
 #ifdef USE_ALPHA_CHANNEL
 	vec2 tex_alpha_coord = vec2(pixel_coord.x / v4_plane_width.w, pixel_coord.y / v4_plane_height.w);
-	float alpha = texture(tex_alpha, tex_alpha_coord);
+	float alpha = texture(tex_alpha, tex_alpha_coord).x * f_sample_scale;
 	
 #else
 	float alpha = 1.0;
@@ -0,0 +1,9 @@
+@REM Run it from "VS2015 x64 Native Tools Command Prompt".
+@SET path_tool=%~dp0
+@SET path_addon=%path_tool%..\..
+@SET path_webm=%path_addon%\libs\libwebm
+@SET path_vpx=%path_addon%\libs\libvpx
+
+@cl /nologo /EHsc /O2 /MD /I"%path_addon%\src" /I"%path_webm%\include" /I"%path_vpx%\include" "%path_tool%webm_frames.cpp" /Fe"%path_tool%webm_frames.exe" /Fo"%TEMP%\\" /link /LIBPATH:"%path_webm%\lib\vs2015\x64\Release" /LIBPATH:"%path_vpx%\lib\vs2015\x64" mkvparser.lib vpxmd.lib
+
+@PAUSE
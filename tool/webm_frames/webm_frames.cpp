@@ -0,0 +1,506 @@
+// Extracts frames of movies to PPM or raw planes, without a window or GL: the
+// demux (mkvparser) and the decode (libvpx) of ofxWebMPlayer only. A frame is
+// decoded from the key frame before it, the next one in the same GOP goes on
+// from there, so a sheet of key frames costs one decode per thumbnail.
+//
+// usage: webm_frames [options] <movie.webm> [<movie.webm> ...]
+//	-t <s,s,...>	the frames at these times, in seconds
+//	-i <n,n,...>	the frames at these indices
+//	-k				every key frame
+//	-n <count>		count frames evenly over the movie, each on the key frame before it
+//	-f ppm|raw		ppm (default) is 8 bits RGB, raw is the planes as decoded
+//	-o <dir>		where the files go, default is the directory of the movie
+//	-j <threads>	the movies decoded at once, default is the number of cores
+//
+// the files are "<movie>_<frame index>.ppm" or ".yuv".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mkvparser/mkvparser.h"
+#include "mkvparser/mkvreader.h"
+#include "vpx_decoder.h"
+#include "vp8dx.h"
+#include "intern_base.h"
+
+typedef struct Options
+{
+	std::vector<f64>	times;
+	std::vector<u32>	indices;
+	bool				is_every_key;
+	u32					count;
+	bool				is_raw;
+	std::string			out_dir;
+	u32					threads;
+} Options;
+
+typedef struct Frame
+{
+	s64	pos;
+	u32	len;
+	s64	time_ns;
+	u32	key;		//the index of the key frame of its GOP
+} Frame;
+
+static bool gf_parse_list(char const* str, std::vector<f64>* p_out)
+{
+	while (*str)
+	{
+		char* p_end;
+		p_out->push_back(strtod(str, &p_end));
+		if (p_end == str || (*p_end && *p_end != ','))
+		{
+			return false;
+		}
+
+		str = *p_end ? p_end + 1 : p_end;
+	}
+
+	return true;
+}
+
+static std::string gf_get_out_path(char const* path, Options const& opt, u32 frame_idx)
+{
+	std::string name = path;
+	size_t slash = name.find_last_of("/\\");
+	std::string dir = opt.out_dir.empty() ? (slash == std::string::npos ? "" : name.substr(0, slash + 1)) : opt.out_dir + "/";
+	name = slash == std::string::npos ? name : name.substr(slash + 1);
+	name = name.substr(0, name.find_last_of('.'));
+
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), "_%06u.%s", frame_idx, opt.is_raw ? "yuv" : "ppm");
+	return dir + name + suffix;
+}
+
+//the planes as they are, the visible samples only.
+static bool gf_write_raw(FILE* fp, vpx_image_t const* p_image)
+{
+	u32 const bytes_per_sample = (p_image->fmt & VPX_IMG_FMT_HIGHBITDEPTH) ? 2 : 1;
+	for (u32 i = 0; i < 3; ++i)
+	{
+		u32 const w = i ? (p_image->d_w + p_image->x_chroma_shift) >> p_image->x_chroma_shift : p_image->d_w;
+		u32 const h = i ? (p_image->d_h + p_image->y_chroma_shift) >> p_image->y_chroma_shift : p_image->d_h;
+		for (u32 y = 0; y < h; ++y)
+		{
+			if (fwrite(p_image->planes[i] + static_cast<size_t>(y) * p_image->stride[i], bytes_per_sample, w, fp) != w)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+//the matrices of the shaders of the player for the limited range, the full
+//range ones have no scale in them.
+static bool gf_write_ppm(FILE* fp, vpx_image_t const* p_image)
+{
+	bool const is_full = p_image->range == VPX_CR_FULL_RANGE;
+	f32 rv, gu, gv, bu;
+	if (p_image->cs == VPX_CS_BT_709)
+	{
+		if (is_full) { rv = 1.5748f; gu = -0.1873f; gv = -0.4681f; bu = 1.8556f; }
+		else { rv = 1.7927f; gu = -0.2133f; gv = -0.5329f; bu = 2.1124f; }
+	}
+	else if (p_image->cs == VPX_CS_BT_2020)
+	{
+		if (is_full) { rv = 1.4746f; gu = -0.16455f; gv = -0.57135f; bu = 1.8814f; }
+		else { rv = 1.6787f; gu = -0.1873f; gv = -0.6504f; bu = 2.1418f; }
+	}
+	else
+	{
+		if (is_full) { rv = 1.402f; gu = -0.344136f; gv = -0.714136f; bu = 1.772f; }
+		else { rv = 1.5960f; gu = -0.3918f; gv = -0.8130f; bu = 2.0172f; }
+	}
+
+	f32 const y_offset = is_full ? 0.f : 0.0625f;
+	f32 const y_scale = is_full ? 1.f : 1.1644f;
+	bool const is_high_bit_depth = (p_image->fmt & VPX_IMG_FMT_HIGHBITDEPTH) != 0;
+	f32 const to_one = 1.f / ((1 << (is_high_bit_depth ? p_image->bit_depth : 8)) - 1);
+
+	fprintf(fp, "P6\n%u %u\n255\n", p_image->d_w, p_image->d_h);
+	std::vector<u8> row(p_image->d_w * 3);
+	for (u32 y = 0; y < p_image->d_h; ++y)
+	{
+		u32 const cy = y >> p_image->y_chroma_shift;
+		for (u32 x = 0; x < p_image->d_w; ++x)
+		{
+			u32 const cx = x >> p_image->x_chroma_shift;
+			f32 sy, su, sv;
+			if (is_high_bit_depth)
+			{
+				sy = reinterpret_cast<u16 const*>(p_image->planes[VPX_PLANE_Y] + static_cast<size_t>(y) * p_image->stride[VPX_PLANE_Y])[x];
+				su = reinterpret_cast<u16 const*>(p_image->planes[VPX_PLANE_U] + static_cast<size_t>(cy) * p_image->stride[VPX_PLANE_U])[cx];
+				sv = reinterpret_cast<u16 const*>(p_image->planes[VPX_PLANE_V] + static_cast<size_t>(cy) * p_image->stride[VPX_PLANE_V])[cx];
+			}
+			else
+			{
+				sy = p_image->planes[VPX_PLANE_Y][static_cast<size_t>(y) * p_image->stride[VPX_PLANE_Y] + x];
+				su = p_image->planes[VPX_PLANE_U][static_cast<size_t>(cy) * p_image->stride[VPX_PLANE_U] + cx];
+				sv = p_image->planes[VPX_PLANE_V][static_cast<size_t>(cy) * p_image->stride[VPX_PLANE_V] + cx];
+			}
+
+			f32 const l = (sy * to_one - y_offset) * y_scale;
+			f32 const u = su * to_one - 0.5f;
+			f32 const v = sv * to_one - 0.5f;
+			f32 const rgb[3] = { l + rv * v, l + gu * u + gv * v, l + bu * u };
+			for (u32 c = 0; c < 3; ++c)
+			{
+				f32 const clamped = std::min(std::max(rgb[c], 0.f), 1.f);
+				row[x * 3 + c] = static_cast<u8>(clamped * 255.f + 0.5f);
+			}
+		}
+
+		if (fwrite(row.data(), 1, row.size(), fp) != row.size())
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool gf_write_image(std::string const& path, vpx_image_t const* p_image, Options const& opt)
+{
+	FILE* fp = fopen(path.c_str(), "wb");
+	if (!fp)
+	{
+		return false;
+	}
+
+	bool is_ok = opt.is_raw ? gf_write_raw(fp, p_image) : gf_write_ppm(fp, p_image);
+	is_ok = fclose(fp) == 0 && is_ok;
+	return is_ok;
+}
+
+//the frames of the first video track, in decode order, as the player indexes them.
+static mkvparser::VideoTrack const* gf_index_frames(mkvparser::Segment const* p_segment, std::vector<Frame>* p_frames)
+{
+	mkvparser::Tracks const* p_tracks = p_segment->GetTracks();
+	mkvparser::Track const* p_video = NULL;
+	for (u32 i = 0; p_tracks && i < p_tracks->GetTracksCount() && !p_video; ++i)
+	{
+		mkvparser::Track const* p_track = p_tracks->GetTrackByIndex(i);
+		if (p_track && p_track->GetType() == mkvparser::Track::kVideo)
+		{
+			p_video = p_track;
+		}
+	}
+
+	if (!p_video)
+	{
+		return NULL;
+	}
+
+	mkvparser::BlockEntry const* p_entry = NULL;
+	p_video->GetFirst(p_entry);
+
+	u32 key = 0;
+	while (p_entry && !p_entry->EOS())
+	{
+		mkvparser::Block const* p_block = p_entry->GetBlock();
+		if (p_block)
+		{
+			if (p_block->IsKey())
+			{
+				key = static_cast<u32>(p_frames->size());
+			}
+
+			s64 time_ns = p_block->GetTime(p_entry->GetCluster());
+			for (s32 f = 0; f < p_block->GetFrameCount(); ++f)
+			{
+				mkvparser::Block::Frame const& frame = p_block->GetFrame(f);
+				Frame info = { frame.pos, static_cast<u32>(frame.len), time_ns, key };
+				p_frames->push_back(info);
+			}
+		}
+
+		p_video->GetNext(p_entry, p_entry);
+	}
+
+	return static_cast<mkvparser::VideoTrack const*>(p_video);
+}
+
+//the frames asked for, sorted so the decoder only goes forward within a GOP.
+static std::vector<u32> gf_get_targets(std::vector<Frame> const& frames, Options const& opt)
+{
+	u32 const frame_count = static_cast<u32>(frames.size());
+	std::vector<u32> targets;
+	for (f64 t : opt.times)
+	{
+		//the last frame which starts at or before t.
+		s64 const t_ns = static_cast<s64>(t * 1e9);
+		auto it = std::upper_bound(frames.begin(), frames.end(), t_ns, [](s64 v, Frame const& f) { return v < f.time_ns; });
+		targets.push_back(it == frames.begin() ? 0 : static_cast<u32>(it - frames.begin() - 1));
+	}
+
+	for (u32 idx : opt.indices)
+	{
+		if (idx < frame_count)
+		{
+			targets.push_back(idx);
+		}
+	}
+
+	for (u32 i = 0; i < frame_count && opt.is_every_key; ++i)
+	{
+		if (frames[i].key == i)
+		{
+			targets.push_back(i);
+		}
+	}
+
+	for (u32 i = 0; i < opt.count; ++i)
+	{
+		targets.push_back(frames[static_cast<u64>(i) * frame_count / opt.count].key);
+	}
+
+	std::sort(targets.begin(), targets.end());
+	targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+	return targets;
+}
+
+static bool gf_extract(char const* path, Options const& opt)
+{
+	mkvparser::MkvReader reader;
+	if (reader.Open(path) != 0)
+	{
+		fprintf(stderr, "%s: can not open the file.\n", path);
+		return false;
+	}
+
+	long long pos = 0;
+	mkvparser::EBMLHeader ebml_header;
+	if (ebml_header.Parse(&reader, pos) < 0)
+	{
+		fprintf(stderr, "%s: not WebM format.\n", path);
+		return false;
+	}
+
+	mkvparser::Segment* p_segment;
+	if (mkvparser::Segment::CreateInstance(&reader, pos, p_segment) < 0)
+	{
+		fprintf(stderr, "%s: Segment::CreateInstance() failed.\n", path);
+		return false;
+	}
+
+	std::unique_ptr<mkvparser::Segment> up_segment(p_segment);
+	if (p_segment->Load() < 0)
+	{
+		fprintf(stderr, "%s: Segment::Load() failed.\n", path);
+		return false;
+	}
+
+	std::vector<Frame> frames;
+	mkvparser::VideoTrack const* p_video = gf_index_frames(p_segment, &frames);
+	if (!p_video || frames.empty())
+	{
+		fprintf(stderr, "%s: no video frame.\n", path);
+		return false;
+	}
+
+	char const* codec_id = p_video->GetCodecId() ? p_video->GetCodecId() : "";
+	vpx_codec_iface_t* p_iface = NULL;
+	if (strcmp(codec_id, "V_VP8") == 0)
+	{
+		p_iface = vpx_codec_vp8_dx();
+	}
+	else if (strcmp(codec_id, "V_VP9") == 0)
+	{
+		p_iface = vpx_codec_vp9_dx();
+	}
+	else
+	{
+		fprintf(stderr, "%s: the codec [%s] is not supported.\n", path, codec_id);
+		return false;
+	}
+
+	//the cores left by the movies decoded at once.
+	vpx_codec_dec_cfg_t cfg;
+	cfg.threads = std::max(1u, std::thread::hardware_concurrency() / std::max(1u, opt.threads));
+	cfg.w = static_cast<u32>(p_video->GetWidth());
+	cfg.h = static_cast<u32>(p_video->GetHeight());
+
+	vpx_codec_ctx_t ctx;
+	bool is_init = false;
+	s64 cur_idx = -1;
+	vpx_image_t* p_image = NULL;
+	std::vector<u8> buffer;
+	u32 decode_count = 0;
+	u32 write_count = 0;
+	bool is_ok = true;
+
+	for (u32 target : gf_get_targets(frames, opt))
+	{
+		//on from the frame before if it is in the same GOP, from the key frame otherwise.
+		u32 begin = static_cast<u32>(cur_idx + 1);
+		if (cur_idx < 0 || frames[cur_idx].key != frames[target].key)
+		{
+			//the image belongs to the context.
+			p_image = NULL;
+			if (is_init)
+			{
+				vpx_codec_destroy(&ctx);
+			}
+
+			is_init = !vpx_codec_dec_init(&ctx, p_iface, &cfg, 0);
+			if (!is_init)
+			{
+				fprintf(stderr, "%s: failed to initialize the decoder.\n", path);
+				is_ok = false;
+				break;
+			}
+
+			begin = frames[target].key;
+		}
+
+		for (u32 i = begin; i <= target; ++i)
+		{
+			buffer.resize(frames[i].len);
+			if (reader.Read(frames[i].pos, frames[i].len, buffer.data()) < 0)
+			{
+				fprintf(stderr, "%s: can not read the frame %u.\n", path, i);
+				is_ok = false;
+				break;
+			}
+
+			if (vpx_codec_decode(&ctx, buffer.data(), frames[i].len, NULL, 0))
+			{
+				fprintf(stderr, "%s: failed to decode the frame %u: %s\n", path, i, vpx_codec_error(&ctx));
+			}
+
+			//an invisible frame has no image, the one before is still shown.
+			vpx_codec_iter_t iter = NULL;
+			if (vpx_image_t* p_next = vpx_codec_get_frame(&ctx, &iter))
+			{
+				p_image = p_next;
+			}
+
+			++decode_count;
+		}
+
+		cur_idx = target;
+		if (!is_ok)
+		{
+			break;
+		}
+
+		std::string out_path = gf_get_out_path(path, opt, target);
+		if (!p_image || !gf_write_image(out_path, p_image, opt))
+		{
+			fprintf(stderr, "%s: can not write the frame %u.\n", out_path.c_str(), target);
+			is_ok = false;
+			continue;
+		}
+
+		++write_count;
+	}
+
+	if (is_init)
+	{
+		vpx_codec_destroy(&ctx);
+	}
+
+	printf("%s: %u of %u frames written, %u decodes.\n", path, write_count, static_cast<u32>(frames.size()), decode_count);
+	return is_ok;
+}
+
+int main(int argc, char** argv)
+{
+	Options opt;
+	opt.is_every_key = false;
+	opt.count = 0;
+	opt.is_raw = false;
+	opt.threads = std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<char const*> paths;
+	bool is_bad = false;
+	for (int i = 1; i < argc && !is_bad; ++i)
+	{
+		char const* arg = argv[i];
+		bool const has_value = i + 1 < argc;
+		if (strcmp(arg, "-t") == 0 && has_value)
+		{
+			is_bad = !gf_parse_list(argv[++i], &opt.times);
+		}
+		else if (strcmp(arg, "-i") == 0 && has_value)
+		{
+			std::vector<f64> indices;
+			is_bad = !gf_parse_list(argv[++i], &indices);
+			for (f64 idx : indices)
+			{
+				opt.indices.push_back(static_cast<u32>(std::max(idx, 0.0)));
+			}
+		}
+		else if (strcmp(arg, "-k") == 0)
+		{
+			opt.is_every_key = true;
+		}
+		else if (strcmp(arg, "-n") == 0 && has_value)
+		{
+			opt.count = static_cast<u32>(atoi(argv[++i]));
+		}
+		else if (strcmp(arg, "-f") == 0 && has_value)
+		{
+			char const* format = argv[++i];
+			opt.is_raw = strcmp(format, "raw") == 0;
+			is_bad = !opt.is_raw && strcmp(format, "ppm") != 0;
+		}
+		else if (strcmp(arg, "-o") == 0 && has_value)
+		{
+			opt.out_dir = argv[++i];
+		}
+		else if (strcmp(arg, "-j") == 0 && has_value)
+		{
+			opt.threads = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg[0] == '-')
+		{
+			is_bad = true;
+		}
+		else
+		{
+			paths.push_back(arg);
+		}
+	}
+
+	bool const has_target = !opt.times.empty() || !opt.indices.empty() || opt.is_every_key || opt.count;
+	if (is_bad || paths.empty() || !has_target)
+	{
+		fprintf(stderr, "usage: %s [-t <s,s,...>] [-i <n,n,...>] [-k] [-n <count>] [-f ppm|raw] [-o <dir>] [-j <threads>] <movie.webm> [<movie.webm> ...]\n", argv[0]);
+		return 1;
+	}
+
+	//one movie per thread, a thread takes the next movie when it is done.
+	std::atomic<u32> next(0);
+	std::atomic<u32> failed(0);
+	std::vector<std::thread> threads;
+	u32 const thread_count = std::min<u32>(opt.threads, static_cast<u32>(paths.size()));
+	for (u32 t = 0; t < thread_count; ++t)
+	{
+		threads.emplace_back([&]()
+		{
+			for (u32 i = next++; i < paths.size(); i = next++)
+			{
+				if (!gf_extract(paths[i], opt))
+				{
+					++failed;
+				}
+			}
+		});
+	}
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	return failed ? 1 : 0;
+}
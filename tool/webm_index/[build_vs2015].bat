@@ -0,0 +1,8 @@
+@REM Run it from "VS2015 x64 Native Tools Command Prompt".
+@SET path_tool=%~dp0
+@SET path_addon=%path_tool%..\..
+@SET path_webm=%path_addon%\libs\libwebm
+
+@cl /nologo /EHsc /O2 /MD /I"%path_addon%\src" /I"%path_webm%\include" "%path_tool%webm_index.cpp" /Fe"%path_tool%webm_index.exe" /Fo"%TEMP%\\" /link /LIBPATH:"%path_webm%\lib\vs2015\x64\Release" mkvparser.lib
+
+@PAUSE
@@ -0,0 +1,92 @@
+// Writes the sidecar index "<movie>.webmidx" which ofxWebMPlayer::load() uses to
+// skip walking every block of the movie.
+//
+// usage: webm_index <movie.webm> [<movie.webm> ...]
+
+#include <stdio.h>
+#include <memory>
+#include "mkvparser/mkvreader.h"
+#include "intern_webm_index.h"
+
+static bool gf_build_index(char const* path)
+{
+	sidecar::FileId file_id;
+	if (!gf_get_file_stat(path, &file_id.size, &file_id.mtime))
+	{
+		fprintf(stderr, "%s: can not stat the file.\n", path);
+		return false;
+	}
+
+	FILE* fp = fopen(path, "rb");
+	if (!fp)
+	{
+		fprintf(stderr, "%s: can not open the file.\n", path);
+		return false;
+	}
+
+	//a reader made from a FILE* does not close it.
+	std::unique_ptr<FILE, decltype(&fclose)> up_fp(fp, &fclose);
+	file_id.hash = sidecar::hashFile(fp, file_id.size);
+	mkvparser::MkvReader reader(fp);
+
+	long long pos = 0;
+	mkvparser::EBMLHeader ebml_header;
+	if (ebml_header.Parse(&reader, pos) < 0)
+	{
+		fprintf(stderr, "%s: not WebM format.\n", path);
+		return false;
+	}
+
+	mkvparser::Segment* p_segment;
+	if (mkvparser::Segment::CreateInstance(&reader, pos, p_segment) < 0)
+	{
+		fprintf(stderr, "%s: Segment::CreateInstance() failed.\n", path);
+		return false;
+	}
+
+	std::unique_ptr<mkvparser::Segment> up_segment(p_segment);
+	if (p_segment->Load() < 0)
+	{
+		fprintf(stderr, "%s: Segment::Load() failed.\n", path);
+		return false;
+	}
+
+	std::vector<u8> data;
+	if (!sidecar::build(p_segment, file_id, &data))
+	{
+		fprintf(stderr, "%s: no video track.\n", path);
+		return false;
+	}
+
+	std::string index_path = sidecar::getPath(path);
+	if (!sidecar::writeFile(index_path.c_str(), data))
+	{
+		fprintf(stderr, "%s: can not write the index.\n", index_path.c_str());
+		return false;
+	}
+
+	sidecar::Header const* p_hdr = reinterpret_cast<sidecar::Header const*>(data.data());
+	printf("%s: %u frames, %u key frames, %u audio packets.\n", index_path.c_str(),
+		p_hdr->frame_count, p_hdr->key_count, p_hdr->audio_packet_count);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <movie.webm> [<movie.webm> ...]\n", argv[0]);
+		return 1;
+	}
+
+	int failed = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!gf_build_index(argv[i]))
+		{
+			++failed;
+		}
+	}
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,152 @@
+// Checks that a player lands on the right frames: loads movies headless with a
+// fake clock and frame checksums, plays them through with and without drops,
+// loops, seeks with setPosition() and setFrame(), steps with nextFrame() and
+// previousFrame(), and compares the checksum of every frame presented against
+// computeFrameChecksums(), a plain decode from the first frame. The exit code
+// is the number of movies with a mismatch.
+//
+// usage: webm_playback_check <movie.webm> [<movie.webm> ...]
+//
+// Unlike webm_index and webm_frames it needs openFrameworks, the player is
+// the one under test: make a project with the projectGenerator, with the
+// ofxWebMPlayer addon and this file as its main.cpp. No window is opened.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "ofMain.h"
+#include "ofxWebMPlayer.h"
+
+typedef struct Check
+{
+	std::vector<unsigned int> const*	p_reference;
+	std::string							movie;
+	unsigned int						count;
+	unsigned int						mismatches;
+} Check;
+
+static void gf_expect(ofxWebMPlayer const& player, Check* p_check, char const* cstr_step)
+{
+	int const frame = player.getCurrentFrame();
+	std::vector<unsigned int> const& reference = *p_check->p_reference;
+	++p_check->count;
+	if (frame < 0 || frame >= static_cast<int>(reference.size()))
+	{
+		++p_check->mismatches;
+		fprintf(stderr, "%s: %s: frame %d is out of the movie.\n", p_check->movie.c_str(), cstr_step, frame);
+		return;
+	}
+
+	if (player.getFrameChecksum() != reference[frame])
+	{
+		++p_check->mismatches;
+		fprintf(stderr, "%s: %s: frame %d is %08x, the reference is %08x.\n", p_check->movie.c_str(), cstr_step, frame, player.getFrameChecksum(), reference[frame]);
+	}
+}
+
+//steps the clock by step_ms until count frames went by, every new frame is checked.
+static void gf_run(ofxWebMPlayer* p_player, unsigned long long* p_millis, unsigned long long step_ms, unsigned int count, Check* p_check, char const* cstr_step)
+{
+	for (unsigned int i = 0; i < count && p_player->isPlaying(); ++i)
+	{
+		*p_millis += step_ms;
+		p_player->update();
+		if (p_player->isFrameNew())
+		{
+			gf_expect(*p_player, p_check, cstr_step);
+		}
+	}
+}
+
+static bool gf_check_movie(char const* path)
+{
+	std::vector<unsigned int> reference;
+	if (!ofxWebMPlayer::computeFrameChecksums(path, &reference) || reference.empty())
+	{
+		fprintf(stderr, "%s: failed to decode the reference.\n", path);
+		return false;
+	}
+
+	unsigned long long millis = 0;
+	ofxWebMPlayer player;
+	player.enableHeadless(true);
+	player.enableFrameChecksums(true);
+	player.setClock([&millis]() { return millis; });
+	if (!player.load(path))
+	{
+		fprintf(stderr, "%s: failed to load.\n", path);
+		return false;
+	}
+
+	Check check = { &reference, path, 0, 0 };
+	unsigned int const frame_count = static_cast<unsigned int>(reference.size());
+	unsigned long long const frame_ms = std::max(1ull, static_cast<unsigned long long>(player.getDuration() * 1000.f / frame_count));
+	gf_expect(player, &check, "load");
+
+	//every frame, then 3 at a time so most are decoded and dropped, round the loop twice.
+	player.setLoopState(OF_LOOP_NORMAL);
+	player.play();
+	gf_run(&player, &millis, frame_ms, frame_count + frame_count / 2, &check, "play");
+	gf_run(&player, &millis, frame_ms * 3, frame_count, &check, "play x3");
+
+	//seeks from wherever playback is, into and out of the GOP it is in.
+	srand(1);
+	for (unsigned int i = 0; i < 32; ++i)
+	{
+		player.setPosition(static_cast<float>(rand()) / RAND_MAX);
+		gf_run(&player, &millis, frame_ms, 2, &check, "setPosition");
+
+		player.setFrame(rand() % frame_count);
+		gf_expect(player, &check, "setFrame");
+		gf_run(&player, &millis, frame_ms, 2, &check, "setFrame + play");
+	}
+
+	//steps forth and back, paused.
+	player.setPaused(true);
+	player.firstFrame();
+	gf_expect(player, &check, "firstFrame");
+	for (unsigned int i = 1; i < frame_count; ++i)
+	{
+		player.nextFrame();
+		gf_expect(player, &check, "nextFrame");
+	}
+
+	for (unsigned int i = 1; i < frame_count; ++i)
+	{
+		player.previousFrame();
+		gf_expect(player, &check, "previousFrame");
+	}
+
+	//to the end without a loop, it has to stop on the last frame.
+	player.setLoopState(OF_LOOP_NONE);
+	player.setFrame(frame_count / 2);
+	player.setPaused(false);
+	gf_run(&player, &millis, frame_ms, frame_count, &check, "play to the end");
+	gf_expect(player, &check, "end");
+
+	player.close();
+	printf("%s: %u frames, %u checks, %u mismatches.\n", path, frame_count, check.count, check.mismatches);
+	return check.mismatches == 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: webm_playback_check <movie.webm> [<movie.webm> ...]\n");
+		return -1;
+	}
+
+	int failed = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!gf_check_movie(argv[i]))
+		{
+			++failed;
+		}
+	}
+
+	return failed;
+}